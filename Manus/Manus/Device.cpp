@@ -17,9 +17,19 @@ limitations under the License.
 #include "stdafx.h"
 #include "Device.h"
 #include "ManusMath.h"
-
+#include "SharedMemory.h"
+#include "OutputBuffer.h"
+#include "Metrics.h"
+#include "Trace.h"
+
+#ifdef MANUS_HIDRAW
+#include "HidrawBackend.h"
+#else
 #include <hidapi.h>
+#endif
 #include <limits>
+#include <math.h>
+#include <string.h>
 
 
 
@@ -28,14 +38,50 @@ limitations under the License.
 #define ACCEL_DIVISOR 16384.0f
 #define QUAT_DIVISOR 16384.0f
 #define COMPASS_DIVISOR 32.0f
-#define FINGER_DIVISOR 255.0f
 
+// The raw report is the wire report preceded by the timestamp and packet number
+static_assert(sizeof(GLOVE_RAW_REPORT) == sizeof(uint64_t) + sizeof(uint32_t) + sizeof(GLOVE_REPORT), "GLOVE_RAW_REPORT must match GLOVE_REPORT");
+
+static_assert(sizeof(USB_OUT_PACKET) <= CAPTURE_MAX_DATA, "USB_OUT_PACKET doesn't fit in a capture record");
+
+std::atomic<uint32_t> Device::s_decode_fields(GLOVE_DECODE_ALL);
+std::mutex Device::s_filter_mutex;
+GLOVE_FILTER_PARAMS Device::s_filter_params[2][GLOVE_FILTER_CHANNELS];
+bool Device::s_filter_enabled[2][GLOVE_FILTER_CHANNELS];
+std::atomic<uint32_t> Device::s_filter_version(1);
+std::atomic<uint32_t> Device::s_write_budget(0);
+std::atomic<uint32_t> Device::s_sequence[2];
+EventCount Device::s_arrivals;
+std::atomic<bool> Device::s_waits_enabled(false);
+
+Device::Device(const char* device_path, DeviceBackend* backend)
+	: m_running(false), m_filter_version(0), m_opens(0), m_data_out_head(0), m_data_out_tail(0), m_write_held(false) {
+	memset(m_filter_timestamp, 0, sizeof(m_filter_timestamp));
+	memset(m_compass_valid, 0, sizeof(m_compass_valid));
+	memset(m_device_id, 0, sizeof(m_device_id));
+	memset(m_raw_count, 0, sizeof(m_raw_count));
+	memset(m_read_time, 0, sizeof(m_read_time));
+	memset(m_device_id_requested, 0, sizeof(m_device_id_requested));
+	memset(m_rumble_out, 0, sizeof(m_rumble_out));
+	memset(m_rumble_sent, 0, sizeof(m_rumble_sent));
+	memset(&m_write_stats, 0, sizeof(m_write_stats));
+	memset(m_stats_wanted, 0, sizeof(m_stats_wanted));
+	for (int i = 0; i < DEVICE_TYPE_COUNT; i++)
+		m_sequence[i] = 0;
+	for (int i = 0; i < DEVICE_TYPE_COUNT; i++) {
+		m_arrival[i].last_interval = 0;
+		m_arrival[i].window_start = 0;
+		m_arrival[i].window_count = 0;
+	}
 
-Device::Device(const char* device_path)
-	: m_running(false) {
 	size_t len = strlen(device_path) + 1;
 	m_device_path = new char[len];
 	memcpy(m_device_path, device_path, len * sizeof(char));
+#ifdef MANUS_HIDRAW
+	m_backend = backend ? backend : new HidrawBackend(device_path);
+#else
+	m_backend = backend ? backend : new HidBackend(device_path);
+#endif
 
 	Connect();
 }
@@ -43,49 +89,366 @@ Device::Device(const char* device_path)
 Device::~Device()
 {
 	Disconnect();
+	delete m_backend;
 	delete m_device_path;
 }
 
 
 bool Device::IsConnected(device_type_t device) {
 	return  m_running && m_local_stats[device - DEVICE_TYPE_LOW].packet_count &&
-		(clock() - m_local_stats[device - DEVICE_TYPE_LOW].last_seen) < CLOCKS_PER_SEC;
+		(DeviceTimestamp() - m_local_stats[device - DEVICE_TYPE_LOW].last_seen) < DEVICE_TIMEOUT_NS;
+}
+
+std::unique_lock<std::mutex> Device::LockReport(uint8_t deviceNr) {
+	// Only a contended lock is timed, the uncontended case counts as no wait
+	std::unique_lock<std::mutex> lk(m_report_mutex[deviceNr], std::try_to_lock);
+	uint64_t wait = 0;
+	if (!lk.owns_lock()) {
+		uint64_t begin = DeviceTimestamp();
+		lk.lock();
+		wait = DeviceTimestamp() - begin;
+	}
+	m_latency[deviceNr][GLOVE_LATENCY_LOCK_WAIT].Record(wait);
+	return lk;
+}
+
+bool Device::WaitSample(uint8_t deviceNr, uint64_t after_seq, unsigned int timeout) {
+	// Any other sequence is newer, one from another dongle included
+	if (m_sequence[deviceNr].load(std::memory_order_seq_cst) != after_seq)
+		return true;
+
+	EventCount& events = m_sample_events[deviceNr];
+	uint64_t deadline = DeviceTimestamp() + timeout * 1000000ull;
+	for (;;) {
+		uint32_t epoch = events.PrepareWait();
+		if (m_sequence[deviceNr].load(std::memory_order_seq_cst) != after_seq) {
+			events.CancelWait();
+			return true;
+		}
+
+		uint64_t now = DeviceTimestamp();
+		if (!m_running || now >= deadline) {
+			events.CancelWait();
+			return false;
+		}
+		events.Wait(epoch, deadline - now);
+	}
+}
+
+// Queued packets are compared byte for byte, so every byte of the union is cleared
+static ESB_DATA_PACKET MakePacket(device_type_t device, uint8_t message_type) {
+	ESB_DATA_PACKET packet;
+	memset(&packet, 0, sizeof(packet));
+	packet.device_type = device;
+	packet.message_type = message_type;
+	return packet;
+}
+
+bool Device::QueueMessage(const ESB_DATA_PACKET& packet) {
+	std::lock_guard<std::mutex> lk(m_data_out_mutex);
+	m_write_stats.requested++;
+
+	// A newer rumble makes the one that wasn't sent yet obsolete
+	if (packet.message_type >= MSG_RUMBLE && packet.message_type <= MSG_RUMBLE_PWR) {
+		if (packet.device_type < DEVICE_TYPE_LOW || packet.device_type >= DEVICE_TYPE_LOW + DEVICE_TYPE_COUNT)
+			return false;
+		ESB_DATA_PACKET& pending = m_rumble_out[packet.device_type - DEVICE_TYPE_LOW];
+		const ESB_DATA_PACKET& sent = m_rumble_sent[packet.device_type - DEVICE_TYPE_LOW];
+
+		if (pending.device_type && memcmp(&pending, &packet, sizeof(packet)) == 0) {
+			m_write_stats.deduplicated++;
+			return true;
+		}
+		if (pending.device_type)
+			m_write_stats.superseded++;
+
+		// A power the glove already runs at needs no message, a timed
+		// rumble restarts its duration so it's always sent
+		if (packet.message_type != MSG_RUMBLE_TIM && memcmp(&sent, &packet, sizeof(packet)) == 0) {
+			pending.device_type = DEV_NONE;
+			m_write_stats.deduplicated++;
+			return true;
+		}
+		pending = packet;
+		return true;
+	}
+
+	for (uint32_t i = m_data_out_tail; i != m_data_out_head; i++) {
+		if (memcmp(&m_data_out[i & (OUT_QUEUE_SIZE - 1)], &packet, sizeof(packet)) == 0) {
+			m_write_stats.deduplicated++;
+			return true;
+		}
+	}
+
+	if (m_data_out_head - m_data_out_tail >= OUT_QUEUE_SIZE) {
+		m_write_stats.dropped++;
+		return false;
+	}
+	m_data_out[m_data_out_head++ & (OUT_QUEUE_SIZE - 1)] = packet;
+	return true;
+}
+
+bool Device::NextMessage(ESB_DATA_PACKET& packet) {
+	std::lock_guard<std::mutex> lk(m_data_out_mutex);
+
+	for (int i = 0; i < DEVICE_TYPE_COUNT; i++) {
+		if (m_rumble_out[i].device_type) {
+			packet = m_rumble_out[i];
+			m_rumble_sent[i] = packet;
+			m_rumble_out[i].device_type = DEV_NONE;
+			m_write_stats.written++;
+			m_write_held = false;
+			return true;
+		}
+	}
+
+	if (m_data_out_head == m_data_out_tail)
+		return false;
+	packet = m_data_out[m_data_out_tail++ & (OUT_QUEUE_SIZE - 1)];
+	m_write_stats.written++;
+	m_write_held = false;
+	return true;
+}
+
+void Device::ThrottleMessages() {
+	std::lock_guard<std::mutex> lk(m_data_out_mutex);
+	// Called on every pass of the device thread while the budget is spent,
+	// the message that waits is only counted once
+	if (m_write_held)
+		return;
+	bool pending = m_data_out_head != m_data_out_tail;
+	for (int i = 0; i < DEVICE_TYPE_COUNT; i++)
+		pending |= m_rumble_out[i].device_type != DEV_NONE;
+	if (pending) {
+		m_write_stats.throttled++;
+		m_write_held = true;
+	}
+}
+
+void Device::ClearMessages() {
+	std::lock_guard<std::mutex> lk(m_data_out_mutex);
+	// The state of a glove that reconnects is unknown
+	for (int i = 0; i < DEVICE_TYPE_COUNT; i++) {
+		m_rumble_out[i].device_type = DEV_NONE;
+		m_rumble_sent[i].device_type = DEV_NONE;
+	}
+	m_data_out_tail = m_data_out_head;
+	m_write_held = false;
+}
+
+static bool NewerSample(const std::atomic<uint32_t> sequence[2], uint32_t hand_mask, uint32_t last_seen[2], GLOVE_HAND& which) {
+	for (int hand = 0; hand < 2; hand++) {
+		if (!(hand_mask & (1 << hand)))
+			continue;
+		uint32_t current = sequence[hand].load(std::memory_order_seq_cst);
+		if (current != last_seen[hand]) {
+			last_seen[hand] = current;
+			which = (GLOVE_HAND)hand;
+			return true;
+		}
+	}
+	return false;
+}
+
+int Device::WaitAny(uint32_t hand_mask, uint32_t last_seen[2], unsigned int timeout, GLOVE_HAND& which) {
+	if (NewerSample(s_sequence, hand_mask, last_seen, which))
+		return MANUS_SUCCESS;
+
+	uint64_t deadline = DeviceTimestamp() + timeout * 1000000ull;
+	for (;;) {
+		// Announce the wait before checking again, a sample published in
+		// between then ends the wait at once
+		uint32_t epoch = s_arrivals.PrepareWait();
+		if (NewerSample(s_sequence, hand_mask, last_seen, which)) {
+			s_arrivals.CancelWait();
+			return MANUS_SUCCESS;
+		}
+		if (!s_waits_enabled.load(std::memory_order_seq_cst)) {
+			s_arrivals.CancelWait();
+			return MANUS_DISCONNECTED;
+		}
+
+		uint64_t now = DeviceTimestamp();
+		if (now >= deadline) {
+			s_arrivals.CancelWait();
+			return MANUS_NO_DATA;
+		}
+		s_arrivals.Wait(epoch, deadline - now);
+	}
+}
+
+void Device::GetMetrics(GLOVE_DONGLE_METRICS& metrics) {
+	for (int i = 0; i < 2; i++) {
+		metrics.packets[i] = m_local_stats[i].packet_count.load(std::memory_order_relaxed);
+		// The rate of the last window is stale once the glove is gone
+		if (IsConnected((device_type_t)(DEVICE_TYPE_LOW + i)))
+			metrics.packets_per_second[i] = m_arrival[i].packets_per_second.load(std::memory_order_relaxed);
+		else
+			metrics.packets_per_second[i] = 0.0f;
+		metrics.jitter_ns[i] = m_arrival[i].jitter_ns.load(std::memory_order_relaxed);
+	}
+
+	LATENCY_SNAPSHOT snapshot;
+	LatencyHistogram::ClearSnapshot(snapshot);
+	m_latency[0][GLOVE_LATENCY_DECODE].AddTo(snapshot);
+	m_latency[1][GLOVE_LATENCY_DECODE].AddTo(snapshot);
+	metrics.decode_ns = snapshot.count ? snapshot.sum / snapshot.count : 0;
+
+	uint32_t opens = m_opens.load(std::memory_order_relaxed);
+	metrics.reconnects = opens ? opens - 1 : 0;
+
+	std::lock_guard<std::mutex> lk(m_data_out_mutex);
+	metrics.queue_depth = m_data_out_head - m_data_out_tail;
+	for (int i = 0; i < DEVICE_TYPE_COUNT; i++)
+		metrics.queue_depth += m_rumble_out[i].device_type ? 1 : 0;
+	metrics.dropped_commands = m_write_stats.dropped;
+}
+
+void Device::UpdateArrival(uint8_t deviceNr, uint64_t read_time) {
+	// Called from the device thread with the previous read time still in m_read_time
+	ARRIVAL_STATS& arrival = m_arrival[deviceNr];
+	if (m_read_time[deviceNr]) {
+		// Interarrival jitter as in RTP (RFC 3550), smoothed over 16 reports
+		uint64_t interval = read_time - m_read_time[deviceNr];
+		if (arrival.last_interval) {
+			int64_t d = (int64_t)(interval - arrival.last_interval);
+			uint64_t jitter = arrival.jitter_ns.load(std::memory_order_relaxed);
+			jitter += ((d < 0 ? -d : d) - (int64_t)jitter) / 16;
+			arrival.jitter_ns.store(jitter, std::memory_order_relaxed);
+		}
+		arrival.last_interval = interval;
+	}
+
+	arrival.window_count++;
+	if (read_time - arrival.window_start >= 1000000000ull) {
+		if (arrival.window_start)
+			arrival.packets_per_second.store(arrival.window_count * 1e9f / (read_time - arrival.window_start), std::memory_order_relaxed);
+		arrival.window_start = read_time;
+		arrival.window_count = 0;
+	}
 }
 
+void Device::AddWriteStats(GLOVE_WRITE_STATS& stats) {
+	std::lock_guard<std::mutex> lk(m_data_out_mutex);
+	stats.requested += m_write_stats.requested;
+	stats.written += m_write_stats.written;
+	stats.deduplicated += m_write_stats.deduplicated;
+	stats.superseded += m_write_stats.superseded;
+	stats.dropped += m_write_stats.dropped;
+	stats.throttled += m_write_stats.throttled;
+}
 
-bool Device::GetData(GLOVE_DATA* data, device_type_t device, unsigned int timeout) {
+
+bool Device::GetData(GLOVE_DATA* data, device_type_t device, unsigned int timeout, uint64_t* read_time) {
 	if (!IsConnected(device)) return false;
+	uint64_t begin = DeviceTimestamp();
+	MetricsReader reader;
 
 	uint8_t deviceNr = device - DEVICE_TYPE_LOW;
-	// Wait until the thread is done writing a packet
-	std::unique_lock<std::mutex> lk(m_report_mutex[deviceNr]);
 
 	// Optionally wait until the next package is sent
 	if (timeout > 0)
 	{
-		m_report_cv[deviceNr].wait_for(lk, std::chrono::milliseconds(timeout));
+		WaitSample(deviceNr, m_sequence[deviceNr], timeout);
 		if (!m_running)
-		{
-			lk.unlock();
 			return false;
-		}
 	}
 
+	// Wait until the thread is done writing a packet
+	std::unique_lock<std::mutex> lk = LockReport(deviceNr);
 	*data = m_data[deviceNr];
+	uint64_t data_read_time = m_read_time[deviceNr];
 
 	lk.unlock();
 
+	RecordLatency(GLOVE_LATENCY_CONSUMER, device, data_read_time, begin);
+	if (read_time)
+		*read_time = data_read_time;
+
 	return IsConnected(device);
 	
 }
 
+int Device::GetDataAfter(GLOVE_DATA* data, device_type_t device, uint64_t after_seq, uint64_t* seq, unsigned int timeout) {
+	if (!IsConnected(device)) return MANUS_DISCONNECTED;
+	uint64_t begin = DeviceTimestamp();
+	MetricsReader reader;
+
+	uint8_t deviceNr = device - DEVICE_TYPE_LOW;
+	if (!WaitSample(deviceNr, after_seq, timeout))
+		return m_running ? MANUS_NO_DATA : MANUS_DISCONNECTED;
+
+	// The sequence is raised under the report lock, so it belongs to this data
+	std::unique_lock<std::mutex> lk = LockReport(deviceNr);
+	*data = m_data[deviceNr];
+	*seq = m_sequence[deviceNr].load(std::memory_order_relaxed);
+	uint64_t data_read_time = m_read_time[deviceNr];
+	lk.unlock();
+
+	RecordLatency(GLOVE_LATENCY_CONSUMER, device, data_read_time, begin);
+	return IsConnected(device) ? MANUS_SUCCESS : MANUS_DISCONNECTED;
+}
+
+void Device::RecordLatency(GLOVE_LATENCY_STAGE stage, device_type_t device, uint64_t read_time, uint64_t begin) {
+	uint8_t deviceNr = device - DEVICE_TYPE_LOW;
+	uint64_t end = DeviceTimestamp();
+	m_latency[deviceNr][stage].Record(end - read_time);
+	if (LatencyTrace::IsEnabled())
+		m_trace.Record(stage, deviceNr, begin, end, read_time);
+}
+
+void Device::AddLatency(GLOVE_LATENCY_STAGE stage, device_type_t device, LATENCY_SNAPSHOT& snapshot) const {
+	m_latency[device - DEVICE_TYPE_LOW][stage].AddTo(snapshot);
+}
+
+void Device::ResetLatency() {
+	for (int devNr = 0; devNr < DEVICE_TYPE_COUNT; devNr++)
+		for (int stage = 0; stage < GLOVE_LATENCY_STAGES; stage++)
+			m_latency[devNr][stage].Reset();
+}
+
+bool Device::GetPredictedData(GLOVE_DATA* data, device_type_t device, uint64_t target_time) {
+	if (!IsConnected(device)) return false;
+
+	uint8_t deviceNr = device - DEVICE_TYPE_LOW;
+	// The velocity estimates are updated by the device thread under the same lock
+	std::unique_lock<std::mutex> lk = LockReport(deviceNr);
+	return m_predictor[deviceNr].Predict(data, target_time);
+}
+
+bool Device::GetRawReport(GLOVE_RAW_REPORT* report, device_type_t device) {
+	if (!IsConnected(device)) return false;
+	uint8_t deviceNr = device - DEVICE_TYPE_LOW;
+
+	std::unique_lock<std::mutex> lk = LockReport(deviceNr);
+	if (!m_raw_count[deviceNr])
+		return false;
+	*report = m_raw_history[deviceNr][(m_raw_count[deviceNr] - 1) & (RAW_HISTORY_SIZE - 1)];
+	return true;
+}
+
+bool Device::GetRawHistory(GLOVE_RAW_REPORT* reports, unsigned int count, unsigned int &copied, device_type_t device) {
+	if (!IsConnected(device)) return false;
+	uint8_t deviceNr = device - DEVICE_TYPE_LOW;
+
+	std::unique_lock<std::mutex> lk = LockReport(deviceNr);
+	uint32_t available = m_raw_count[deviceNr] < RAW_HISTORY_SIZE ? m_raw_count[deviceNr] : RAW_HISTORY_SIZE;
+	copied = count < available ? count : available;
+
+	// Copy the most recent reports, oldest first
+	uint32_t first = m_raw_count[deviceNr] - copied;
+	for (unsigned int i = 0; i < copied; i++)
+		reports[i] = m_raw_history[deviceNr][(first + i) & (RAW_HISTORY_SIZE - 1)];
+	return true;
+}
+
 bool Device::GetFlags(uint8_t & flags, device_type_t device, unsigned int timeout) {
 	if (!IsConnected(device)) return false;
 	uint8_t deviceNr = device - DEVICE_TYPE_LOW;
 
 	// Send request for flags
-	m_data_out.device_type = device;
-	m_data_out.message_type = MSG_FLAGS_GET;
+	ESB_DATA_PACKET packet = MakePacket(device, MSG_FLAGS_GET);
+	QueueMessage(packet);
 
 	std::unique_lock<std::mutex> lk(m_flags_mutex[deviceNr]);
 
@@ -109,12 +472,20 @@ bool Device::GetFlags(uint8_t & flags, device_type_t device, unsigned int timeou
 	
 }
 
+void Device::RequestStats(device_type_t device) {
+	uint8_t deviceNr = device - DEVICE_TYPE_LOW;
+	{
+		std::lock_guard<std::mutex> lk(m_stats_mutex[deviceNr]);
+		m_stats_wanted[deviceNr] = true;
+	}
+	QueueMessage(MakePacket(device, MSG_STATS_GET));
+}
+
 bool Device::GetRssi(int32_t &rssi, device_type_t device, unsigned int timeout) {
 	if (!IsConnected(device)) return false;
 	uint8_t deviceNr = device - DEVICE_TYPE_LOW;
 	// Send request for stats
-	m_data_out.device_type = device;
-	m_data_out.message_type = MSG_STATS_GET;
+	RequestStats(device);
 
 	std::unique_lock<std::mutex> lk(m_stats_mutex[deviceNr]);
 	
@@ -144,8 +515,7 @@ bool Device::GetBatteryVoltage(uint16_t &voltage, device_type_t device, unsigned
 	uint8_t deviceNr = device - DEVICE_TYPE_LOW;
 
 	// Send request for stats
-	m_data_out.device_type = device;
-	m_data_out.message_type = MSG_STATS_GET;
+	RequestStats(device);
 
 	std::unique_lock<std::mutex> lk(m_stats_mutex[deviceNr]);
 
@@ -175,8 +545,7 @@ bool Device::GetBatteryPercentage(uint8_t &percentage, device_type_t device, uns
 	uint8_t deviceNr = device - DEVICE_TYPE_LOW;
 
 	// Send request for stats
-	m_data_out.device_type = device;
-	m_data_out.message_type = MSG_STATS_GET;
+	RequestStats(device);
 
 	std::unique_lock<std::mutex> lk(m_stats_mutex[deviceNr]);
 
@@ -207,28 +576,150 @@ bool Device::SetVibration(float power, device_type_t device, unsigned int timeou
 	if (power < 0) power = 0.0f;
 	if (power > 1) power = 1.0f;
 
-	m_data_out.device_type = device;
-	m_data_out.message_type = MSG_RUMBLE_PWR;
-	m_data_out.rumble.power = (uint16_t)(0xFFFF * power);
+	ESB_DATA_PACKET packet = MakePacket(device, MSG_RUMBLE_PWR);
+	packet.rumble.power = (uint16_t)(0xFFFF * power);
+	QueueMessage(packet);
 	return true;
 }
 
 
+bool Device::SetTimedVibration(float power, unsigned int duration_ms, device_type_t device) {
+	if (!IsConnected(device)) return false;
+	// clipping
+	if (power < 0) power = 0.0f;
+	if (power > 1) power = 1.0f;
+	if (duration_ms > 0xFFFF) duration_ms = 0xFFFF;
+
+	// The glove stops by itself after the duration
+	ESB_DATA_PACKET packet = MakePacket(device, MSG_RUMBLE_TIM);
+	packet.rumble.power = (uint16_t)(0xFFFF * power);
+	packet.rumble.duration = (uint16_t)duration_ms;
+	return QueueMessage(packet);
+}
+
 bool Device::SetFlags(uint8_t flags, device_type_t device) {
 	if (!IsConnected(device)) return false;
-	m_data_out.device_type = device;
-	m_data_out.message_type = MSG_FLAGS_SET;
-	m_data_out.flags.flags = flags;
+	ESB_DATA_PACKET packet = MakePacket(device, MSG_FLAGS_SET);
+	packet.flags.flags = flags;
+	QueueMessage(packet);
 	return true;
 }
 
 bool Device::PowerOff(device_type_t device) {
 	if (!IsConnected(device)) return false;
-	m_data_out.device_type = device;
-	m_data_out.message_type = MSG_POWER_OFF;
+	ESB_DATA_PACKET packet = MakePacket(device, MSG_POWER_OFF);
+	QueueMessage(packet);
+	return true;
+}
+
+bool Device::StartFingerCalibration(device_type_t device) {
+	if (!IsConnected(device)) return false;
+	uint8_t deviceNr = device - DEVICE_TYPE_LOW;
+
+	std::unique_lock<std::mutex> lk = LockReport(deviceNr);
+	m_finger_calibration[deviceNr].StartRecording();
+	return true;
+}
+
+bool Device::StopFingerCalibration(device_type_t device, bool save) {
+	if (!IsConnected(device)) return false;
+	uint8_t deviceNr = device - DEVICE_TYPE_LOW;
+
+	std::unique_lock<std::mutex> lk = LockReport(deviceNr);
+	if (!m_finger_calibration[deviceNr].StopRecording())
+		return false;
+	FINGER_PROFILE profile = m_finger_calibration[deviceNr].GetProfile();
+	// The device thread needs the lock for every report, don't hold it while writing the file
+	lk.unlock();
+
+	// Without a device id there's nothing to key the profile on
+	if (save && profile.device_id)
+		return FingerCalibration::SaveProfile(profile);
+	return true;
+}
+
+bool Device::SetFingerResponse(const float gamma[GLOVE_FINGERS], device_type_t device) {
+	if (!IsConnected(device)) return false;
+	uint8_t deviceNr = device - DEVICE_TYPE_LOW;
+
+	// The profile is in report order, which is reversed for the left hand
+	float report_gamma[GLOVE_FINGERS];
+	for (int j = 0; j < GLOVE_FINGERS; j++) {
+		if (device == DEV_GLOVE_RIGHT)
+			report_gamma[j] = gamma[j];
+		else
+			report_gamma[GLOVE_FINGERS - (j + 1)] = gamma[j];
+	}
+
+	std::unique_lock<std::mutex> lk = LockReport(deviceNr);
+	m_finger_calibration[deviceNr].SetResponse(report_gamma);
+	uint32_t device_id = m_finger_calibration[deviceNr].GetDeviceId();
+	lk.unlock();
+
+	// Stored right away, a later calibration keeps it
+	if (device_id)
+		return FingerCalibration::SaveResponse(device_id, report_gamma);
+	return true;
+}
+
+bool Device::AddCompassSample(const int16_t compass[GLOVE_AXES], device_type_t device) {
+	if (!IsConnected(device)) return false;
+	uint8_t deviceNr = device - DEVICE_TYPE_LOW;
+
+	float sample[GLOVE_AXES];
+	for (int i = 0; i < GLOVE_AXES; i++)
+		sample[i] = compass[i] / COMPASS_DIVISOR;
+
+	// The fit runs in the background, this only copies the sample
+	m_mag_calibration[deviceNr].AddSample(sample);
+
+	std::unique_lock<std::mutex> lk = LockReport(deviceNr);
+	memcpy(m_compass[deviceNr], sample, sizeof(sample));
+	m_compass_valid[deviceNr] = true;
 	return true;
 }
 
+bool Device::GetHeading(float &heading, device_type_t device) {
+	if (!IsConnected(device)) return false;
+	uint8_t deviceNr = device - DEVICE_TYPE_LOW;
+
+	float sample[GLOVE_AXES];
+	GLOVE_QUATERNION orientation;
+	{
+		std::unique_lock<std::mutex> lk = LockReport(deviceNr);
+		if (!m_compass_valid[deviceNr])
+			return false;
+		memcpy(sample, m_compass[deviceNr], sizeof(sample));
+		orientation = m_data[deviceNr].Quaternion;
+	}
+
+	float field[GLOVE_AXES];
+	if (!m_mag_calibration[deviceNr].Correct(field, sample))
+		return false;
+
+	// Rotate the calibrated field into the world frame to compensate for the tilt
+	GLOVE_QUATERNION v = { 0.0f, field[0], field[1], field[2] };
+	v = ManusMath::QuaternionMultiply(ManusMath::QuaternionMultiply(orientation, v), ManusMath::QuaternionConjugate(orientation));
+
+	heading = atan2f(v.y, v.x);
+	return true;
+}
+
+bool Device::GetGesture(int &gesture, device_type_t device) {
+	if (!IsConnected(device)) return false;
+	if (device != DEV_GLOVE_LEFT && device != DEV_GLOVE_RIGHT) return false;
+	gesture = m_gestures.GetGesture(device == DEV_GLOVE_LEFT ? GLOVE_LEFT : GLOVE_RIGHT);
+	return true;
+}
+
+void Device::SetFilter(GLOVE_HAND hand, GLOVE_FILTER_CHANNEL channel, const GLOVE_FILTER_PARAMS* params) {
+	std::lock_guard<std::mutex> lk(s_filter_mutex);
+	s_filter_enabled[hand][channel] = params != NULL;
+	if (params)
+		s_filter_params[hand][channel] = *params;
+	s_filter_version++;
+}
+
 void Device::Connect() {
 	Disconnect();
 	m_thread = std::thread(DeviceThread, this);
@@ -238,52 +729,76 @@ void Device::Disconnect() {
 	// Instruct the device thread to stop and
 	// wait for it to shut down.
 	m_running = false;
-	m_data_out.device_type = DEV_NONE;
 	if (m_thread.joinable())
 		m_thread.join();
 }
 
 void Device::DeviceThread(Device* dev) {
 	// TODO: remove threading? (HIDAPI can work without, just return old report when hid_read returns 0)
-	dev->m_device = hid_open_path(dev->m_device_path);
-
-	if (!dev->m_device)
+	if (!dev->m_backend->Open())
 		return;
 
+	// Messages queued for the previous connection are dropped
+	dev->ClearMessages();
+	dev->m_opens.fetch_add(1, std::memory_order_relaxed);
 	dev->m_running = true;
 
+	// Earliest time of the next write when the write budget is spent
+	uint64_t next_write = 0;
+
 	// Keep retrieving reports while the SDK is running and the device is connected
-	while (dev->m_running && dev->m_device)
+	while (dev->m_running)
 	{
 		
-		if (dev->m_data_out.device_type) {
-			USB_OUT_PACKET data;
-			data.report_id = 0;
-			data.data = dev->m_data_out;
-			int write = hid_write(dev->m_device, (uint8_t*)(&data), sizeof(data));
-			
-			dev->m_data_out.device_type = DEV_NONE;
+		// One message per report keeps the radio free for the glove data,
+		// the budget spaces the writes further with room for a short burst
+		USB_OUT_PACKET data;
+		data.report_id = 0;
+		uint32_t budget = s_write_budget.load(std::memory_order_relaxed);
+		uint64_t interval = budget ? 1000000000ull / budget : 0;
+		uint64_t now = DeviceTimestamp();
+		if (next_write > now + interval * (WRITE_BURST - 1)) {
+			dev->ThrottleMessages();
+		} else if (dev->NextMessage(data.data)) {
+			MANUS_TRACE_SCOPE("Device::Write");
+			next_write = (next_write > now ? next_write : now) + interval;
+			dev->m_capture.Record(CAPTURE_OUT, &data, sizeof(data), now);
+			int write = dev->m_backend->Write((uint8_t*)(&data), sizeof(data));
 		}
 
 		uint8_t report[32];
-		//int read = hid_read(dev->m_device, report, sizeof(report));
-		int read = hid_read_timeout(dev->m_device, report, sizeof(report), HID_READ_TIMEOUT_MS);
+		int read = dev->m_backend->Read(report, sizeof(report), HID_READ_TIMEOUT_MS);
+		uint64_t timestamp = dev->m_backend->Timestamp();
+		// Latencies are measured on the wall clock, also when replaying
+		uint64_t read_time = DeviceTimestamp();
 
 		if (read == 0) continue;
+		MANUS_TRACE_SCOPE("Device::Report");
 
 		if (read == -1) {
 			dev->m_running = false;
 			break;
 		}
+
+		dev->m_capture.Record(CAPTURE_IN, report, read, timestamp);
 			
 
 		{
 
 			if (report[0] == DEVICE_MESSAGE) {
 				ESB_DATA_PACKET *recv_data = (ESB_DATA_PACKET *)(1 + report);
-				if (recv_data->device_type < DEVICE_TYPE_COUNT + DEVICE_TYPE_LOW) {
+				// Captures replay whatever they hold, only known devices index the state
+				if (recv_data->device_type >= DEVICE_TYPE_LOW && recv_data->device_type < DEVICE_TYPE_COUNT + DEVICE_TYPE_LOW) {
 					
 					uint8_t deviceNr = recv_data->device_type - DEVICE_TYPE_LOW;
+
+					// Every reply carries the device id, apply the profile of a newly seen glove
+					if (recv_data->device_id && recv_data->device_id != dev->m_device_id[deviceNr]) {
+						std::unique_lock<std::mutex> lk = dev->LockReport(deviceNr);
+						dev->m_device_id[deviceNr] = recv_data->device_id;
+						dev->m_finger_calibration[deviceNr].SetDeviceId(recv_data->device_id);
+					}
+
 					switch (recv_data->message_type) {
 					case MSG_FLAGS_GET: {
 						std::lock_guard<std::mutex> lk(dev->m_flags_mutex[deviceNr]);
@@ -294,6 +809,11 @@ void Device::DeviceThread(Device* dev) {
 						}
 					case MSG_STATS_GET: {
 						std::lock_guard<std::mutex> lk(dev->m_stats_mutex[deviceNr]);
+						// Only the device id of a reply nobody asked for is used, it
+						// answers the automatic request and would be a stale result
+						if (!dev->m_stats_wanted[deviceNr])
+							break;
+						dev->m_stats_wanted[deviceNr] = false;
 						dev->m_remote_stats[deviceNr].device_type = recv_data->device_type;
 						dev->m_remote_stats[deviceNr].stats = recv_data->stats;
 						dev->m_stats_cv[deviceNr].notify_all();
@@ -302,25 +822,72 @@ void Device::DeviceThread(Device* dev) {
 						}
 					}
 				}
-			} else if (report[0] < DEVICE_TYPE_COUNT + DEVICE_TYPE_LOW) {
+			} else if (report[0] >= DEVICE_TYPE_LOW && report[0] < DEVICE_TYPE_COUNT + DEVICE_TYPE_LOW) {
 				uint8_t deviceNr = report[0] - DEVICE_TYPE_LOW;
-				std::lock_guard<std::mutex> lk(dev->m_report_mutex[deviceNr]);
+				std::unique_lock<std::mutex> lk = dev->LockReport(deviceNr);
 				dev->m_local_stats[deviceNr].packet_count++;
-				dev->m_local_stats[deviceNr].last_seen = clock();
+				dev->m_local_stats[deviceNr].last_seen = read_time;
+				dev->m_timestamp[deviceNr] = timestamp;
 				memcpy(&dev->m_report[deviceNr], report, sizeof(GLOVE_REPORT));
 
+				GLOVE_RAW_REPORT& raw = dev->m_raw_history[deviceNr][dev->m_raw_count[deviceNr]++ & (RAW_HISTORY_SIZE - 1)];
+				raw.timestamp = timestamp;
+				raw.packet_number = dev->m_local_stats[deviceNr].packet_count;
+				memcpy(&raw.device_type, report, sizeof(GLOVE_REPORT));
+
+				LatencyHistogram* latency = dev->m_latency[deviceNr];
+				dev->UpdateArrival(deviceNr, read_time);
+				if (dev->m_read_time[deviceNr])
+					latency[GLOVE_LATENCY_REPORT_INTERVAL].Record(read_time - dev->m_read_time[deviceNr]);
+				dev->m_read_time[deviceNr] = read_time;
+
 				dev->UpdateState();
-				dev->m_report_cv[deviceNr].notify_all();
+				uint64_t decoded = DeviceTimestamp();
+				dev->m_sequence[deviceNr].fetch_add(1, std::memory_order_seq_cst);
+				dev->m_sample_events[deviceNr].NotifyAll();
+				if (deviceNr <= DEV_GLOVE_RIGHT - DEVICE_TYPE_LOW) {
+					NotifySample((GLOVE_HAND)deviceNr);
+					if (SharedServer::IsRunning())
+						SharedServer::Publish((GLOVE_HAND)deviceNr, dev->m_data[deviceNr], raw, read_time);
+					dev->m_stream.Publish((GLOVE_HAND)deviceNr, dev->m_data[deviceNr], raw, read_time);
+				}
+				uint64_t published = DeviceTimestamp();
+
+				latency[GLOVE_LATENCY_DECODE].Record(decoded - read_time);
+				latency[GLOVE_LATENCY_PUBLISH].Record(published - read_time);
+				if (LatencyTrace::IsEnabled()) {
+					dev->m_trace.Record(GLOVE_LATENCY_DECODE, deviceNr, read_time, decoded, read_time);
+					dev->m_trace.Record(GLOVE_LATENCY_PUBLISH, deviceNr, decoded, published, read_time);
+				}
+
+				// Ask an unknown glove for its stats to learn its device id
+				if (!dev->m_device_id[deviceNr] && read_time - dev->m_device_id_requested[deviceNr] > DEVICE_ID_RETRY_NS) {
+					ESB_DATA_PACKET request = MakePacket((device_type_t)report[0], MSG_STATS_GET);
+					if (dev->QueueMessage(request))
+						dev->m_device_id_requested[deviceNr] = read_time;
+				}
+
+				// Outside the report lock, the skeletal model can take a while
+				if (deviceNr <= DEV_GLOVE_RIGHT - DEVICE_TYPE_LOW && OutputBuffer::IsBound((GLOVE_HAND)deviceNr)) {
+					GLOVE_DATA data = dev->m_data[deviceNr];
+					lk.unlock();
+					OutputBuffer::Publish((GLOVE_HAND)deviceNr, data, read_time);
+				}
 			}
 		}
 	}
 
-	hid_close(dev->m_device);
-	dev->m_device = NULL;
+	dev->m_backend->Close();
+
+	// Readers waiting for a sample see the device stopped
+	for (int i = 0; i < DEVICE_TYPE_COUNT; i++)
+		dev->m_sample_events[i].NotifyAll();
 }
 
 
 void Device::UpdateState() {
+	MANUS_TRACE_SCOPE("Device::UpdateState");
+	uint32_t fields = s_decode_fields;
 
 	for (int devNr = 0; devNr < DEVICE_TYPE_COUNT; devNr++) {
 
@@ -329,27 +896,84 @@ void Device::UpdateState() {
 
 			m_data[devNr].PacketNumber = m_local_stats[devNr].packet_count;
 
-			m_data[devNr].Acceleration.x = m_report[devNr].accel[0] / ACCEL_DIVISOR;
-			m_data[devNr].Acceleration.y = m_report[devNr].accel[1] / ACCEL_DIVISOR;
-			m_data[devNr].Acceleration.z = m_report[devNr].accel[2] / ACCEL_DIVISOR;
-
-			// normalize quaternion data
-			m_data[devNr].Quaternion.w = m_report[devNr].quat[0] / QUAT_DIVISOR;
-			m_data[devNr].Quaternion.x = m_report[devNr].quat[1] / QUAT_DIVISOR;
-			m_data[devNr].Quaternion.y = m_report[devNr].quat[2] / QUAT_DIVISOR;
-			m_data[devNr].Quaternion.z = m_report[devNr].quat[3] / QUAT_DIVISOR;
-
-			// normalize finger data
-			for (int j = 0; j < GLOVE_FINGERS; j++) {
-				// account for finger order
-				if (devNr == DEV_GLOVE_RIGHT - DEVICE_TYPE_LOW)
-					m_data[devNr].Fingers[j] = m_report[devNr].fingers[j] / FINGER_DIVISOR;
-				else
-					m_data[devNr].Fingers[j] = m_report[devNr].fingers[GLOVE_FINGERS - (j + 1)] / FINGER_DIVISOR;
+			if (fields & GLOVE_DECODE_ACCELERATION) {
+				m_data[devNr].Acceleration.x = m_report[devNr].accel[0] / ACCEL_DIVISOR;
+				m_data[devNr].Acceleration.y = m_report[devNr].accel[1] / ACCEL_DIVISOR;
+				m_data[devNr].Acceleration.z = m_report[devNr].accel[2] / ACCEL_DIVISOR;
 			}
 
+			// normalize quaternion data, the euler angles are derived from it
+			if (fields & (GLOVE_DECODE_QUATERNION | GLOVE_DECODE_EULER)) {
+				m_data[devNr].Quaternion.w = m_report[devNr].quat[0] / QUAT_DIVISOR;
+				m_data[devNr].Quaternion.x = m_report[devNr].quat[1] / QUAT_DIVISOR;
+				m_data[devNr].Quaternion.y = m_report[devNr].quat[2] / QUAT_DIVISOR;
+				m_data[devNr].Quaternion.z = m_report[devNr].quat[3] / QUAT_DIVISOR;
+			}
+
+			if (fields & GLOVE_DECODE_FINGERS) {
+				// normalize finger data using the calibrated range
+				float fingers[GLOVE_FINGERS];
+				m_finger_calibration[devNr].Apply(m_report[devNr].fingers, fingers);
+				for (int j = 0; j < GLOVE_FINGERS; j++) {
+					// account for finger order
+					if (devNr == DEV_GLOVE_RIGHT - DEVICE_TYPE_LOW)
+						m_data[devNr].Fingers[j] = fingers[j];
+					else
+						m_data[devNr].Fingers[j] = fingers[GLOVE_FINGERS - (j + 1)];
+				}
+			}
+
+			// The processing stages need a complete sample
+			bool complete = (fields & (GLOVE_DECODE_QUATERNION | GLOVE_DECODE_FINGERS)) == (GLOVE_DECODE_QUATERNION | GLOVE_DECODE_FINGERS);
+			if (complete)
+				ApplyFilters(devNr);
+
 			// calculate the euler angles
-			ManusMath::GetEuler(&m_data[devNr].Euler, &m_data[devNr].Quaternion);
+			if (fields & GLOVE_DECODE_EULER)
+				ManusMath::GetEuler(&m_data[devNr].Euler, &m_data[devNr].Quaternion);
+
+			if (!complete)
+				continue;
+
+			// update the velocity estimates at sensor rate
+			m_predictor[devNr].Update(m_data[devNr], m_timestamp[devNr]);
+
+			// classify the hand pose
+			if (devNr <= DEV_GLOVE_RIGHT - DEVICE_TYPE_LOW)
+				m_gestures.Update((GLOVE_HAND)devNr, m_data[devNr], m_timestamp[devNr]);
 		}
 	}
 }
+
+void Device::ApplyFilters(int devNr) {
+	// Only the gloves are filtered
+	if (devNr > DEV_GLOVE_RIGHT - DEVICE_TYPE_LOW)
+		return;
+
+	// Pick up changed settings without taking the lock on every sample
+	uint32_t version = s_filter_version;
+	if (version != m_filter_version) {
+		std::lock_guard<std::mutex> lk(s_filter_mutex);
+		memcpy(m_filter_params, s_filter_params, sizeof(m_filter_params));
+		memcpy(m_filter_enabled, s_filter_enabled, sizeof(m_filter_enabled));
+		m_filter_version = version;
+	}
+
+	float dt = m_filter_timestamp[devNr] ? (m_timestamp[devNr] - m_filter_timestamp[devNr]) / 1e9f : 0.0f;
+	m_filter_timestamp[devNr] = m_timestamp[devNr];
+
+	const GLOVE_FILTER_PARAMS* params = m_filter_params[devNr];
+	const bool* enabled = m_filter_enabled[devNr];
+
+	for (int j = 0; j < GLOVE_FINGERS; j++) {
+		if (enabled[j])
+			m_data[devNr].Fingers[j] = m_finger_filter[devNr][j].Filter(m_data[devNr].Fingers[j], dt, params[j]);
+		else
+			m_finger_filter[devNr][j].Reset();
+	}
+
+	if (enabled[GLOVE_FILTER_ORIENTATION])
+		m_data[devNr].Quaternion = m_orientation_filter[devNr].Filter(m_data[devNr].Quaternion, dt, params[GLOVE_FILTER_ORIENTATION]);
+	else
+		m_orientation_filter[devNr].Reset();
+}
@@ -17,17 +17,37 @@
 #pragma once
 
 #include "Manus.h"
-
-#include <hidapi.h>
+#include "MotionPredictor.h"
+#include "OneEuroFilter.h"
+#include "MagCalibration.h"
+#include "GestureRecognizer.h"
+#include "FingerCalibration.h"
+#include "Recorder.h"
+#include "Stream.h"
+#include "DeviceBackend.h"
+#include "LatencyHistogram.h"
+#include "LatencyTrace.h"
+#include "EventCount.h"
+
+#include <chrono>
 #include <thread>
 #include <condition_variable>
 #include <mutex>
+#include <atomic>
 #include <vector>
 #include <inttypes.h>
 
 //
 #define HID_READ_TIMEOUT_MS 50
 #define HID_WRITE_TIMEOUT_MS 50
+// A device that sent nothing for this long is disconnected
+#define DEVICE_TIMEOUT_NS 1000000000ull
+// Interval between requests for the device id of an unknown glove
+#define DEVICE_ID_RETRY_NS 1000000000ull
+// Messages that can wait for the device thread, must be a power of two
+#define OUT_QUEUE_SIZE 16
+// Writes that may go out back to back under a write budget
+#define WRITE_BURST 4
 
 
 // flag for handedness (0 = left, 1 = right)
@@ -55,6 +75,9 @@
 #define GLOVE_REPORT_ID     1
 #define COMPASS_REPORT_ID   2
 
+// Number of raw reports kept per device, must be a power of two
+#define RAW_HISTORY_SIZE 64
+
 #define DEVICE_TYPE_LOW   2
 #define DEVICE_TYPE_COUNT 4
 enum device_type_t : uint8_t {
@@ -123,31 +146,95 @@ typedef struct {
 	stats_t stats;
 } GLOVE_STATS;
 
+// Read without the report lock to check if a device is connected
 typedef struct {
-	uint32_t packet_count = 0;
-	clock_t last_seen = 0;
+	std::atomic<uint32_t> packet_count{ 0 };
+	std::atomic<uint64_t> last_seen{ 0 };
 } LOCAL_STATS;
 
+// Arrival statistics of a glove, written by the device thread and
+// read without the report lock for the metrics
+typedef struct {
+	uint64_t last_interval;
+	uint64_t window_start;
+	uint32_t window_count;
+	std::atomic<float> packets_per_second{ 0.0f };
+	std::atomic<uint64_t> jitter_ns{ 0 };
+} ARRIVAL_STATS;
+
+// Monotonic time in nanoseconds, the clock all sample timestamps are taken from
+inline uint64_t DeviceTimestamp() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
 class Device
 {
 private:
-	bool m_running;
+	std::atomic<bool> m_running;
 
 	GLOVE_DATA		m_data[DEVICE_TYPE_COUNT];
 	GLOVE_REPORT	m_report[DEVICE_TYPE_COUNT];
+	uint64_t		m_timestamp[DEVICE_TYPE_COUNT];
+	MotionPredictor	m_predictor[DEVICE_TYPE_COUNT];
+
+	OneEuroFilter		m_finger_filter[DEVICE_TYPE_COUNT][GLOVE_FINGERS];
+	OrientationFilter	m_orientation_filter[DEVICE_TYPE_COUNT];
+	uint64_t			m_filter_timestamp[DEVICE_TYPE_COUNT];
+
+	MagCalibration		m_mag_calibration[DEVICE_TYPE_COUNT];
+	float				m_compass[DEVICE_TYPE_COUNT][GLOVE_AXES];
+	bool				m_compass_valid[DEVICE_TYPE_COUNT];
+
+	// Latencies from the moment the report was read, see GLOVE_LATENCY_STAGE
+	LatencyHistogram	m_latency[DEVICE_TYPE_COUNT][GLOVE_LATENCY_STAGES];
+	LatencyTrace		m_trace;
+	uint64_t			m_read_time[DEVICE_TYPE_COUNT];
+
+	// Reports as received, written by the device thread under the report mutex
+	GLOVE_RAW_REPORT	m_raw_history[DEVICE_TYPE_COUNT][RAW_HISTORY_SIZE];
+	uint32_t			m_raw_count[DEVICE_TYPE_COUNT];
+
+	GestureRecognizer	m_gestures;
+
+	// ESB device id of each glove, used to look up its finger profile
+	uint32_t			m_device_id[DEVICE_TYPE_COUNT];
+	uint64_t			m_device_id_requested[DEVICE_TYPE_COUNT];
+	FingerCalibration	m_finger_calibration[DEVICE_TYPE_COUNT];
+
+	// Local copy of the filter settings, refreshed when the version changes
+	GLOVE_FILTER_PARAMS	m_filter_params[2][GLOVE_FILTER_CHANNELS];
+	bool				m_filter_enabled[2][GLOVE_FILTER_CHANNELS];
+	uint32_t			m_filter_version;
+
+	// Filter settings are shared by all devices so they survive reconnects
+	static std::mutex				s_filter_mutex;
+	static GLOVE_FILTER_PARAMS		s_filter_params[2][GLOVE_FILTER_CHANNELS];
+	static bool						s_filter_enabled[2][GLOVE_FILTER_CHANNELS];
+	static std::atomic<uint32_t>	s_filter_version;
+
+	static std::atomic<uint32_t>	s_decode_fields;
 
 	GLOVE_STATS		m_remote_stats[DEVICE_TYPE_COUNT];
+	// A caller asked for the stats, under the stats mutex
+	bool			m_stats_wanted[DEVICE_TYPE_COUNT];
 	GLOVE_FLAGS		m_flags[DEVICE_TYPE_COUNT];
 	LOCAL_STATS		m_local_stats[DEVICE_TYPE_COUNT];
+	ARRIVAL_STATS	m_arrival[DEVICE_TYPE_COUNT];
+	// Times the device thread opened the device
+	std::atomic<uint32_t> m_opens;
 	
 
 	char* m_device_path;
-	hid_device* m_device;
+	DeviceBackend* m_backend;
 
 	std::thread m_thread;
 
 	std::mutex m_report_mutex[DEVICE_TYPE_COUNT];
-	std::condition_variable m_report_cv[DEVICE_TYPE_COUNT];
+	// Samples decoded per device, raised under the report mutex. Readers
+	// sleep on the event count until it moves, without taking the mutex.
+	std::atomic<uint64_t> m_sequence[DEVICE_TYPE_COUNT];
+	EventCount m_sample_events[DEVICE_TYPE_COUNT];
 
 
 	std::mutex		m_flags_mutex[DEVICE_TYPE_COUNT];
@@ -156,31 +243,104 @@ private:
 	std::condition_variable m_stats_cv[DEVICE_TYPE_COUNT];
 
 
-	ESB_DATA_PACKET m_data_out = { 0 };
+	// Messages for the device thread to send, any thread can queue them.
+	// Rumble messages go first and only the latest one per device is kept,
+	// the other messages are sent in order. Identical messages are dropped,
+	// as is a rumble power the glove already got.
+	std::mutex		m_data_out_mutex;
+	ESB_DATA_PACKET m_rumble_out[DEVICE_TYPE_COUNT];
+	ESB_DATA_PACKET m_rumble_sent[DEVICE_TYPE_COUNT];
+	ESB_DATA_PACKET m_data_out[OUT_QUEUE_SIZE];
+	uint32_t		m_data_out_head;
+	uint32_t		m_data_out_tail;
+	GLOVE_WRITE_STATS m_write_stats;
+	// The next message was held back by the write budget and is counted as throttled
+	bool			m_write_held;
+
+	// Most writes per second to a dongle, 0 is unlimited
+	static std::atomic<uint32_t> s_write_budget;
+
+	// Samples published per hand by any source, for WaitAny
+	static std::atomic<uint32_t> s_sequence[2];
+	static EventCount s_arrivals;
+	// Cleared when the SDK shuts down, ends the waits of WaitAny
+	static std::atomic<bool> s_waits_enabled;
+
+	// Stages the HID traffic for the capture file
+	Recorder::Channel m_capture;
+	StreamSender::Channel m_stream;
 
 
 
 public:
-	Device(const char* device_path);
+	// Takes ownership of the backend, by default the device is opened through HIDAPI
+	Device(const char* device_path, DeviceBackend* backend = NULL);
 	~Device();
 
 	void Connect();
 	void Disconnect();
 	bool IsRunning() const { return m_running; }
 	const char* GetDevicePath() const { return m_device_path; }
-	bool GetData(GLOVE_DATA* data, device_type_t device, unsigned int timeout);
+	bool GetData(GLOVE_DATA* data, device_type_t device, unsigned int timeout, uint64_t* read_time = NULL);
+	int GetDataAfter(GLOVE_DATA* data, device_type_t device, uint64_t after_seq, uint64_t* seq, unsigned int timeout);
+	bool GetPredictedData(GLOVE_DATA* data, device_type_t device, uint64_t target_time);
+	bool GetRawReport(GLOVE_RAW_REPORT* report, device_type_t device);
+	bool GetRawHistory(GLOVE_RAW_REPORT* reports, unsigned int count, unsigned int &copied, device_type_t device);
 	bool GetFlags(uint8_t &flags, device_type_t device, unsigned int timeout);
 	bool GetRssi(int32_t &rssi, device_type_t device, unsigned int timeout);
 	bool GetBatteryVoltage(uint16_t &voltage, device_type_t device, unsigned int timeout);
 	bool GetBatteryPercentage(uint8_t &percentage, device_type_t device, unsigned int timeout);
 
+	bool GetHeading(float &heading, device_type_t device);
+	bool GetGesture(int &gesture, device_type_t device);
+	bool PollGesture(GLOVE_GESTURE_EVENT &event) { return m_gestures.PollEvent(event); }
+
 	bool IsConnected(device_type_t device);
+
+	void RecordLatency(GLOVE_LATENCY_STAGE stage, device_type_t device, uint64_t read_time, uint64_t begin);
+	void AddLatency(GLOVE_LATENCY_STAGE stage, device_type_t device, LATENCY_SNAPSHOT& snapshot) const;
+	void ResetLatency();
+	void CollectTrace(std::vector<TRACE_EVENT>& events) const { m_trace.Collect(events); }
 	
 	bool SetVibration(float power, device_type_t dev, unsigned int timeout);
+	bool SetTimedVibration(float power, unsigned int duration_ms, device_type_t device);
 	bool SetFlags(uint8_t flags, device_type_t device);
 	bool PowerOff(device_type_t device);
+	bool StartFingerCalibration(device_type_t device);
+	bool StopFingerCalibration(device_type_t device, bool save);
+	bool SetFingerResponse(const float gamma[GLOVE_FINGERS], device_type_t device);
+	bool AddCompassSample(const int16_t compass[GLOVE_AXES], device_type_t device);
+
+	static void SetFilter(GLOVE_HAND hand, GLOVE_FILTER_CHANNEL channel, const GLOVE_FILTER_PARAMS* params);
+	static void SetDecodeFields(uint32_t fields) { s_decode_fields = fields; }
+	static void SetWriteBudget(uint32_t writes_per_second) { s_write_budget = writes_per_second; }
+	void AddWriteStats(GLOVE_WRITE_STATS& stats);
+	void GetMetrics(GLOVE_DONGLE_METRICS& metrics);
+
+	/*! \brief Announce a new sample of a hand to WaitAny. */
+	static void NotifySample(GLOVE_HAND hand) {
+		s_sequence[hand].fetch_add(1, std::memory_order_seq_cst);
+		s_arrivals.NotifyAll();
+	}
+	/*! \brief Allow WaitAny, or wake up all waits and let them return MANUS_DISCONNECTED. */
+	static void EnableWaits(bool enabled) {
+		s_waits_enabled.store(enabled, std::memory_order_seq_cst);
+		if (!enabled)
+			s_arrivals.NotifyAll();
+	}
+	/*! \brief Wait until a hand in the mask has a sample after its sequence in last_seen. */
+	static int WaitAny(uint32_t hand_mask, uint32_t last_seen[2], unsigned int timeout, GLOVE_HAND& which);
 
 private:
 	static void DeviceThread(Device* dev);
+	std::unique_lock<std::mutex> LockReport(uint8_t deviceNr);
+	bool WaitSample(uint8_t deviceNr, uint64_t after_seq, unsigned int timeout);
+	bool QueueMessage(const ESB_DATA_PACKET& packet);
+	void RequestStats(device_type_t device);
+	bool NextMessage(ESB_DATA_PACKET& packet);
+	void ThrottleMessages();
+	void ClearMessages();
+	void UpdateArrival(uint8_t deviceNr, uint64_t read_time);
 	void UpdateState();
+	void ApplyFilters(int devNr);
 };
@@ -0,0 +1,65 @@
+/*
+   Copyright 2015 Manus VR
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include "stdafx.h"
+#include "DeviceBackend.h"
+#include "Device.h"
+
+#include <string.h>
+
+#ifndef MANUS_HIDRAW
+HidBackend::HidBackend(const char* path)
+	: m_device(NULL)
+{
+	size_t len = strlen(path) + 1;
+	m_path = new char[len];
+	memcpy(m_path, path, len * sizeof(char));
+}
+
+HidBackend::~HidBackend()
+{
+	Close();
+	delete[] m_path;
+}
+
+bool HidBackend::Open()
+{
+	m_device = hid_open_path(m_path);
+	return m_device != NULL;
+}
+
+void HidBackend::Close()
+{
+	if (m_device)
+		hid_close(m_device);
+	m_device = NULL;
+}
+
+int HidBackend::Read(uint8_t* data, size_t length, int timeout_ms)
+{
+	return hid_read_timeout(m_device, data, length, timeout_ms);
+}
+
+int HidBackend::Write(const uint8_t* data, size_t length)
+{
+	return hid_write(m_device, data, length);
+}
+
+uint64_t HidBackend::Timestamp()
+{
+	return DeviceTimestamp();
+}
+#endif
@@ -0,0 +1,61 @@
+/*
+   Copyright 2015 Manus VR
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#ifndef MANUS_HIDRAW
+#include <hidapi.h>
+#endif
+#include <stddef.h>
+#include <stdint.h>
+
+// Source of the packets of a Device, the device thread reads and writes
+// through this interface so the same decode pipeline serves every source.
+class DeviceBackend
+{
+public:
+	virtual ~DeviceBackend() {}
+
+	virtual bool Open() = 0;
+	virtual void Close() = 0;
+
+	/*! \brief Read a packet, returns its length, 0 on timeout or -1 when the device is gone. */
+	virtual int Read(uint8_t* data, size_t length, int timeout_ms) = 0;
+	virtual int Write(const uint8_t* data, size_t length) = 0;
+
+	/*! \brief Time the last packet was received, in the clock of DeviceTimestamp(). */
+	virtual uint64_t Timestamp() = 0;
+};
+
+#ifndef MANUS_HIDRAW
+// Talks to a dongle through HIDAPI
+class HidBackend : public DeviceBackend
+{
+private:
+	char* m_path;
+	hid_device* m_device;
+
+public:
+	HidBackend(const char* path);
+	~HidBackend();
+
+	bool Open();
+	void Close();
+	int Read(uint8_t* data, size_t length, int timeout_ms);
+	int Write(const uint8_t* data, size_t length);
+	uint64_t Timestamp();
+};
+#endif
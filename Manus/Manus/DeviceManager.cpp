@@ -17,61 +17,116 @@ limitations under the License.
 #include "stdafx.h" // pre compiled headers
 #include "Device.h"
 #include "DeviceManager.h"
+#include "SimBackend.h"
+#include "Metrics.h"
+#include "Trace.h"
+#ifdef MANUS_HIDRAW
+#include "HidrawBackend.h"
+#endif
 
 #include <thread>
 #include <mutex>
 #include <string.h>
+#include <stdio.h>
+#include <string>
 
 //extern std::vector<Glove*> g_gloves;
-extern std::vector<Device*> g_devices;
+extern DeviceList g_devices;
 extern std::mutex g_gloves_mutex;
 MANUS_ID MANUS_IDS[] = { { MANUS_BT_VENDOR_ID, MANUS_BT_PRODUCT_ID } , {NORDIC_USB_VENDOR_ID, NORDIC_USB_PRODUCT_ID}  };
 
 DeviceManager::DeviceManager() {
 	this->Running = true;
+	this->RescanRequested = false;
 	this->DeviceThread = std::thread(&DeviceManager::EnumerateDevicesThread, this);
 }
 
 DeviceManager::~DeviceManager() {
-	this->Running = false;
+	{
+		std::lock_guard<std::mutex> lock(cv_m);
+		this->Running = false;
+	}
 	cv.notify_all();
 	DeviceThread.join();
 }
 
+void DeviceManager::Rescan() {
+	{
+		std::lock_guard<std::mutex> lock(cv_m);
+		this->RescanRequested = true;
+	}
+	cv.notify_all();
+}
+
+/*
+Add a device for the path, or reconnect it when it was seen before
+*/
+void DeviceManager::AddDevice(const char* path, DeviceBackend* backend) {
+	// Enumeration will return gloves we're already connected to.
+	// Therefore we will compare the device path for the found device
+	// with the device paths known. 
+	// Walk through the previously detected gloves and compare 
+	// their device paths to the currently found glove.
+	for (Device* device : g_devices) {
+		if (!(strcasecmp(device->GetDevicePath(), path))) {
+			//Reconnect if previously disconnected
+			if (!device->IsRunning()) device->Connect();
+			delete backend;
+			return;
+		}
+	}
+
+	// If the device isn't previously seen, add it.
+	Device* device = new Device(path, backend);
+	if (!g_devices.push_back(device))
+		delete device;
+}
+
 /*
 Just copying the Manus Emurate code out...
 */
 void DeviceManager::EnumerateDevices() {
+	MANUS_TRACE_SCOPE("DeviceManager::EnumerateDevices");
 	std::lock_guard<std::mutex> lock(g_gloves_mutex);
+	uint64_t begin = DeviceTimestamp();
+	EnumerateLocked();
+	Metrics::Add(Metrics::s_enumerations);
+	Metrics::s_enumeration_ns.store(DeviceTimestamp() - begin, std::memory_order_relaxed);
+}
+
+void DeviceManager::EnumerateLocked() {
+
+	// The simulated dongles replace the real ones
+	GLOVE_SIM_CONFIG sim;
+	if (SimBackend::GetConfig(sim)) {
+		for (unsigned int i = 0; i < sim.dongles; i++) {
+			char path[32];
+			snprintf(path, sizeof(path), "sim:%u", i);
+
+			AddDevice(path, new SimBackend(i));
+		}
+		return;
+	}
 
 	// Enumerate the Manus devices on the system
-	struct hid_device_info *hid_devices, *current_device;
 	for (int i = 0; i < sizeof(MANUS_IDS) / sizeof(MANUS_IDS)[0]; i++) {
+#ifdef MANUS_HIDRAW
+		std::vector<std::string> paths;
+		HidrawBackend::Enumerate(MANUS_IDS[i].VID, MANUS_IDS[i].PID, paths);
+		for (const std::string& path : paths)
+			AddDevice(path.c_str());
+#else
+		struct hid_device_info *hid_devices, *current_device;
 		hid_devices = hid_enumerate(MANUS_IDS[i].VID, MANUS_IDS[i].PID);
 		current_device = hid_devices;
 		while (current_device != nullptr) {
-			bool found = false;
-			// The HIDAPI will return gloves we're already connected to.
-			// Therefore we will compare the device path for the found device
-			// with the device paths known. 
-			// Walk through the previously detected gloves and compare 
-			// their device paths to the currently found glove.
-			for (Device* device : g_devices) {
-				if (!(strcasecmp(device->GetDevicePath(), current_device->path))) {
-					found = true;
-					//Reconnect if previously disconnected
-					if (!device->IsRunning()) device->Connect();
-					break;
-				}
-			}
-
-			// If the device isn't previously seen, add it.
-			if (!found) g_devices.push_back(new Device(current_device->path));
+			AddDevice(current_device->path);
 
 			// Examine the next HID device
 			current_device = current_device->next;
 		}
 		hid_free_enumeration(hid_devices);
+#endif
 	}
 }
 
@@ -84,10 +139,14 @@ void DeviceManager::EnumerateDevicesThread()
 	std::unique_lock<std::mutex> lock(cv_m);
 	while (this->Running)
 	{
+		this->RescanRequested = false;
+		lock.unlock();
 		this->EnumerateDevices();
+		lock.lock();
 		if (!this->Running) return;
 		//std::this_thread::sleep_for(std::chrono::seconds(MANUS_DEVICE_SCAN_INTERVAL));
-		cv.wait_for(lock,std::chrono::seconds(MANUS_DEVICE_SCAN_INTERVAL));
+		cv.wait_for(lock, std::chrono::seconds(MANUS_DEVICE_SCAN_INTERVAL),
+			[this] { return !this->Running || this->RescanRequested; });
 		if (!this->Running) return;
 	}
 }
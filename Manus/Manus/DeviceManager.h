@@ -2,6 +2,12 @@
 #include <thread>
 #include <mutex>
 #include <vector>
+#include <condition_variable>
+
+#include <atomic>
+
+class Device;
+class DeviceBackend;
 
 // Time in seconds between device scans
 #define MANUS_DEVICE_SCAN_INTERVAL 10
@@ -23,17 +29,50 @@ typedef struct {
 // Cross platform clearing the differences between WIN32 and POSIX APIs
 #ifdef _WIN32
 #define strcasecmp _strcmpi
+#else
+#include <strings.h>
 #endif
 
+// Maximum number of dongles over the lifetime of a session
+#define MANUS_MAX_DEVICES 64
+
+// List of the devices that is read without locking.
+// Devices are only added, under g_gloves_mutex, until the SDK shuts down,
+// so a reader sees a consistent prefix of the list at any time.
+class DeviceList {
+public:
+	DeviceList() : m_count(0) {}
+	Device* const* begin() const { return m_devices; }
+	Device* const* end() const { return m_devices + m_count.load(std::memory_order_acquire); }
+	size_t size() const { return m_count.load(std::memory_order_acquire); }
+	bool push_back(Device* device) {
+		size_t count = m_count.load(std::memory_order_relaxed);
+		if (count >= MANUS_MAX_DEVICES)
+			return false;
+		m_devices[count] = device;
+		m_count.store(count + 1, std::memory_order_release);
+		return true;
+	}
+	void clear() { m_count = 0; }
+private:
+	Device* m_devices[MANUS_MAX_DEVICES];
+	std::atomic<size_t> m_count;
+};
+
 class DeviceManager {
 public:
 	DeviceManager();
 	~DeviceManager();
+	/*! \brief Scan for devices now instead of at the next interval. */
+	void Rescan();
 private:
 	std::thread DeviceThread;
 	std::condition_variable cv;
 	std::mutex cv_m;
 	bool Running;
+	bool RescanRequested;
+	void AddDevice(const char* path, DeviceBackend* backend = NULL);
 	void EnumerateDevices();
+	void EnumerateLocked();
 	void EnumerateDevicesThread();
 };
@@ -0,0 +1,100 @@
+/*
+   Copyright 2015 Manus VR
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include <limits.h>
+#else
+#include <condition_variable>
+#include <mutex>
+#endif
+
+// Lets threads sleep until a condition that is published elsewhere may
+// have changed, without a mutex on the publishing side.
+// A waiter calls PrepareWait, checks its condition and then calls Wait
+// with the returned epoch, or CancelWait when the condition holds. A
+// publisher updates the state the condition reads and calls NotifyAll.
+// Wait returns at once when a notification came in after PrepareWait.
+// The sleep is a single futex (WaitOnAddress on Windows) on the epoch,
+// and a publisher only enters the kernel when somebody is waiting.
+class EventCount
+{
+private:
+	std::atomic<uint32_t> m_epoch;
+	std::atomic<uint32_t> m_waiters;
+#if !defined(_WIN32) && !defined(__linux__)
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+#endif
+
+public:
+	EventCount() : m_epoch(0), m_waiters(0) {}
+
+	uint32_t PrepareWait() {
+		m_waiters.fetch_add(1, std::memory_order_seq_cst);
+		return m_epoch.load(std::memory_order_seq_cst);
+	}
+
+	void CancelWait() {
+		m_waiters.fetch_sub(1, std::memory_order_relaxed);
+	}
+
+	/*! \brief Sleep until a notification after PrepareWait or the timeout, may wake up spuriously. */
+	void Wait(uint32_t epoch, uint64_t timeout_ns) {
+		if (m_epoch.load(std::memory_order_seq_cst) == epoch) {
+#if defined(_WIN32)
+			DWORD ms = (DWORD)((timeout_ns + 999999) / 1000000);
+			WaitOnAddress(&m_epoch, &epoch, sizeof(epoch), ms);
+#elif defined(__linux__)
+			struct timespec timeout;
+			timeout.tv_sec = (time_t)(timeout_ns / 1000000000ull);
+			timeout.tv_nsec = (long)(timeout_ns % 1000000000ull);
+			syscall(SYS_futex, (uint32_t*)&m_epoch, FUTEX_WAIT_PRIVATE, epoch, &timeout, NULL, 0);
+#else
+			std::unique_lock<std::mutex> lk(m_mutex);
+			m_cv.wait_for(lk, std::chrono::nanoseconds(timeout_ns),
+				[&] { return m_epoch.load(std::memory_order_seq_cst) != epoch; });
+#endif
+		}
+		m_waiters.fetch_sub(1, std::memory_order_relaxed);
+	}
+
+	void NotifyAll() {
+		m_epoch.fetch_add(1, std::memory_order_seq_cst);
+		if (!m_waiters.load(std::memory_order_seq_cst))
+			return;
+#if defined(_WIN32)
+		WakeByAddressAll(&m_epoch);
+#elif defined(__linux__)
+		syscall(SYS_futex, (uint32_t*)&m_epoch, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+#else
+		std::lock_guard<std::mutex> lk(m_mutex);
+		m_cv.notify_all();
+#endif
+	}
+};
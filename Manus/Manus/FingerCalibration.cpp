@@ -0,0 +1,236 @@
+/*
+   Copyright 2015 Manus VR
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include "stdafx.h"
+#include "FingerCalibration.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+
+// Smallest range accepted from a recording, narrower ranges are sensor noise
+#define FINGER_MIN_RANGE 16
+
+typedef struct {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t count;
+} FINGER_PROFILE_HEADER;
+
+std::mutex FingerCalibration::s_profiles_mutex;
+std::vector<FINGER_PROFILE> FingerCalibration::s_profiles;
+
+FingerCalibration::FingerCalibration()
+	: m_valid(false), m_recording(false)
+{
+	memset(&m_profile, 0, sizeof(m_profile));
+	BuildLut();
+}
+
+void FingerCalibration::BuildLut()
+{
+	for (int i = 0; i < FINGER_PROFILE_FINGERS; i++) {
+		float min = m_valid ? m_profile.min[i] : 0.0f;
+		float max = m_valid ? m_profile.max[i] : 255.0f;
+		float gamma = (m_valid && m_profile.gamma[i] > 0.0f) ? m_profile.gamma[i] : 1.0f;
+
+		for (int raw = 0; raw < 256; raw++) {
+			float value = (raw - min) / (max - min);
+			if (value < 0.0f) value = 0.0f;
+			if (value > 1.0f) value = 1.0f;
+			m_lut[i][raw] = (gamma == 1.0f) ? value : powf(value, gamma);
+		}
+	}
+}
+
+void FingerCalibration::SetDeviceId(uint32_t device_id)
+{
+	FINGER_PROFILE profile;
+	if (FindProfile(device_id, profile)) {
+		m_profile = profile;
+		m_valid = true;
+	} else {
+		memset(&m_profile, 0, sizeof(m_profile));
+		m_profile.device_id = device_id;
+		m_valid = false;
+	}
+	BuildLut();
+}
+
+void FingerCalibration::StartRecording()
+{
+	memset(m_recorded_min, 0xFF, sizeof(m_recorded_min));
+	memset(m_recorded_max, 0, sizeof(m_recorded_max));
+	m_recording = true;
+}
+
+bool FingerCalibration::StopRecording()
+{
+	if (!m_recording)
+		return false;
+	m_recording = false;
+
+	for (int i = 0; i < FINGER_PROFILE_FINGERS; i++)
+		if (m_recorded_max[i] < m_recorded_min[i] + FINGER_MIN_RANGE)
+			return false;
+
+	memcpy(m_profile.min, m_recorded_min, sizeof(m_profile.min));
+	memcpy(m_profile.max, m_recorded_max, sizeof(m_profile.max));
+	for (int i = 0; i < FINGER_PROFILE_FINGERS; i++)
+		if (!m_valid || m_profile.gamma[i] <= 0.0f)
+			m_profile.gamma[i] = 1.0f;
+	m_valid = true;
+	BuildLut();
+	return true;
+}
+
+void FingerCalibration::SetResponse(const float gamma[FINGER_PROFILE_FINGERS])
+{
+	if (!m_valid) {
+		memset(m_profile.min, 0, sizeof(m_profile.min));
+		memset(m_profile.max, 0xFF, sizeof(m_profile.max));
+		m_valid = true;
+	}
+	memcpy(m_profile.gamma, gamma, sizeof(m_profile.gamma));
+	BuildLut();
+}
+
+void FingerCalibration::Apply(const uint8_t raw[FINGER_PROFILE_FINGERS], float fingers[FINGER_PROFILE_FINGERS])
+{
+	if (m_recording) {
+		for (int i = 0; i < FINGER_PROFILE_FINGERS; i++) {
+			if (raw[i] < m_recorded_min[i]) m_recorded_min[i] = raw[i];
+			if (raw[i] > m_recorded_max[i]) m_recorded_max[i] = raw[i];
+		}
+	}
+
+	for (int i = 0; i < FINGER_PROFILE_FINGERS; i++)
+		fingers[i] = m_lut[i][raw[i]];
+}
+
+const char* FingerCalibration::ProfilePath()
+{
+	const char* path = getenv("MANUS_PROFILES");
+	return path ? path : FINGER_PROFILE_FILE;
+}
+
+bool FingerCalibration::LoadProfiles()
+{
+	std::lock_guard<std::mutex> lk(s_profiles_mutex);
+	s_profiles.clear();
+
+	FILE* file = fopen(ProfilePath(), "rb");
+	if (!file)
+		return false;
+
+	FINGER_PROFILE_HEADER header;
+	bool ok = fread(&header, sizeof(header), 1, file) == 1 &&
+		header.magic == FINGER_PROFILE_MAGIC && header.version == FINGER_PROFILE_VERSION;
+	if (ok) {
+		s_profiles.resize(header.count);
+		ok = fread(s_profiles.data(), sizeof(FINGER_PROFILE), header.count, file) == header.count;
+		if (!ok)
+			s_profiles.clear();
+	}
+
+	fclose(file);
+	return ok;
+}
+
+bool FingerCalibration::FindProfile(uint32_t device_id, FINGER_PROFILE& profile)
+{
+	std::lock_guard<std::mutex> lk(s_profiles_mutex);
+	for (const FINGER_PROFILE& p : s_profiles) {
+		if (p.device_id == device_id) {
+			profile = p;
+			return true;
+		}
+	}
+	return false;
+}
+
+// Called with the profiles locked
+bool FingerCalibration::WriteProfiles()
+{
+	// Written next to the file and renamed over it, so a failed write keeps the old profiles
+	std::string path = ProfilePath();
+	std::string temp = path + ".tmp";
+	FILE* file = fopen(temp.c_str(), "wb");
+	if (!file)
+		return false;
+
+	FINGER_PROFILE_HEADER header;
+	header.magic = FINGER_PROFILE_MAGIC;
+	header.version = FINGER_PROFILE_VERSION;
+	header.count = (uint16_t)s_profiles.size();
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+		fwrite(s_profiles.data(), sizeof(FINGER_PROFILE), s_profiles.size(), file) == s_profiles.size();
+	ok = fclose(file) == 0 && ok;
+#ifdef _WIN32
+	// rename doesn't replace an existing file on Windows
+	if (ok)
+		remove(path.c_str());
+#endif
+	if (!ok || rename(temp.c_str(), path.c_str()) != 0) {
+		remove(temp.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool FingerCalibration::SaveProfile(const FINGER_PROFILE& profile)
+{
+	std::lock_guard<std::mutex> lk(s_profiles_mutex);
+
+	bool found = false;
+	for (FINGER_PROFILE& p : s_profiles) {
+		if (p.device_id == profile.device_id) {
+			p = profile;
+			found = true;
+		}
+	}
+	if (!found)
+		s_profiles.push_back(profile);
+
+	// Rewrite the whole file, it only holds a few dozen bytes per glove
+	return WriteProfiles();
+}
+
+bool FingerCalibration::SaveResponse(uint32_t device_id, const float gamma[FINGER_PROFILE_FINGERS])
+{
+	std::lock_guard<std::mutex> lk(s_profiles_mutex);
+
+	bool found = false;
+	for (FINGER_PROFILE& p : s_profiles) {
+		if (p.device_id == device_id) {
+			memcpy(p.gamma, gamma, sizeof(p.gamma));
+			found = true;
+		}
+	}
+	// A glove without a recorded range uses the full range, like SetResponse() does
+	if (!found) {
+		FINGER_PROFILE profile;
+		profile.device_id = device_id;
+		memset(profile.min, 0, sizeof(profile.min));
+		memset(profile.max, 0xFF, sizeof(profile.max));
+		memcpy(profile.gamma, gamma, sizeof(profile.gamma));
+		s_profiles.push_back(profile);
+	}
+
+	return WriteProfiles();
+}
@@ -0,0 +1,85 @@
+/*
+   Copyright 2015 Manus VR
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <mutex>
+#include <vector>
+
+#define FINGER_PROFILE_FINGERS 5
+// File the profiles are stored in, can be overridden with the MANUS_PROFILES environment variable
+#define FINGER_PROFILE_FILE "ManusProfiles.bin"
+#define FINGER_PROFILE_MAGIC 0x50464E4D // "MNFP"
+#define FINGER_PROFILE_VERSION 1
+
+#pragma pack(push, 1) // stored as is in the profile file
+typedef struct {
+	uint32_t device_id;
+	uint8_t min[FINGER_PROFILE_FINGERS];
+	uint8_t max[FINGER_PROFILE_FINGERS];
+	// Exponent of the response curve, 1 is linear
+	float gamma[FINGER_PROFILE_FINGERS];
+} FINGER_PROFILE;
+#pragma pack(pop)
+
+// Host side calibration of the finger range of a glove.
+// The raw finger values are mapped through a lookup table that is built
+// from the profile, so applying the calibration costs one load per finger.
+// Fingers are in report order, the calibration is applied before the
+// fingers are reordered for the hand.
+class FingerCalibration
+{
+private:
+	FINGER_PROFILE m_profile;
+	bool m_valid;
+
+	bool m_recording;
+	uint8_t m_recorded_min[FINGER_PROFILE_FINGERS];
+	uint8_t m_recorded_max[FINGER_PROFILE_FINGERS];
+
+	float m_lut[FINGER_PROFILE_FINGERS][256];
+
+	void BuildLut();
+
+	static std::mutex s_profiles_mutex;
+	static std::vector<FINGER_PROFILE> s_profiles;
+	static const char* ProfilePath();
+	static bool WriteProfiles();
+
+public:
+	FingerCalibration();
+
+	/*! \brief Select the glove, applies its stored profile if there is one. */
+	void SetDeviceId(uint32_t device_id);
+	uint32_t GetDeviceId() const { return m_profile.device_id; }
+	const FINGER_PROFILE& GetProfile() const { return m_profile; }
+
+	void StartRecording();
+	/*! \brief Finish recording and apply the recorded range, store it with SaveProfile(). */
+	bool StopRecording();
+	void SetResponse(const float gamma[FINGER_PROFILE_FINGERS]);
+
+	/*! \brief Normalize the raw finger values, called from the device thread. */
+	void Apply(const uint8_t raw[FINGER_PROFILE_FINGERS], float fingers[FINGER_PROFILE_FINGERS]);
+
+	/*! \brief Load all stored profiles into memory. */
+	static bool LoadProfiles();
+	static bool FindProfile(uint32_t device_id, FINGER_PROFILE& profile);
+	static bool SaveProfile(const FINGER_PROFILE& profile);
+	/*! \brief Store the response curve in the profile of the glove, which keeps its range. */
+	static bool SaveResponse(uint32_t device_id, const float gamma[FINGER_PROFILE_FINGERS]);
+};
@@ -0,0 +1,285 @@
+/*
+   Copyright 2015 Manus VR
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include <math.h>
+
+// Fixed size versions of the matrix routines in matrix.cpp.
+//
+// The routines in matrix.cpp take row pointer arrays and a runtime size so
+// a single implementation serves every dimension. These overloads take
+// references to plain two dimensional arrays instead, the dimension is a
+// template parameter so the loops have constant trip counts the compiler
+// can unroll and vectorize, and there is no indirection through row pointers.
+// The algorithms are the same step for step, so the results match the
+// C versions.
+
+// function sets the matrix A to the identity matrix
+template <int N>
+inline void fmatrixAeqI(float (&A)[N][N])
+{
+	for (int i = 0; i < N; i++)
+		for (int j = 0; j < N; j++)
+			A[i][j] = (i == j) ? 1.0F : 0.0F;
+}
+
+// function sets every entry in the matrix A to a constant scalar
+template <int N>
+inline void fmatrixAeqScalar(float (&A)[N][N], float Scalar)
+{
+	for (int i = 0; i < N; i++)
+		for (int j = 0; j < N; j++)
+			A[i][j] = Scalar;
+}
+
+// function negates all elements of matrix A
+template <int N>
+inline void fmatrixAeqMinusA(float (&A)[N][N])
+{
+	for (int i = 0; i < N; i++)
+		for (int j = 0; j < N; j++)
+			A[i][j] = -A[i][j];
+}
+
+// function calculates the determinant of a 3x3 matrix
+inline float fmatrixDetA(const float (&A)[3][3])
+{
+	return (A[0][0] * (A[1][1] * A[2][2] - A[1][2] * A[2][1]) +
+		A[0][1] * (A[1][2] * A[2][0] - A[1][0] * A[2][2]) +
+		A[0][2] * (A[1][0] * A[2][1] - A[1][1] * A[2][0]));
+}
+
+// function directly calculates the symmetric inverse of a symmetric 3x3 matrix
+// only the on and above diagonal terms in B are used and need to be specified
+inline void fmatrixAeqInvSymB(float (&A)[3][3], const float (&B)[3][3])
+{
+	float fB11B22mB12B12 = B[1][1] * B[2][2] - B[1][2] * B[1][2];
+	float fB12B02mB01B22 = B[1][2] * B[0][2] - B[0][1] * B[2][2];
+	float fB01B12mB11B02 = B[0][1] * B[1][2] - B[1][1] * B[0][2];
+
+	// determinant and then reciprocal
+	float ftmp = B[0][0] * fB11B22mB12B12 + B[0][1] * fB12B02mB01B22 + B[0][2] * fB01B12mB11B02;
+
+	if (ftmp != 0.0F)
+	{
+		ftmp = 1.0F / ftmp;
+		A[0][0] = fB11B22mB12B12 * ftmp;
+		A[1][0] = A[0][1] = fB12B02mB01B22 * ftmp;
+		A[2][0] = A[0][2] = fB01B12mB11B02 * ftmp;
+		A[1][1] = (B[0][0] * B[2][2] - B[0][2] * B[0][2]) * ftmp;
+		A[2][1] = A[1][2] = (B[0][2] * B[0][1] - B[0][0] * B[1][2]) * ftmp;
+		A[2][2] = (B[0][0] * B[1][1] - B[0][1] * B[0][1]) * ftmp;
+	}
+	else
+	{
+		// provide the identity matrix if the determinant is zero
+		fmatrixAeqI(A);
+	}
+}
+
+// function computes all eigenvalues and eigenvectors of a real symmetric matrix A
+// using Jacobi rotations, see eigencompute() in matrix.cpp.
+// A is changed on output, the eigenvectors are the columns of eigvec and are not sorted
+template <int N>
+inline void eigencompute(float (&A)[N][N], float (&eigval)[N], float (&eigvec)[N][N])
+{
+	// maximum number of iterations to achieve convergence: in practice 6 is typical
+	const int NITER = 15;
+
+	for (int ir = 0; ir < N; ir++)
+	{
+		for (int ic = 0; ic < N; ic++)
+			eigvec[ir][ic] = 0.0F;
+		eigvec[ir][ir] = 1.0F;
+		eigval[ir] = A[ir][ir];
+	}
+
+	float residue;
+	int ctr = 0;
+	do
+	{
+		// absolute value of the above diagonal elements as exit criterion
+		residue = 0.0F;
+		for (int ir = 0; ir < N - 1; ir++)
+			for (int ic = ir + 1; ic < N; ic++)
+				residue += fabsf(A[ir][ic]);
+
+		if (residue > 0.0F)
+		{
+			for (int ir = 0; ir < N - 1; ir++)
+			{
+				for (int ic = ir + 1; ic < N; ic++)
+				{
+					if (fabsf(A[ir][ic]) > 0.0F)
+					{
+						float cot2phi = 0.5F * (eigval[ic] - eigval[ir]) / (A[ir][ic]);
+
+						// use the smaller solution of tan(phi)
+						float tanphi = 1.0F / (fabsf(cot2phi) + sqrtf(1.0F + cot2phi * cot2phi));
+						if (cot2phi < 0.0F)
+							tanphi = -tanphi;
+
+						float cosphi = 1.0F / sqrtf(1.0F + tanphi * tanphi);
+						float sinphi = tanphi * cosphi;
+						float tanhalfphi = sinphi / (1.0F + cosphi);
+
+						float ftmp = tanphi * A[ir][ic];
+						eigval[ir] -= ftmp;
+						eigval[ic] += ftmp;
+						A[ir][ic] = 0.0F;
+
+						for (int j = 0; j < N; j++)
+						{
+							ftmp = eigvec[j][ir];
+							eigvec[j][ir] = ftmp - sinphi * (eigvec[j][ic] + tanhalfphi * ftmp);
+							eigvec[j][ic] = eigvec[j][ic] + sinphi * (ftmp - tanhalfphi * eigvec[j][ic]);
+						}
+
+						// apply the rotation only to the elements of A that can change
+						for (int j = 0; j <= ir - 1; j++)
+						{
+							ftmp = A[j][ir];
+							A[j][ir] = ftmp - sinphi * (A[j][ic] + tanhalfphi * ftmp);
+							A[j][ic] = A[j][ic] + sinphi * (ftmp - tanhalfphi * A[j][ic]);
+						}
+						for (int j = ir + 1; j <= ic - 1; j++)
+						{
+							ftmp = A[ir][j];
+							A[ir][j] = ftmp - sinphi * (A[j][ic] + tanhalfphi * ftmp);
+							A[j][ic] = A[j][ic] + sinphi * (ftmp - tanhalfphi * A[j][ic]);
+						}
+						for (int j = ic + 1; j < N; j++)
+						{
+							ftmp = A[ir][j];
+							A[ir][j] = ftmp - sinphi * (A[ic][j] + tanhalfphi * ftmp);
+							A[ic][j] = A[ic][j] + sinphi * (ftmp - tanhalfphi * A[ic][j]);
+						}
+					}
+				}
+			}
+		}
+	} while ((residue > 0.0F) && (ctr++ < NITER));
+}
+
+// function uses Gauss-Jordan elimination with full pivoting to compute the
+// inverse of matrix A in situ, see fmatrixAeqInvA() in matrix.cpp.
+// A singular matrix is replaced with the identity matrix and false is returned
+template <int N>
+inline bool fmatrixAeqInvA(float (&A)[N][N])
+{
+	int iColInd[N], iRowInd[N], iPivot[N];
+	int iPivotRow = 0, iPivotCol = 0;
+
+	for (int j = 0; j < N; j++)
+		iPivot[j] = 0;
+
+	for (int i = 0; i < N; i++)
+	{
+		// find the largest element not in a previously pivoted row or column
+		float largest = 0.0F;
+		for (int j = 0; j < N; j++)
+		{
+			if (iPivot[j] != 1)
+			{
+				for (int k = 0; k < N; k++)
+				{
+					if (iPivot[k] == 0)
+					{
+						if (fabsf(A[j][k]) >= largest)
+						{
+							iPivotRow = j;
+							iPivotCol = k;
+							largest = fabsf(A[iPivotRow][iPivotCol]);
+						}
+					}
+					else if (iPivot[k] > 1)
+					{
+						fmatrixAeqI(A);
+						return false;
+					}
+				}
+			}
+		}
+		iPivot[iPivotCol]++;
+
+		if (iPivotRow != iPivotCol)
+		{
+			for (int l = 0; l < N; l++)
+			{
+				float ftmp = A[iPivotRow][l];
+				A[iPivotRow][l] = A[iPivotCol][l];
+				A[iPivotCol][l] = ftmp;
+			}
+		}
+
+		iRowInd[i] = iPivotRow;
+		iColInd[i] = iPivotCol;
+
+		if (A[iPivotCol][iPivotCol] == 0.0F)
+		{
+			fmatrixAeqI(A);
+			return false;
+		}
+
+		float recippiv = 1.0F / A[iPivotCol][iPivotCol];
+		A[iPivotCol][iPivotCol] = 1.0F;
+		for (int l = 0; l < N; l++)
+			A[iPivotCol][l] *= recippiv;
+
+		for (int m = 0; m < N; m++)
+		{
+			if (m != iPivotCol)
+			{
+				float scaling = A[m][iPivotCol];
+				A[m][iPivotCol] = 0.0F;
+				for (int l = 0; l < N; l++)
+					A[m][l] -= A[iPivotCol][l] * scaling;
+			}
+		}
+	}
+
+	// apply the column swaps in reverse order
+	for (int l = N - 1; l >= 0; l--)
+	{
+		int i = iRowInd[l];
+		int j = iColInd[l];
+		if (i != j)
+		{
+			for (int k = 0; k < N; k++)
+			{
+				float ftmp = A[k][i];
+				A[k][i] = A[k][j];
+				A[k][j] = ftmp;
+			}
+		}
+	}
+
+	return true;
+}
+
+// function multiplies the matrix A with the vector x
+template <int N>
+inline void fmatrixAxV(float (&y)[N], const float (&A)[N][N], const float (&x)[N])
+{
+	for (int i = 0; i < N; i++)
+	{
+		float sum = 0.0F;
+		for (int j = 0; j < N; j++)
+			sum += A[i][j] * x[j];
+		y[i] = sum;
+	}
+}
@@ -0,0 +1,221 @@
+/*
+   Copyright 2015 Manus VR
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include "stdafx.h"
+#include "GestureRecognizer.h"
+#include "ManusMath.h"
+
+#include <string.h>
+#include <float.h>
+
+// Squared distance in finger bends below which the built-in gestures match
+#define GESTURE_DEFAULT_THRESHOLD 0.25f
+
+// Finger bends of the built-in gestures, thumb first (0 = straight, 1 = bent)
+static const float s_builtin_gestures[][5] = {
+	{ 1.0f, 1.0f, 1.0f, 1.0f, 1.0f }, // GLOVE_GESTURE_FIST
+	{ 1.0f, 0.0f, 1.0f, 1.0f, 1.0f }, // GLOVE_GESTURE_POINT
+	{ 0.5f, 0.5f, 0.0f, 0.0f, 0.0f }, // GLOVE_GESTURE_PINCH
+	{ 0.0f, 0.0f, 0.0f, 0.0f, 0.0f }, // GLOVE_GESTURE_OPEN
+	{ 0.0f, 1.0f, 1.0f, 1.0f, 1.0f }, // GLOVE_GESTURE_THUMBS_UP
+};
+
+std::mutex GestureRecognizer::s_bank_mutex;
+GestureRecognizer::BANK GestureRecognizer::s_bank;
+std::atomic<uint32_t> GestureRecognizer::s_bank_version(0);
+std::shared_timed_mutex GestureRecognizer::s_callback_mutex;
+GLOVE_GESTURE_CALLBACK GestureRecognizer::s_callback = NULL;
+void* GestureRecognizer::s_user_data = NULL;
+
+GestureRecognizer::GestureRecognizer()
+	: m_bank_version(0)
+{
+	m_bank.count = 0;
+	for (int i = 0; i < 2; i++) {
+		m_state[i].current = -1;
+		m_state[i].candidate = -1;
+		m_state[i].candidate_count = 0;
+		m_gesture[i] = GLOVE_GESTURE_NONE;
+	}
+}
+
+void GestureRecognizer::InitializeBank()
+{
+	// Called with s_bank_mutex held, version 0 means the bank is still empty
+	if (s_bank_version != 0)
+		return;
+
+	memset(&s_bank, 0, sizeof(s_bank));
+	for (int t = 0; t < GESTURE_MAX_TEMPLATES; t++)
+		s_bank.thresholds[t] = -1.0f; // padding never matches
+
+	// The built-in gestures only look at the fingers
+	float weights[GESTURE_FEATURES] = { 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f };
+	for (int i = 0; i < (int)(sizeof(s_builtin_gestures) / sizeof(s_builtin_gestures[0])); i++) {
+		float features[GESTURE_FEATURES] = { 0 };
+		memcpy(features, s_builtin_gestures[i], sizeof(s_builtin_gestures[i]));
+		AddTemplateLocked(GLOVE_GESTURE_FIST + i, features, weights, GESTURE_DEFAULT_THRESHOLD);
+	}
+	s_bank_version = 1;
+}
+
+int GestureRecognizer::AddTemplateLocked(int id, const float features[GESTURE_FEATURES], const float weights[GESTURE_FEATURES], float threshold)
+{
+	if (s_bank.count >= GESTURE_MAX_TEMPLATES)
+		return GLOVE_GESTURE_NONE;
+
+	int t = s_bank.count++;
+	for (int f = 0; f < GESTURE_FEATURES; f++) {
+		s_bank.features[f][t] = features[f];
+		s_bank.weights[f][t] = weights[f];
+	}
+	s_bank.thresholds[t] = threshold;
+	s_bank.ids[t] = id;
+	return id;
+}
+
+int GestureRecognizer::AddTemplate(const float fingers[5], const GLOVE_QUATERNION* orientation, float threshold)
+{
+	std::lock_guard<std::mutex> lk(s_bank_mutex);
+	InitializeBank();
+
+	float features[GESTURE_FEATURES] = { 0 };
+	float weights[GESTURE_FEATURES] = { 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f };
+	memcpy(features, fingers, 5 * sizeof(float));
+
+	// Only the direction of gravity is used so the template matches at any heading
+	if (orientation) {
+		GLOVE_VECTOR gravity;
+		ManusMath::GetGravity(&gravity, orientation);
+		features[5] = gravity.x;
+		features[6] = gravity.y;
+		features[7] = gravity.z;
+		weights[5] = weights[6] = weights[7] = 1.0f;
+	}
+
+	// User templates are numbered after the built-in gestures
+	int id = GLOVE_GESTURE_USER + s_bank.count - (int)(sizeof(s_builtin_gestures) / sizeof(s_builtin_gestures[0]));
+	id = AddTemplateLocked(id, features, weights, threshold);
+	// A full bank is unchanged, the gloves keep their state
+	if (id != GLOVE_GESTURE_NONE)
+		s_bank_version++;
+	return id;
+}
+
+void GestureRecognizer::SetCallback(GLOVE_GESTURE_CALLBACK callback, void* user_data)
+{
+	std::unique_lock<std::shared_timed_mutex> lk(s_callback_mutex);
+	s_callback = callback;
+	s_user_data = user_data;
+}
+
+void GestureRecognizer::Publish(GLOVE_HAND hand, int gesture, bool active, uint64_t timestamp)
+{
+	GLOVE_GESTURE_EVENT event;
+	event.hand = hand;
+	event.gesture = gesture;
+	event.active = active ? 1 : 0;
+	event.timestamp = timestamp;
+
+	// Events are dropped when nobody polls, the callback still sees them
+	m_events.Push(event);
+	std::shared_lock<std::shared_timed_mutex> lk(s_callback_mutex);
+	if (s_callback)
+		s_callback(&event, s_user_data);
+}
+
+void GestureRecognizer::Update(GLOVE_HAND hand, const GLOVE_DATA& data, uint64_t timestamp)
+{
+	STATE& state = m_state[hand];
+
+	// Pick up new templates, the indices change so restart the classification
+	uint32_t version = s_bank_version;
+	if (version == 0 || version != m_bank_version) {
+		{
+			std::lock_guard<std::mutex> lk(s_bank_mutex);
+			InitializeBank();
+			memcpy(&m_bank, &s_bank, sizeof(m_bank));
+			m_bank_version = s_bank_version;
+		}
+		for (int i = 0; i < 2; i++) {
+			if (m_state[i].current >= 0)
+				Publish((GLOVE_HAND)i, m_gesture[i], false, timestamp);
+			m_state[i].current = -1;
+			m_state[i].candidate = -1;
+			m_state[i].candidate_count = 0;
+			m_gesture[i] = GLOVE_GESTURE_NONE;
+		}
+	}
+
+	float features[GESTURE_FEATURES];
+	memcpy(features, data.Fingers, 5 * sizeof(float));
+	GLOVE_VECTOR gravity;
+	ManusMath::GetGravity(&gravity, &data.Quaternion);
+	features[5] = gravity.x;
+	features[6] = gravity.y;
+	features[7] = gravity.z;
+
+	// Weighted squared distance to every template, padded to a multiple of 8
+	// so the inner loop vectorizes without a remainder
+	int count = (m_bank.count + 7) & ~7;
+	for (int t = 0; t < count; t++)
+		m_distance[t] = 0.0f;
+	for (int f = 0; f < GESTURE_FEATURES; f++) {
+		const float x = features[f];
+		const float* templ = m_bank.features[f];
+		const float* weight = m_bank.weights[f];
+		for (int t = 0; t < count; t++) {
+			float d = x - templ[t];
+			m_distance[t] += weight[t] * d * d;
+		}
+	}
+
+	int best = -1;
+	float best_distance = FLT_MAX;
+	for (int t = 0; t < count; t++) {
+		if (m_distance[t] < m_bank.thresholds[t] && m_distance[t] < best_distance) {
+			best = t;
+			best_distance = m_distance[t];
+		}
+	}
+
+	// Hysteresis: the active gesture holds until it's clearly left
+	if (state.current >= 0) {
+		if (m_distance[state.current] <= m_bank.thresholds[state.current] * GESTURE_RELEASE_FACTOR) {
+			state.candidate = -1;
+			state.candidate_count = 0;
+			return;
+		}
+		Publish(hand, m_bank.ids[state.current], false, timestamp);
+		state.current = -1;
+		m_gesture[hand] = GLOVE_GESTURE_NONE;
+	}
+
+	// A new gesture has to match for several samples before it starts
+	if (best != state.candidate) {
+		state.candidate = best;
+		state.candidate_count = 0;
+	}
+	if (best < 0)
+		return;
+	if (++state.candidate_count >= GESTURE_HOLD_SAMPLES) {
+		state.current = best;
+		state.candidate = -1;
+		state.candidate_count = 0;
+		m_gesture[hand] = m_bank.ids[best];
+		Publish(hand, m_bank.ids[best], true, timestamp);
+	}
+}
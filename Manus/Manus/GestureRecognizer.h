@@ -0,0 +1,94 @@
+/*
+   Copyright 2015 Manus VR
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include "Manus.h"
+#include "SpscQueue.h"
+
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+
+// Five finger bends followed by the gravity direction in the glove frame
+#define GESTURE_FEATURES 8
+#define GESTURE_MAX_TEMPLATES 256
+// Consecutive samples a gesture has to match before it starts
+#define GESTURE_HOLD_SAMPLES 3
+// A gesture ends when its distance exceeds the threshold by this factor
+#define GESTURE_RELEASE_FACTOR 1.5f
+#define GESTURE_QUEUE_SIZE 64
+
+// Classifies hand poses by their distance to a set of templates.
+// The templates are stored per feature (structure of arrays) so the
+// distance to all templates is computed by loops over contiguous floats.
+class GestureRecognizer
+{
+private:
+	typedef struct {
+		float features[GESTURE_FEATURES][GESTURE_MAX_TEMPLATES];
+		float weights[GESTURE_FEATURES][GESTURE_MAX_TEMPLATES];
+		float thresholds[GESTURE_MAX_TEMPLATES];
+		int ids[GESTURE_MAX_TEMPLATES];
+		int count;
+	} BANK;
+
+	typedef struct {
+		int current;
+		int candidate;
+		int candidate_count;
+	} STATE;
+
+	// The template bank is shared, each recognizer works on a copy
+	// that's refreshed when the version changes
+	static std::mutex s_bank_mutex;
+	static BANK s_bank;
+	static std::atomic<uint32_t> s_bank_version;
+
+	// Held shared while a device thread calls the callback, so changing
+	// the callback waits until no thread still runs the old one
+	static std::shared_timed_mutex s_callback_mutex;
+	static GLOVE_GESTURE_CALLBACK s_callback;
+	static void* s_user_data;
+
+	BANK m_bank;
+	uint32_t m_bank_version;
+
+	STATE m_state[2];
+	std::atomic<int> m_gesture[2];
+	float m_distance[GESTURE_MAX_TEMPLATES];
+
+	SpscQueue<GLOVE_GESTURE_EVENT, GESTURE_QUEUE_SIZE> m_events;
+
+	static void InitializeBank();
+	static int AddTemplateLocked(int id, const float features[GESTURE_FEATURES], const float weights[GESTURE_FEATURES], float threshold);
+	void Publish(GLOVE_HAND hand, int gesture, bool active, uint64_t timestamp);
+
+public:
+	GestureRecognizer();
+
+	/*! \brief Classify a new sample, called from the device thread at sensor rate. */
+	void Update(GLOVE_HAND hand, const GLOVE_DATA& data, uint64_t timestamp);
+
+	/*! \brief Get the next gesture event, must only be called from one thread. */
+	bool PollEvent(GLOVE_GESTURE_EVENT& event) { return m_events.Pop(event); }
+
+	/*! \brief Get the gesture that is currently active for the hand. */
+	int GetGesture(GLOVE_HAND hand) const { return m_gesture[hand]; }
+
+	static int AddTemplate(const float fingers[5], const GLOVE_QUATERNION* orientation, float threshold);
+	static void SetCallback(GLOVE_GESTURE_CALLBACK callback, void* user_data);
+};
@@ -0,0 +1,284 @@
+/*
+   Copyright 2015 Manus VR
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+
+#include "stdafx.h"
+#include "HapticScheduler.h"
+#include "Device.h"
+#include "DeviceManager.h"
+
+extern DeviceList g_devices;
+
+std::mutex HapticScheduler::s_mutex;
+std::condition_variable HapticScheduler::s_cv;
+std::thread HapticScheduler::s_thread;
+bool HapticScheduler::s_running = false;
+std::vector<HapticScheduler::SEGMENT> HapticScheduler::s_segments[2];
+uint32_t HapticScheduler::s_generation[2] = { 0, 0 };
+std::vector<HapticScheduler::EVENT> HapticScheduler::s_wheel[HAPTIC_WHEEL_SLOTS];
+size_t HapticScheduler::s_pending = 0;
+std::chrono::steady_clock::time_point HapticScheduler::s_epoch;
+uint64_t HapticScheduler::s_tick = 0;
+
+static uint64_t Duration(const GLOVE_HAPTIC_WAVEFORM& waveform)
+{
+	switch (waveform.shape) {
+	case GLOVE_HAPTIC_ADSR:
+		return (uint64_t)waveform.attack + waveform.decay + waveform.sustain + waveform.release;
+	case GLOVE_HAPTIC_PULSES:
+		if (!waveform.count || !waveform.on)
+			return 0;
+		return (uint64_t)waveform.count * waveform.on + (uint64_t)(waveform.count - 1) * waveform.off;
+	case GLOVE_HAPTIC_CURVE:
+		if (!waveform.samples || waveform.sample_count < 2)
+			return 0;
+		return (uint64_t)(waveform.sample_count - 1) * waveform.sample_interval;
+	}
+	return 0;
+}
+
+static uint8_t Quantize(float power)
+{
+	if (power < 0.0f) power = 0.0f;
+	if (power > 1.0f) power = 1.0f;
+	return (uint8_t)(power * HAPTIC_LEVELS + 0.5f);
+}
+
+float HapticScheduler::Sample(const GLOVE_HAPTIC_WAVEFORM& waveform, uint32_t time)
+{
+	// The power in the middle of the millisecond
+	float t = time + 0.5f;
+	float value = 0.0f;
+
+	switch (waveform.shape) {
+	case GLOVE_HAPTIC_ADSR:
+		if (t < waveform.attack) {
+			value = t / waveform.attack;
+			break;
+		}
+		t -= waveform.attack;
+		if (t < waveform.decay) {
+			value = 1.0f + (waveform.sustain_level - 1.0f) * t / waveform.decay;
+			break;
+		}
+		t -= waveform.decay;
+		if (t < waveform.sustain) {
+			value = waveform.sustain_level;
+			break;
+		}
+		t -= waveform.sustain;
+		value = waveform.sustain_level * (1.0f - t / waveform.release);
+		break;
+	case GLOVE_HAPTIC_PULSES:
+		value = (time % (waveform.on + waveform.off)) < waveform.on ? 1.0f : 0.0f;
+		break;
+	case GLOVE_HAPTIC_CURVE: {
+		float position = t / waveform.sample_interval;
+		unsigned int i = (unsigned int)position;
+		if (i >= waveform.sample_count - 1)
+			return waveform.samples[waveform.sample_count - 1] * waveform.power;
+		float fraction = position - i;
+		value = waveform.samples[i] + (waveform.samples[i + 1] - waveform.samples[i]) * fraction;
+		break;
+	}
+	}
+	return value * waveform.power;
+}
+
+bool HapticScheduler::Compile(const GLOVE_HAPTIC_WAVEFORM& waveform, std::vector<SEGMENT>& segments)
+{
+	uint64_t total = Duration(waveform);
+	if (total == 0 || total > HAPTIC_MAX_DURATION_MS)
+		return false;
+
+	segments.clear();
+	uint32_t time = 0;
+	while (time < total) {
+		// Extend the segment while the power stays on the same level
+		uint8_t level = Quantize(Sample(waveform, time));
+		uint32_t end = time + 1;
+		while (end < total && Quantize(Sample(waveform, end)) == level)
+			end++;
+
+		// Steps that are too short for the radio are averaged out
+		if (end - time < HAPTIC_MIN_SEGMENT_MS) {
+			end = time + HAPTIC_MIN_SEGMENT_MS;
+			if (end > total)
+				end = (uint32_t)total;
+			float sum = 0.0f;
+			for (uint32_t t = time; t < end; t++)
+				sum += Sample(waveform, t);
+			level = Quantize(sum / (end - time));
+		}
+
+		if (!segments.empty() && segments.back().level == level) {
+			segments.back().duration += end - time;
+		} else {
+			SEGMENT segment = { level, end - time };
+			segments.push_back(segment);
+		}
+		time = end;
+	}
+	return true;
+}
+
+int HapticScheduler::Play(GLOVE_HAND hand, const GLOVE_HAPTIC_WAVEFORM& waveform)
+{
+	std::vector<SEGMENT> segments;
+	if (!Compile(waveform, segments))
+		return MANUS_INVALID_ARGUMENT;
+
+	std::lock_guard<std::mutex> lk(s_mutex);
+	if (!s_running) {
+		s_running = true;
+		s_thread = std::thread(SchedulerThread);
+	}
+
+	// An empty wheel restarts the clock, the ticks stay small
+	if (!s_pending) {
+		s_epoch = std::chrono::steady_clock::now();
+		s_tick = 0;
+	}
+
+	s_segments[hand].swap(segments);
+	s_generation[hand]++;
+	Schedule(hand, 0, s_tick);
+	s_cv.notify_one();
+	return MANUS_SUCCESS;
+}
+
+void HapticScheduler::Cancel(GLOVE_HAND hand)
+{
+	// The events of the waveform are dropped when they come up
+	std::lock_guard<std::mutex> lk(s_mutex);
+	s_segments[hand].clear();
+	s_generation[hand]++;
+}
+
+void HapticScheduler::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lk(s_mutex);
+		if (!s_running)
+			return;
+		s_running = false;
+		s_cv.notify_one();
+	}
+	if (s_thread.joinable())
+		s_thread.join();
+
+	std::lock_guard<std::mutex> lk(s_mutex);
+	for (int i = 0; i < HAPTIC_WHEEL_SLOTS; i++)
+		s_wheel[i].clear();
+	s_pending = 0;
+	for (int i = 0; i < 2; i++) {
+		s_segments[i].clear();
+		s_generation[i]++;
+	}
+}
+
+void HapticScheduler::Schedule(GLOVE_HAND hand, uint32_t segment, uint64_t tick)
+{
+	// Called with s_mutex held, tick is never before s_tick
+	EVENT event;
+	event.hand = hand;
+	event.generation = s_generation[hand];
+	event.segment = segment;
+	event.rounds = (uint32_t)((tick - s_tick) / HAPTIC_WHEEL_SLOTS);
+	s_wheel[tick & (HAPTIC_WHEEL_SLOTS - 1)].push_back(event);
+	s_pending++;
+}
+
+void HapticScheduler::Fire(const EVENT& event, uint64_t tick, std::vector<MESSAGE>& messages)
+{
+	// Called with s_mutex held
+	if (event.generation != s_generation[event.hand])
+		return;
+
+	const std::vector<SEGMENT>& segments = s_segments[event.hand];
+	const SEGMENT& segment = segments[event.segment];
+	bool last = event.segment + 1 == segments.size();
+
+	// A silent segment needs no message as the previous one runs out by
+	// itself, only the start of a waveform stops what was playing before
+	if (segment.level || event.segment == 0) {
+		MESSAGE message;
+		message.hand = event.hand;
+		message.level = segment.level;
+		message.duration = segment.level ? segment.duration : 0;
+		if (segment.level && !last && segments[event.segment + 1].level)
+			message.duration += HAPTIC_OVERLAP_MS;
+		messages.push_back(message);
+	}
+
+	if (!last)
+		Schedule(event.hand, event.segment + 1, tick + segment.duration);
+}
+
+void HapticScheduler::Send(const MESSAGE& message)
+{
+	device_type_t dev = (message.hand == GLOVE_LEFT) ? DEV_GLOVE_LEFT : DEV_GLOVE_RIGHT;
+	for (Device* device : g_devices) {
+		if (!device->IsConnected(dev)) continue;
+		device->SetTimedVibration((float)message.level / HAPTIC_LEVELS, message.duration, dev);
+		return;
+	}
+}
+
+void HapticScheduler::SchedulerThread()
+{
+	std::vector<EVENT> due;
+	std::vector<MESSAGE> messages;
+
+	std::unique_lock<std::mutex> lk(s_mutex);
+	while (s_running) {
+		if (!s_pending) {
+			s_cv.wait(lk);
+			continue;
+		}
+
+		// Process every tick up to now, a late thread catches up in one go
+		uint64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::steady_clock::now() - s_epoch).count();
+		while (s_tick <= now) {
+			uint64_t tick = s_tick++;
+			std::vector<EVENT>& slot = s_wheel[tick & (HAPTIC_WHEEL_SLOTS - 1)];
+			due.swap(slot);
+			for (EVENT& event : due) {
+				if (event.rounds) {
+					event.rounds--;
+					slot.push_back(event);
+				} else {
+					s_pending--;
+					Fire(event, tick, messages);
+				}
+			}
+			due.clear();
+		}
+
+		// The devices are called without the lock, Play never waits on a radio
+		if (!messages.empty()) {
+			lk.unlock();
+			for (const MESSAGE& message : messages)
+				Send(message);
+			messages.clear();
+			lk.lock();
+			continue;
+		}
+
+		s_cv.wait_until(lk, s_epoch + std::chrono::milliseconds(s_tick));
+	}
+}
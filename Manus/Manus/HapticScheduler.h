@@ -0,0 +1,100 @@
+/*
+   Copyright 2015 Manus VR
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+
+#pragma once
+
+#include "Manus.h"
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Power steps of a compiled waveform, finer steps can't be felt. Levels
+// run from 0 (off) to HAPTIC_LEVELS (full power), so there are 17 of them
+#define HAPTIC_LEVELS 16
+// Shortest segment, the glove gets one message per report at best
+#define HAPTIC_MIN_SEGMENT_MS 10
+// A segment followed by another one keeps rumbling this long so the next
+// message arrives before the motor stops
+#define HAPTIC_OVERLAP_MS 10
+// Longest waveform that is accepted
+#define HAPTIC_MAX_DURATION_MS 60000
+// Slots of the timer wheel, one per millisecond, must be a power of two
+#define HAPTIC_WHEEL_SLOTS 64
+
+// Plays haptic waveforms on the gloves.
+// A waveform is compiled into segments of constant power and every segment
+// that rumbles becomes a single timed rumble message, the glove stops by
+// itself at the end. The segments are released by one thread driving a
+// hashed timer wheel, so a playing waveform costs a message per power step
+// instead of a message per millisecond.
+class HapticScheduler
+{
+public:
+	/*! \brief Replace the waveform of a hand, returns a MANUS_ error code. */
+	static int Play(GLOVE_HAND hand, const GLOVE_HAPTIC_WAVEFORM& waveform);
+	/*! \brief Drop the waveform of a hand, the motor keeps its last message. */
+	static void Cancel(GLOVE_HAND hand);
+	/*! \brief Drop all waveforms and stop the scheduler thread. */
+	static void Stop();
+
+private:
+	typedef struct {
+		uint8_t level;
+		uint32_t duration;
+	} SEGMENT;
+
+	typedef struct {
+		GLOVE_HAND hand;
+		uint32_t generation;
+		uint32_t segment;
+		// Turns of the wheel left before the event is due
+		uint32_t rounds;
+	} EVENT;
+
+	typedef struct {
+		GLOVE_HAND hand;
+		uint8_t level;
+		uint32_t duration;
+	} MESSAGE;
+
+	static std::mutex s_mutex;
+	static std::condition_variable s_cv;
+	static std::thread s_thread;
+	static bool s_running;
+
+	static std::vector<SEGMENT> s_segments[2];
+	// Raised whenever the waveform of a hand changes, older events are dropped
+	static uint32_t s_generation[2];
+
+	static std::vector<EVENT> s_wheel[HAPTIC_WHEEL_SLOTS];
+	static size_t s_pending;
+	static std::chrono::steady_clock::time_point s_epoch;
+	// Next tick to process, in milliseconds since the epoch
+	static uint64_t s_tick;
+
+	static float Sample(const GLOVE_HAPTIC_WAVEFORM& waveform, uint32_t time);
+	static bool Compile(const GLOVE_HAPTIC_WAVEFORM& waveform, std::vector<SEGMENT>& segments);
+	static void Schedule(GLOVE_HAND hand, uint32_t segment, uint64_t tick);
+	static void Fire(const EVENT& event, uint64_t tick, std::vector<MESSAGE>& messages);
+	static void Send(const MESSAGE& message);
+	static void SchedulerThread();
+};
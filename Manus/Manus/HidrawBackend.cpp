@@ -0,0 +1,123 @@
+/*
+   Copyright 2015 Manus VR
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include "stdafx.h"
+#include "HidrawBackend.h"
+#include "Device.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+
+HidrawBackend::HidrawBackend(const char* path)
+	: m_path(path), m_fd(-1)
+{
+}
+
+HidrawBackend::~HidrawBackend()
+{
+	Close();
+}
+
+bool HidrawBackend::Open()
+{
+	m_fd = open(m_path.c_str(), O_RDWR | O_CLOEXEC);
+	return m_fd >= 0;
+}
+
+void HidrawBackend::Close()
+{
+	if (m_fd >= 0)
+		close(m_fd);
+	m_fd = -1;
+}
+
+int HidrawBackend::Read(uint8_t* data, size_t length, int timeout_ms)
+{
+	struct pollfd fds;
+	fds.fd = m_fd;
+	fds.events = POLLIN;
+	fds.revents = 0;
+
+	int ret = poll(&fds, 1, timeout_ms);
+	if (ret < 0)
+		return errno == EINTR ? 0 : -1;
+	if (ret == 0)
+		return 0;
+	// The node is invalidated when the dongle is unplugged
+	if (fds.revents & (POLLERR | POLLHUP | POLLNVAL))
+		return -1;
+
+	ssize_t bytes = read(m_fd, data, length);
+	if (bytes < 0)
+		return (errno == EAGAIN || errno == EINTR) ? 0 : -1;
+	return (int)bytes;
+}
+
+int HidrawBackend::Write(const uint8_t* data, size_t length)
+{
+	// The first byte is the report number, which hidraw expects in the buffer as well
+	ssize_t bytes = write(m_fd, data, length);
+	return bytes < 0 ? -1 : (int)bytes;
+}
+
+uint64_t HidrawBackend::Timestamp()
+{
+	return DeviceTimestamp();
+}
+
+void HidrawBackend::Enumerate(uint16_t vendor_id, uint16_t product_id, std::vector<std::string>& paths)
+{
+	DIR* dir = opendir("/sys/class/hidraw");
+	if (!dir)
+		return;
+
+	struct dirent* entry;
+	while ((entry = readdir(dir)) != NULL) {
+		if (strncmp(entry->d_name, "hidraw", 6))
+			continue;
+
+		// A truncated path would open the uevent of another device
+		char uevent[PATH_MAX];
+		int length = snprintf(uevent, sizeof(uevent), "/sys/class/hidraw/%s/device/uevent", entry->d_name);
+		if (length < 0 || length >= (int)sizeof(uevent))
+			continue;
+		FILE* file = fopen(uevent, "r");
+		if (!file)
+			continue;
+
+		// The ids of the HID device are listed as HID_ID=<bus>:<vendor>:<product>
+		char line[256];
+		unsigned int bus, vendor, product;
+		bool match = false;
+		while (fgets(line, sizeof(line), file)) {
+			if (sscanf(line, "HID_ID=%x:%x:%x", &bus, &vendor, &product) == 3) {
+				match = vendor == vendor_id && product == product_id;
+				break;
+			}
+		}
+		fclose(file);
+
+		if (match)
+			paths.push_back(std::string("/dev/") + entry->d_name);
+	}
+	closedir(dir);
+}
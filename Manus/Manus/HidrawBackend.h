@@ -0,0 +1,45 @@
+/*
+   Copyright 2015 Manus VR
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include "DeviceBackend.h"
+
+#include <string>
+#include <vector>
+
+// Talks to a dongle through the Linux hidraw driver.
+// Reports are read straight into the buffer of the device thread, there is
+// no intermediate report queue or copy like in the hidapi implementation.
+class HidrawBackend : public DeviceBackend
+{
+private:
+	std::string m_path;
+	int m_fd;
+
+public:
+	HidrawBackend(const char* path);
+	~HidrawBackend();
+
+	bool Open();
+	void Close();
+	int Read(uint8_t* data, size_t length, int timeout_ms);
+	int Write(const uint8_t* data, size_t length);
+	uint64_t Timestamp();
+
+	/*! \brief Find the hidraw nodes of the devices with the given vendor and product id. */
+	static void Enumerate(uint16_t vendor_id, uint16_t product_id, std::vector<std::string>& paths);
+};
@@ -0,0 +1,137 @@
+/*
+   Copyright 2015 Manus VR
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include "stdafx.h"
+#include "LatencyHistogram.h"
+
+#include <string.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#define LATENCY_SUB_COUNT (1 << LATENCY_SUB_BITS)
+#define LATENCY_HALF_COUNT (1 << (LATENCY_SUB_BITS - 1))
+
+static int HighestBit(uint64_t value)
+{
+#ifdef _MSC_VER
+	// The 64-bit scan isn't available on 32-bit targets
+	unsigned long index;
+	if (_BitScanReverse(&index, (unsigned long)(value >> 32)))
+		return index + 32;
+	_BitScanReverse(&index, (unsigned long)value);
+	return index;
+#else
+	return 63 - __builtin_clzll(value);
+#endif
+}
+
+int LatencyHistogram::BucketIndex(uint64_t ns)
+{
+	if (ns < LATENCY_SUB_COUNT)
+		return (int)ns;
+
+	// The top LATENCY_SUB_BITS bits of the value select the bucket
+	int shift = HighestBit(ns) - (LATENCY_SUB_BITS - 1);
+	int sub = (int)(ns >> shift) - LATENCY_HALF_COUNT;
+	int index = LATENCY_SUB_COUNT + (shift - 1) * LATENCY_HALF_COUNT + sub;
+	return index < LATENCY_BUCKETS ? index : LATENCY_BUCKETS - 1;
+}
+
+uint64_t LatencyHistogram::BucketValue(int index)
+{
+	if (index < LATENCY_SUB_COUNT)
+		return index;
+
+	int shift = (index - LATENCY_SUB_COUNT) / LATENCY_HALF_COUNT + 1;
+	int sub = (index - LATENCY_SUB_COUNT) % LATENCY_HALF_COUNT;
+	uint64_t lower = (uint64_t)(LATENCY_HALF_COUNT + sub) << shift;
+	return lower + ((uint64_t)1 << shift) / 2;
+}
+
+void LatencyHistogram::Record(uint64_t ns)
+{
+	m_buckets[BucketIndex(ns)].fetch_add(1, std::memory_order_relaxed);
+	m_count.fetch_add(1, std::memory_order_relaxed);
+	m_sum.fetch_add(ns, std::memory_order_relaxed);
+
+	uint64_t min = m_min.load(std::memory_order_relaxed);
+	while (ns < min && !m_min.compare_exchange_weak(min, ns, std::memory_order_relaxed));
+	uint64_t max = m_max.load(std::memory_order_relaxed);
+	while (ns > max && !m_max.compare_exchange_weak(max, ns, std::memory_order_relaxed));
+}
+
+void LatencyHistogram::Reset()
+{
+	for (int i = 0; i < LATENCY_BUCKETS; i++)
+		m_buckets[i].store(0, std::memory_order_relaxed);
+	m_count = 0;
+	m_sum = 0;
+	m_min = UINT64_MAX;
+	m_max = 0;
+}
+
+void LatencyHistogram::ClearSnapshot(LATENCY_SNAPSHOT& snapshot)
+{
+	memset(&snapshot, 0, sizeof(snapshot));
+	snapshot.min = UINT64_MAX;
+}
+
+void LatencyHistogram::AddTo(LATENCY_SNAPSHOT& snapshot) const
+{
+	for (int i = 0; i < LATENCY_BUCKETS; i++)
+		snapshot.buckets[i] += m_buckets[i].load(std::memory_order_relaxed);
+	snapshot.count += m_count.load(std::memory_order_relaxed);
+	snapshot.sum += m_sum.load(std::memory_order_relaxed);
+
+	uint64_t min = m_min.load(std::memory_order_relaxed);
+	uint64_t max = m_max.load(std::memory_order_relaxed);
+	if (min < snapshot.min) snapshot.min = min;
+	if (max > snapshot.max) snapshot.max = max;
+}
+
+void LatencyHistogram::Summarize(const LATENCY_SNAPSHOT& snapshot, GLOVE_LATENCY_HISTOGRAM* histogram)
+{
+	memset(histogram, 0, sizeof(*histogram));
+	if (!snapshot.count)
+		return;
+
+	histogram->count = snapshot.count;
+	histogram->min_ns = snapshot.min;
+	histogram->max_ns = snapshot.max;
+	histogram->mean_ns = snapshot.sum / snapshot.count;
+
+	const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+	uint64_t* percentiles[] = { &histogram->p50_ns, &histogram->p90_ns, &histogram->p99_ns, &histogram->p999_ns };
+
+	// The buckets are counted while they're being recorded to,
+	// so the total is taken from the buckets themselves
+	uint64_t total = 0;
+	for (int i = 0; i < LATENCY_BUCKETS; i++)
+		total += snapshot.buckets[i];
+
+	uint64_t seen = 0;
+	int q = 0;
+	for (int i = 0; i < LATENCY_BUCKETS && q < 4; i++) {
+		seen += snapshot.buckets[i];
+		while (q < 4 && seen > 0 && seen >= quantiles[q] * total) {
+			uint64_t value = BucketValue(i);
+			if (value < snapshot.min) value = snapshot.min;
+			if (value > snapshot.max) value = snapshot.max;
+			*percentiles[q++] = value;
+		}
+	}
+}
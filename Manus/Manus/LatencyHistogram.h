@@ -0,0 +1,64 @@
+/*
+   Copyright 2015 Manus VR
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include "Manus.h"
+
+#include <stdint.h>
+#include <atomic>
+
+// Values below 2^LATENCY_SUB_BITS ns get their own bucket, above that every
+// power of two is split in 2^(LATENCY_SUB_BITS - 1) buckets (6% precision)
+#define LATENCY_SUB_BITS 5
+// Enough buckets for latencies up to an hour
+#define LATENCY_BUCKETS 640
+
+typedef struct {
+	uint64_t buckets[LATENCY_BUCKETS];
+	uint64_t count;
+	uint64_t sum;
+	uint64_t min;
+	uint64_t max;
+} LATENCY_SNAPSHOT;
+
+// Log-linear latency histogram in the style of HdrHistogram.
+// Recording is a few relaxed atomic operations so any thread can record
+// without locks, reading sums the buckets into a snapshot.
+class LatencyHistogram
+{
+private:
+	std::atomic<uint32_t> m_buckets[LATENCY_BUCKETS];
+	std::atomic<uint64_t> m_count;
+	std::atomic<uint64_t> m_sum;
+	std::atomic<uint64_t> m_min;
+	std::atomic<uint64_t> m_max;
+
+public:
+	LatencyHistogram() { Reset(); }
+
+	void Record(uint64_t ns);
+	void Reset();
+
+	/*! \brief Add the recorded values to a snapshot, snapshots of several histograms can be combined. */
+	void AddTo(LATENCY_SNAPSHOT& snapshot) const;
+
+	static void ClearSnapshot(LATENCY_SNAPSHOT& snapshot);
+	static void Summarize(const LATENCY_SNAPSHOT& snapshot, GLOVE_LATENCY_HISTOGRAM* histogram);
+	static int BucketIndex(uint64_t ns);
+	/*! \brief Get the middle of the range of values counted by a bucket. */
+	static uint64_t BucketValue(int index);
+};
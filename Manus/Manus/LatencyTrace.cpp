@@ -0,0 +1,107 @@
+/*
+   Copyright 2015 Manus VR
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include "stdafx.h"
+#include "LatencyTrace.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <functional>
+#include <thread>
+
+static const char* s_stage_names[GLOVE_LATENCY_STAGES] = {
+	"report", "decode", "publish", "consumer", "skeletal", "lock_wait"
+};
+
+std::atomic<bool> LatencyTrace::s_enabled(false);
+
+LatencyTrace::LatencyTrace()
+	: m_next(0)
+{
+	for (int i = 0; i < TRACE_EVENTS; i++)
+		m_slots[i].sequence.store(0, std::memory_order_relaxed);
+}
+
+void LatencyTrace::Record(GLOVE_LATENCY_STAGE stage, uint8_t device, uint64_t begin, uint64_t end, uint64_t read)
+{
+	uint32_t index = m_next.fetch_add(1, std::memory_order_relaxed);
+	SLOT& slot = m_slots[index & (TRACE_EVENTS - 1)];
+
+	uint64_t words[TRACE_EVENT_WORDS] = { 0 };
+	TRACE_EVENT* event = (TRACE_EVENT*)words;
+	event->begin = begin;
+	event->end = end;
+	event->read = read;
+	event->thread = (uint32_t)std::hash<std::thread::id>()(std::this_thread::get_id());
+	event->stage = (uint8_t)stage;
+	event->device = device;
+
+	slot.sequence.store(0, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	for (size_t i = 0; i < TRACE_EVENT_WORDS; i++)
+		slot.words[i].store(words[i], std::memory_order_relaxed);
+	slot.sequence.store(index + 1, std::memory_order_release);
+}
+
+void LatencyTrace::Collect(std::vector<TRACE_EVENT>& events) const
+{
+	for (int i = 0; i < TRACE_EVENTS; i++) {
+		const SLOT& slot = m_slots[i];
+		uint32_t sequence = slot.sequence.load(std::memory_order_acquire);
+		if (!sequence)
+			continue;
+		uint64_t words[TRACE_EVENT_WORDS];
+		for (size_t w = 0; w < TRACE_EVENT_WORDS; w++)
+			words[w] = slot.words[w].load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (slot.sequence.load(std::memory_order_relaxed) == sequence)
+			events.push_back(*(const TRACE_EVENT*)words);
+	}
+}
+
+bool LatencyTrace::Write(const char* path, std::vector<TRACE_EVENT>& events, std::vector<TRACE_SPAN>& spans)
+{
+	FILE* file = fopen(path, "w");
+	if (!file)
+		return false;
+
+	std::sort(events.begin(), events.end(), [](const TRACE_EVENT& a, const TRACE_EVENT& b) { return a.begin < b.begin; });
+	std::sort(spans.begin(), spans.end(), [](const TRACE_SPAN& a, const TRACE_SPAN& b) { return a.begin < b.begin; });
+	uint64_t base = events.empty() ? 0 : events[0].begin;
+	if (!spans.empty() && (events.empty() || spans[0].begin < base))
+		base = spans[0].begin;
+
+	// Complete ("X") events with microsecond timestamps, one track per thread
+	fprintf(file, "{ \"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+	for (size_t i = 0; i < events.size(); i++) {
+		const TRACE_EVENT& event = events[i];
+		fprintf(file, "  { \"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f, "
+			"\"args\": { \"device\": %u, \"age_us\": %.3f } }%s\n",
+			s_stage_names[event.stage], event.thread, (event.begin - base) / 1000.0, (event.end - event.begin) / 1000.0,
+			event.device, (event.end - event.read) / 1000.0, i + 1 < events.size() || !spans.empty() ? "," : "");
+	}
+	for (size_t i = 0; i < spans.size(); i++) {
+		const TRACE_SPAN& span = spans[i];
+		fprintf(file, "  { \"name\": \"%s\", \"cat\": \"sdk\", \"ph\": \"X\", \"pid\": 1, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f }%s\n",
+			span.name, span.thread, (span.begin - base) / 1000.0, (span.end - span.begin) / 1000.0,
+			i + 1 < spans.size() ? "," : "");
+	}
+	fprintf(file, "] }\n");
+
+	bool ok = !ferror(file);
+	fclose(file);
+	return ok;
+}
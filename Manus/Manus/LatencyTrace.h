@@ -0,0 +1,80 @@
+/*
+   Copyright 2015 Manus VR
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include "Manus.h"
+
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+
+// Number of recent trace events kept, must be a power of two
+#define TRACE_EVENTS 4096
+
+typedef struct {
+	uint64_t begin;
+	uint64_t end;
+	// Time the report the event belongs to was read from the device
+	uint64_t read;
+	uint32_t thread;
+	uint8_t stage;
+	uint8_t device;
+} TRACE_EVENT;
+
+#define TRACE_EVENT_WORDS ((sizeof(TRACE_EVENT) + 7) / 8)
+
+// A span recorded by a trace point, see Trace.h
+typedef struct {
+	uint64_t begin;
+	uint64_t end;
+	// Static string, only the pointer is stored
+	const char* name;
+	uint32_t thread;
+} TRACE_SPAN;
+
+#define TRACE_SPAN_WORDS ((sizeof(TRACE_SPAN) + 7) / 8)
+
+// Ring of the most recent trace events, written by any thread without locks.
+// Every slot carries a sequence number that is cleared while the slot is
+// being written, so a reader can tell a complete event from a torn one.
+// The event is stored in atomic words so concurrent access is well defined.
+class LatencyTrace
+{
+private:
+	typedef struct {
+		std::atomic<uint32_t> sequence;
+		std::atomic<uint64_t> words[TRACE_EVENT_WORDS];
+	} SLOT;
+
+	SLOT m_slots[TRACE_EVENTS];
+	std::atomic<uint32_t> m_next;
+
+	static std::atomic<bool> s_enabled;
+
+public:
+	LatencyTrace();
+
+	void Record(GLOVE_LATENCY_STAGE stage, uint8_t device, uint64_t begin, uint64_t end, uint64_t read);
+	void Collect(std::vector<TRACE_EVENT>& events) const;
+
+	static bool IsEnabled() { return s_enabled.load(std::memory_order_relaxed); }
+	static void SetEnabled(bool enabled) { s_enabled = enabled; }
+
+	/*! \brief Write events and the spans of the trace points in the Chrome
+	 *  trace event format, which Perfetto also reads. */
+	static bool Write(const char* path, std::vector<TRACE_EVENT>& events, std::vector<TRACE_SPAN>& spans);
+};
@@ -0,0 +1,381 @@
+/*
+   Copyright 2015 Manus VR
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include "stdafx.h"
+#include "MagCalibration.h"
+#include "FixedMatrix.h"
+
+#include <math.h>
+#include <string.h>
+
+// The fits are based on the 4, 7 and 10 element magnetic calibration of the
+// Freescale sensor fusion library, using the fixed size matrix routines.
+// The samples are centered and scaled to
+// roughly unit length before the normal equations are formed, which keeps
+// the single precision sums well conditioned.
+
+// Center the samples on their mean and scale them to unit radius
+static void Normalize(float samples[][3], int count, float mean[3], float& scale)
+{
+	mean[0] = mean[1] = mean[2] = 0.0f;
+	for (int i = 0; i < count; i++)
+		for (int k = 0; k < 3; k++)
+			mean[k] += samples[i][k];
+	for (int k = 0; k < 3; k++)
+		mean[k] /= count;
+
+	scale = 0.0f;
+	for (int i = 0; i < count; i++) {
+		for (int k = 0; k < 3; k++)
+			samples[i][k] -= mean[k];
+		scale += sqrtf(samples[i][0] * samples[i][0] + samples[i][1] * samples[i][1] + samples[i][2] * samples[i][2]);
+	}
+	scale = (scale > 0.0f) ? scale / count : 1.0f;
+
+	for (int i = 0; i < count; i++)
+		for (int k = 0; k < 3; k++)
+			samples[i][k] /= scale;
+}
+
+// Index of the smallest eigenvalue, its eigenvector is the least squares solution
+static int SmallestEigenvalue(const float eigval[], int n)
+{
+	int j = 0;
+	for (int i = 1; i < n; i++)
+		if (eigval[i] < eigval[j])
+			j = i;
+	return j;
+}
+
+MagCalibration::MagCalibration()
+	: m_running(false), m_fit_requested(false)
+{
+	Reset();
+}
+
+MagCalibration::~MagCalibration()
+{
+	{
+		std::lock_guard<std::mutex> lk(m_samples_mutex);
+		m_running = false;
+	}
+	m_fit_cv.notify_all();
+	if (m_thread.joinable())
+		m_thread.join();
+}
+
+void MagCalibration::Reset()
+{
+	{
+		std::lock_guard<std::mutex> lk(m_samples_mutex);
+		m_count = 0;
+		m_next = 0;
+		m_new_samples = 0;
+	}
+
+	std::lock_guard<std::mutex> lk(m_result_mutex);
+	memset(&m_result, 0, sizeof(m_result));
+	fmatrixAeqI(m_result.inv_w);
+}
+
+void MagCalibration::AddSample(const float sample[3])
+{
+	std::unique_lock<std::mutex> lk(m_samples_mutex, std::try_to_lock);
+	if (!lk.owns_lock())
+		return;
+
+	// Start the worker on the first sample so idle gloves don't cost a thread
+	if (!m_running) {
+		m_running = true;
+		m_thread = std::thread(FitThread, this);
+	}
+
+	// Skip samples that add nothing to the spread of the buffer
+	if (m_count) {
+		const float* last = m_samples[(m_next + MAG_BUFFER_SIZE - 1) % MAG_BUFFER_SIZE];
+		float dx = sample[0] - last[0], dy = sample[1] - last[1], dz = sample[2] - last[2];
+		if (dx * dx + dy * dy + dz * dz < MAG_MIN_SAMPLE_DISTANCE * MAG_MIN_SAMPLE_DISTANCE)
+			return;
+	}
+
+	memcpy(m_samples[m_next], sample, sizeof(m_samples[m_next]));
+	m_next = (m_next + 1) % MAG_BUFFER_SIZE;
+	if (m_count < MAG_BUFFER_SIZE)
+		m_count++;
+
+	if (++m_new_samples >= MAG_FIT_INTERVAL && m_count >= MAG_MIN_SAMPLES_4CAL) {
+		m_new_samples = 0;
+		m_fit_requested = true;
+		m_fit_cv.notify_one();
+	}
+}
+
+bool MagCalibration::GetResult(RESULT& result)
+{
+	std::lock_guard<std::mutex> lk(m_result_mutex);
+	result = m_result;
+	return m_result.solver != 0;
+}
+
+bool MagCalibration::Correct(float corrected[3], const float sample[3])
+{
+	RESULT result;
+	if (!GetResult(result))
+		return false;
+
+	float v[3];
+	for (int k = 0; k < 3; k++)
+		v[k] = sample[k] - result.offset[k];
+	for (int i = 0; i < 3; i++)
+		corrected[i] = result.inv_w[i][0] * v[0] + result.inv_w[i][1] * v[1] + result.inv_w[i][2] * v[2];
+	return true;
+}
+
+void MagCalibration::FitThread(MagCalibration* cal)
+{
+	float (*samples)[3] = cal->m_fit_samples;
+
+	std::unique_lock<std::mutex> lk(cal->m_samples_mutex);
+	while (cal->m_running)
+	{
+		cal->m_fit_cv.wait(lk, [cal] { return cal->m_fit_requested || !cal->m_running; });
+		if (!cal->m_running)
+			break;
+		cal->m_fit_requested = false;
+
+		// Work on a copy so the device thread can keep adding samples
+		int count = cal->m_count;
+		memcpy(samples, cal->m_samples, count * sizeof(samples[0]));
+		lk.unlock();
+
+		RESULT result;
+		bool valid;
+		if (count >= MAG_MIN_SAMPLES_10CAL)
+			valid = cal->Fit10(samples, count, result);
+		else if (count >= MAG_MIN_SAMPLES_7CAL)
+			valid = cal->Fit7(samples, count, result);
+		else
+			valid = cal->Fit4(samples, count, result);
+
+		// Accept the new calibration if it's plausible and better than the current one
+		if (valid && result.field >= MAG_MIN_FIELD && result.field <= MAG_MAX_FIELD) {
+			std::lock_guard<std::mutex> result_lk(cal->m_result_mutex);
+			if (!cal->m_result.solver || result.solver > cal->m_result.solver ||
+				result.fit_error <= cal->m_result.fit_error)
+				cal->m_result = result;
+		}
+
+		lk.lock();
+	}
+}
+
+float MagCalibration::FitError(float samples[][3], int count, const RESULT& result)
+{
+	// Relative deviation of the corrected samples from a sphere with radius field
+	float sum = 0.0f;
+	float field2 = result.field * result.field;
+	for (int i = 0; i < count; i++) {
+		float v[3], c[3];
+		for (int k = 0; k < 3; k++)
+			v[k] = samples[i][k] - result.offset[k];
+		for (int k = 0; k < 3; k++)
+			c[k] = result.inv_w[k][0] * v[0] + result.inv_w[k][1] * v[1] + result.inv_w[k][2] * v[2];
+		float err = c[0] * c[0] + c[1] * c[1] + c[2] * c[2] - field2;
+		sum += err * err;
+	}
+	return 100.0f * sqrtf(sum / count) / (2.0f * field2);
+}
+
+// Hard iron only: fit a sphere |B - V|^2 = field^2 by linear least squares
+bool MagCalibration::Fit4(float samples[][3], int count, RESULT& result)
+{
+	float raw[MAG_BUFFER_SIZE][3];
+	memcpy(raw, samples, count * sizeof(raw[0]));
+
+	float mean[3], scale;
+	Normalize(samples, count, mean, scale);
+
+	float mat[4][4] = { { 0 } }, vec[4] = { 0 };
+	for (int i = 0; i < count; i++) {
+		float x[4] = { samples[i][0], samples[i][1], samples[i][2], 1.0f };
+		float y = x[0] * x[0] + x[1] * x[1] + x[2] * x[2];
+		for (int r = 0; r < 4; r++) {
+			vec[r] += x[r] * y;
+			for (int c = 0; c < 4; c++)
+				mat[r][c] += x[r] * x[c];
+		}
+	}
+
+	if (!fmatrixAeqInvA(mat))
+		return false;
+
+	float beta[4];
+	fmatrixAxV(beta, mat, vec);
+
+	float field2 = beta[3];
+	for (int k = 0; k < 3; k++) {
+		float v = 0.5f * beta[k];
+		field2 += v * v;
+		result.offset[k] = v * scale + mean[k];
+	}
+	if (field2 <= 0.0f)
+		return false;
+
+	fmatrixAeqI(result.inv_w);
+	result.field = sqrtf(field2) * scale;
+	result.solver = 4;
+	result.fit_error = FitError(raw, count, result);
+	return true;
+}
+
+// Hard iron and soft iron along the sensor axes: fit an axis aligned ellipsoid
+bool MagCalibration::Fit7(float samples[][3], int count, RESULT& result)
+{
+	float raw[MAG_BUFFER_SIZE][3];
+	memcpy(raw, samples, count * sizeof(raw[0]));
+
+	float mean[3], scale;
+	Normalize(samples, count, mean, scale);
+
+	float mat[7][7] = { { 0 } }, eigval[7], eigvec[7][7];
+	for (int i = 0; i < count; i++) {
+		float x = samples[i][0], y = samples[i][1], z = samples[i][2];
+		float row[7] = { x * x, y * y, z * z, x, y, z, 1.0f };
+		for (int r = 0; r < 7; r++)
+			for (int c = r; c < 7; c++)
+				mat[r][c] += row[r] * row[c];
+	}
+	for (int r = 0; r < 7; r++)
+		for (int c = 0; c < r; c++)
+			mat[r][c] = mat[c][r];
+
+	eigencompute(mat, eigval, eigvec);
+	int j = SmallestEigenvalue(eigval, 7);
+
+	float p[7];
+	for (int r = 0; r < 7; r++)
+		p[r] = eigvec[r][j];
+	// The solution is only defined up to sign, the quadratic terms must be positive
+	if (p[0] + p[1] + p[2] < 0.0f)
+		for (int r = 0; r < 7; r++)
+			p[r] = -p[r];
+	if (p[0] <= 0.0f || p[1] <= 0.0f || p[2] <= 0.0f)
+		return false;
+
+	float k = -p[6];
+	float v[3];
+	for (int i = 0; i < 3; i++) {
+		v[i] = -p[3 + i] / (2.0f * p[i]);
+		k += p[i] * v[i] * v[i];
+	}
+	if (k <= 0.0f)
+		return false;
+
+	// Normalize the soft iron matrix to unit determinant
+	float det_root = powf(p[0] * p[1] * p[2], 1.0f / 6.0f);
+	fmatrixAeqScalar(result.inv_w, 0.0f);
+	for (int i = 0; i < 3; i++) {
+		result.inv_w[i][i] = sqrtf(p[i]) / det_root;
+		result.offset[i] = v[i] * scale + mean[i];
+	}
+	result.field = sqrtf(k) / det_root * scale;
+	result.solver = 7;
+	result.fit_error = FitError(raw, count, result);
+	return true;
+}
+
+// Hard iron and full soft iron: fit a general ellipsoid
+bool MagCalibration::Fit10(float samples[][3], int count, RESULT& result)
+{
+	float raw[MAG_BUFFER_SIZE][3];
+	memcpy(raw, samples, count * sizeof(raw[0]));
+
+	float mean[3], scale;
+	Normalize(samples, count, mean, scale);
+
+	float mat[10][10] = { { 0 } }, eigval[10], eigvec[10][10];
+	for (int i = 0; i < count; i++) {
+		float x = samples[i][0], y = samples[i][1], z = samples[i][2];
+		float row[10] = { x * x, 2.0f * x * y, 2.0f * x * z, y * y, 2.0f * y * z, z * z, x, y, z, 1.0f };
+		for (int r = 0; r < 10; r++)
+			for (int c = r; c < 10; c++)
+				mat[r][c] += row[r] * row[c];
+	}
+	for (int r = 0; r < 10; r++)
+		for (int c = 0; c < r; c++)
+			mat[r][c] = mat[c][r];
+
+	eigencompute(mat, eigval, eigvec);
+	int j = SmallestEigenvalue(eigval, 10);
+
+	float p[10];
+	for (int r = 0; r < 10; r++)
+		p[r] = eigvec[r][j];
+
+	float a[3][3] = {
+		{ p[0], p[1], p[2] },
+		{ p[1], p[3], p[4] },
+		{ p[2], p[4], p[5] } };
+	float det = fmatrixDetA(a);
+	// The solution is only defined up to sign, the ellipsoid matrix must be positive definite
+	if (det < 0.0f) {
+		fmatrixAeqMinusA(a);
+		for (int r = 0; r < 10; r++)
+			p[r] = -p[r];
+		det = -det;
+	}
+	if (det <= 0.0f)
+		return false;
+
+	// Center of the ellipsoid: V = -1/2 * A^-1 * b
+	float inv_a[3][3];
+	fmatrixAeqInvSymB(inv_a, a);
+	float v[3];
+	for (int i = 0; i < 3; i++)
+		v[i] = -0.5f * (inv_a[i][0] * p[6] + inv_a[i][1] * p[7] + inv_a[i][2] * p[8]);
+
+	float k = -p[9];
+	for (int r = 0; r < 3; r++)
+		for (int c = 0; c < 3; c++)
+			k += v[r] * a[r][c] * v[c];
+	if (k <= 0.0f)
+		return false;
+
+	// Normalize to unit determinant and take the matrix square root of A
+	float det_root = powf(det, 1.0f / 3.0f);
+	float norm_a[3][3], norm_eigval[3], norm_eigvec[3][3];
+	for (int r = 0; r < 3; r++)
+		for (int c = 0; c < 3; c++)
+			norm_a[r][c] = a[r][c] / det_root;
+	eigencompute(norm_a, norm_eigval, norm_eigvec);
+	for (int i = 0; i < 3; i++)
+		if (norm_eigval[i] <= 0.0f)
+			return false;
+
+	for (int r = 0; r < 3; r++) {
+		for (int c = 0; c < 3; c++) {
+			float sum = 0.0f;
+			for (int m = 0; m < 3; m++)
+				sum += norm_eigvec[r][m] * sqrtf(norm_eigval[m]) * norm_eigvec[c][m];
+			result.inv_w[r][c] = sum;
+		}
+		result.offset[r] = v[r] * scale + mean[r];
+	}
+	result.field = sqrtf(k / det_root) * scale;
+	result.solver = 10;
+	result.fit_error = FitError(raw, count, result);
+	return true;
+}
@@ -0,0 +1,99 @@
+/*
+   Copyright 2015 Manus VR
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include "Manus.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Number of compass samples kept for the ellipsoid fit
+#define MAG_BUFFER_SIZE 240
+// Minimum number of samples for each of the fit algorithms
+#define MAG_MIN_SAMPLES_4CAL 40
+#define MAG_MIN_SAMPLES_7CAL 100
+#define MAG_MIN_SAMPLES_10CAL 150
+// Number of new samples before the fit is run again
+#define MAG_FIT_INTERVAL 20
+// Minimum distance in uT between two buffered samples
+#define MAG_MIN_SAMPLE_DISTANCE 1.0f
+// Plausible range of the geomagnetic field strength in uT
+#define MAG_MIN_FIELD 22.0f
+#define MAG_MAX_FIELD 67.0f
+
+// Hard and soft iron calibration of the magnetometer.
+// Samples are collected from the device thread, the fits run on a
+// worker thread so the device thread never waits for the calibration.
+class MagCalibration
+{
+public:
+	typedef struct {
+		// Hard iron offset in uT
+		float offset[3];
+		// Inverse soft iron matrix
+		float inv_w[3][3];
+		// Geomagnetic field strength in uT
+		float field;
+		// Fit error in percent
+		float fit_error;
+		// Number of parameters of the fit (4, 7 or 10), 0 if not calibrated
+		int solver;
+	} RESULT;
+
+private:
+	float m_samples[MAG_BUFFER_SIZE][3];
+	float m_fit_samples[MAG_BUFFER_SIZE][3];
+	int m_count;
+	int m_next;
+	int m_new_samples;
+
+	RESULT m_result;
+
+	bool m_running;
+	bool m_fit_requested;
+	std::thread m_thread;
+	std::mutex m_samples_mutex;
+	std::mutex m_result_mutex;
+	std::condition_variable m_fit_cv;
+
+	static void FitThread(MagCalibration* cal);
+
+	// The fits work on a private copy of the buffer
+	bool Fit4(float samples[][3], int count, RESULT& result);
+	bool Fit7(float samples[][3], int count, RESULT& result);
+	bool Fit10(float samples[][3], int count, RESULT& result);
+	float FitError(float samples[][3], int count, const RESULT& result);
+
+public:
+	MagCalibration();
+	~MagCalibration();
+
+	void Reset();
+
+	/*! \brief Add a compass sample in uT.
+	*
+	*  Never blocks, the sample is dropped if the worker is busy copying the buffer.
+	*/
+	void AddSample(const float sample[3]);
+
+	/*! \brief Get the latest accepted calibration. */
+	bool GetResult(RESULT& result);
+
+	/*! \brief Apply the calibration to a raw sample in uT. */
+	bool Correct(float corrected[3], const float sample[3]);
+};
@@ -17,51 +17,344 @@
 #include "stdafx.h"
 #include "Manus.h"
 #include "Device.h"
+#ifndef MANUS_NO_SKELETAL
 #include "SkeletalModel.h"
+#endif
 #include "DeviceManager.h"
+#include "ReplayBackend.h"
+#include "SimBackend.h"
+#include "PoseCodec.h"
+#include "SharedMemory.h"
+#include "Stream.h"
+#include "OutputBuffer.h"
+#include "HapticScheduler.h"
+#include "Metrics.h"
+#include "Trace.h"
+#ifndef MANUS_HIDRAW
 #include <hidapi.h>
+#endif
+#include <stdlib.h>
+#include <string.h>
 #include <vector>
 #include <mutex>
+#include <string>
 
 bool g_initialized = false;
 
-std::vector<Device*> g_devices;
+DeviceList g_devices;
 std::mutex g_gloves_mutex;
 
 DeviceManager *g_device_manager;
+#ifndef MANUS_NO_SKELETAL
 SkeletalModel g_skeletal;
+#endif
+
+// Capture to replay instead of the connected devices, see ManusSetReplay()
+std::string g_replay_path;
+float g_replay_speed = 1.0f;
+
+// Server to read the gloves from instead of the connected devices, see ManusSetClient()
+bool g_client_set = false;
+std::string g_client_name;
+SharedClient* g_client;
+
+// Machine to receive the gloves from instead of the connected devices, see ManusSetStreamReceiver()
+std::string g_receiver_address;
+unsigned short g_receiver_port = 0;
+StreamReceiver* g_receiver;
+
+static int InitReplay(const char* path, float speed)
+{
+	std::vector<uint16_t> sources;
+	if (!ReplayBackend::GetSources(path, sources))
+		return MANUS_ERROR;
+
+	// One device per dongle that was captured, there's nothing to enumerate
+	std::lock_guard<std::mutex> lock(g_gloves_mutex);
+	for (uint16_t source : sources) {
+		std::string device_path = "replay:" + std::to_string(source);
+		Device* device = new Device(device_path.c_str(), new ReplayBackend(path, source, speed));
+		if (!g_devices.push_back(device)) {
+			delete device;
+			break;
+		}
+	}
+	return MANUS_SUCCESS;
+}
 
 
 int ManusInit()
 {
+	MANUS_TRACE_FUNCTION();
 	if (g_initialized)
 		return MANUS_ERROR;
 
+	Device::EnableWaits(true);
+
+	// A client doesn't touch the devices, the server process owns them
+	bool use_client = g_client_set;
+	std::string client_name = g_client_name;
+	if (!g_client_set && getenv("MANUS_CLIENT")) {
+		use_client = true;
+		client_name = getenv("MANUS_CLIENT");
+	}
+	if (use_client) {
+		g_client = new SharedClient();
+		if (!g_client->Open(client_name.empty() ? NULL : client_name.c_str())) {
+			delete g_client;
+			g_client = NULL;
+			return MANUS_ERROR;
+		}
+		g_device_manager = NULL;
+		g_initialized = true;
+		return MANUS_SUCCESS;
+	}
+
+#ifndef MANUS_HIDRAW
 	if (hid_init() != 0)
 		return MANUS_ERROR;
+#endif
 
+#ifndef MANUS_NO_SKELETAL
 	if (!g_skeletal.InitializeScene())
 		return MANUS_ERROR;
+#endif
+
+	// The streamed samples are turned into skeletal models locally
+	std::string receiver_address = g_receiver_address;
+	unsigned short receiver_port = g_receiver_port;
+	if (receiver_address.empty() && getenv("MANUS_STREAM")) {
+		std::string stream = getenv("MANUS_STREAM");
+		size_t colon = stream.rfind(':');
+		if (colon != std::string::npos) {
+			receiver_address = stream.substr(0, colon);
+			receiver_port = (unsigned short)atoi(stream.c_str() + colon + 1);
+		}
+	}
+	if (!receiver_address.empty()) {
+		g_receiver = new StreamReceiver();
+		if (!g_receiver->Open(receiver_address.c_str(), receiver_port)) {
+			delete g_receiver;
+			g_receiver = NULL;
+			return MANUS_ERROR;
+		}
+		g_device_manager = NULL;
+		g_initialized = true;
+		return MANUS_SUCCESS;
+	}
 
-	g_device_manager = new DeviceManager();
+	// Profiles are looked up by the device threads, so load them up front
+	FingerCalibration::LoadProfiles();
+
+	Device::SetDecodeFields(GLOVE_DECODE_ALL);
+
+	// The environment selects a replay when the application didn't
+	std::string replay_path = g_replay_path;
+	float replay_speed = g_replay_speed;
+	if (replay_path.empty() && getenv("MANUS_REPLAY")) {
+		replay_path = getenv("MANUS_REPLAY");
+		const char* speed = getenv("MANUS_REPLAY_SPEED");
+		replay_speed = speed ? (float)atof(speed) : 1.0f;
+	}
+
+	GLOVE_SIM_CONFIG sim;
+	if (!SimBackend::GetConfig(sim) && getenv("MANUS_SIM_DONGLES")) {
+		memset(&sim, 0, sizeof(sim));
+		sim.dongles = atoi(getenv("MANUS_SIM_DONGLES"));
+		sim.gloves = getenv("MANUS_SIM_GLOVES") ? atoi(getenv("MANUS_SIM_GLOVES")) : 2;
+		sim.rate = getenv("MANUS_SIM_RATE") ? (float)atof(getenv("MANUS_SIM_RATE")) : 100.0f;
+		sim.motion = GLOVE_SIM_WAVE;
+		sim.motion_frequency = 0.5f;
+		sim.seed = 1;
+		if (ManusSetSimulation(&sim) != MANUS_SUCCESS)
+			return MANUS_ERROR;
+	}
+
+	// Dongles pulled out in the previous session are back
+	SimBackend::PlugAll();
+
+	if (!replay_path.empty()) {
+		if (InitReplay(replay_path.c_str(), replay_speed) != MANUS_SUCCESS)
+			return MANUS_ERROR;
+		g_device_manager = NULL;
+	} else {
+		g_device_manager = new DeviceManager();
+	}
 	g_initialized = true;
 
 	return MANUS_SUCCESS;
 }
 
+int ManusSetReplay(const char* path, float speed)
+{
+	MANUS_TRACE_FUNCTION();
+	if (g_initialized)
+		return MANUS_ERROR;
+
+	if (speed < 0.0f)
+		return MANUS_INVALID_ARGUMENT;
+
+	g_replay_path = path ? path : "";
+	g_replay_speed = speed;
+	return MANUS_SUCCESS;
+}
+
+int ManusSetClient(const char* name)
+{
+	MANUS_TRACE_FUNCTION();
+	if (g_initialized)
+		return MANUS_ERROR;
+
+	g_client_set = name != NULL;
+	g_client_name = name ? name : "";
+	return MANUS_SUCCESS;
+}
+
+int ManusStartServer(const char* name)
+{
+	MANUS_TRACE_FUNCTION();
+	if (!g_initialized || g_client)
+		return MANUS_ERROR;
+
+	return SharedServer::Start(name) ? MANUS_SUCCESS : MANUS_ERROR;
+}
+
+int ManusStopServer()
+{
+	MANUS_TRACE_FUNCTION();
+	if (!g_initialized || !SharedServer::IsRunning())
+		return MANUS_ERROR;
+
+	SharedServer::Stop();
+	return MANUS_SUCCESS;
+}
+
+int ManusSetStreamReceiver(const char* address, unsigned short port)
+{
+	MANUS_TRACE_FUNCTION();
+	if (g_initialized)
+		return MANUS_ERROR;
+
+	if (address && !port)
+		return MANUS_INVALID_ARGUMENT;
+
+	g_receiver_address = address ? address : "";
+	g_receiver_port = port;
+	return MANUS_SUCCESS;
+}
+
+int ManusStartStream(const GLOVE_STREAM_CONFIG* config)
+{
+	MANUS_TRACE_FUNCTION();
+	if (!g_initialized || g_client || g_receiver)
+		return MANUS_ERROR;
+
+	if (!config || !config->address || !config->port || !config->content ||
+		(config->content & ~(GLOVE_STREAM_DATA | GLOVE_STREAM_RAW)))
+		return MANUS_INVALID_ARGUMENT;
+
+	return StreamSender::Start(*config) ? MANUS_SUCCESS : MANUS_ERROR;
+}
+
+int ManusStopStream()
+{
+	MANUS_TRACE_FUNCTION();
+	if (!g_initialized || !StreamSender::IsStreaming())
+		return MANUS_ERROR;
+
+	StreamSender::Stop();
+	return MANUS_SUCCESS;
+}
+
+int ManusGetStreamStats(uint64_t* datagrams, uint64_t* samples, uint64_t* lost)
+{
+	MANUS_TRACE_FUNCTION();
+	if (!g_initialized)
+		return MANUS_ERROR;
+
+	if (!datagrams || !samples || !lost)
+		return MANUS_INVALID_ARGUMENT;
+
+	if (g_receiver)
+		g_receiver->GetStats(*datagrams, *samples, *lost);
+	else
+		StreamSender::GetStats(*datagrams, *samples, *lost);
+	return MANUS_SUCCESS;
+}
+
+int ManusSetSimulation(const GLOVE_SIM_CONFIG* config)
+{
+	MANUS_TRACE_FUNCTION();
+	if (g_initialized)
+		return MANUS_ERROR;
+
+	if (config && (config->dongles < 1 || config->dongles > SIM_MAX_DONGLES || config->dongles > MANUS_MAX_DEVICES || config->gloves < 1 || config->gloves > DEVICE_TYPE_COUNT ||
+		config->rate <= 0.0f || config->rate > 10000.0f || config->loss < 0.0f || config->loss > 1.0f ||
+		config->jitter_us < 0.0f || (config->motion == GLOVE_SIM_SCRIPT && !config->callback)))
+		return MANUS_INVALID_ARGUMENT;
+
+	SimBackend::Configure(config);
+	return MANUS_SUCCESS;
+}
+
+int ManusSetSimulatedDongle(unsigned int dongle, bool plugged)
+{
+	MANUS_TRACE_FUNCTION();
+	if (!g_initialized)
+		return MANUS_ERROR;
+
+	GLOVE_SIM_CONFIG config;
+	if (!SimBackend::GetConfig(config))
+		return MANUS_ERROR;
+
+	if (dongle >= config.dongles || dongle >= SIM_MAX_DONGLES)
+		return MANUS_INVALID_ARGUMENT;
+
+	SimBackend::SetPlugged(dongle, plugged);
+
+	// Pick up the dongle without waiting for the next scan
+	if (plugged && g_device_manager)
+		g_device_manager->Rescan();
+	return MANUS_SUCCESS;
+}
+
 int ManusExit()
 {
+	MANUS_TRACE_FUNCTION();
 	if (!g_initialized)
 		return MANUS_ERROR;
 
+	// Threads in ManusWaitAny return before the devices go away
+	Device::EnableWaits(false);
+	Recorder::Stop();
+	SharedServer::Stop();
+	StreamSender::Stop();
+	OutputBuffer::Bind(GLOVE_LEFT, NULL, GLOVE_OUTPUT_DATA);
+	OutputBuffer::Bind(GLOVE_RIGHT, NULL, GLOVE_OUTPUT_DATA);
+	HapticScheduler::Stop();
+
+	if (g_receiver) {
+		g_receiver->Close();
+		delete g_receiver;
+		g_receiver = NULL;
+	}
+
+	if (g_client) {
+		g_client->Close();
+		delete g_client;
+		g_client = NULL;
+	}
+
+	// Stop scanning first, a scan in progress needs the device lock
+	delete g_device_manager;
+	g_device_manager = NULL;
+
 	std::lock_guard<std::mutex> lock(g_gloves_mutex);
 
 	for (Device* device : g_devices)
 		delete device;
 	g_devices.clear();
 
-	delete g_device_manager;
-
 	g_initialized = false;
 
 	return MANUS_SUCCESS;
@@ -69,9 +362,15 @@ int ManusExit()
 
 int ManusGetData(GLOVE_HAND hand, GLOVE_DATA* data, unsigned int timeout)
 {
+	MANUS_TRACE_FUNCTION();
 	if (!g_initialized)
 		return MANUS_ERROR;
 
+	if (g_client)
+		return g_client->GetData(hand, data, timeout);
+	if (g_receiver)
+		return g_receiver->GetData(hand, data, timeout);
+
 	device_type_t dev = (hand == GLOVE_LEFT) ? DEV_GLOVE_LEFT : DEV_GLOVE_RIGHT;
 	for (Device* device : g_devices) {
 		if (device->GetData(data, dev, timeout)) {
@@ -82,31 +381,614 @@ int ManusGetData(GLOVE_HAND hand, GLOVE_DATA* data, unsigned int timeout)
 
 }
 
+int ManusGetDataAfter(GLOVE_HAND hand, uint64_t after_seq, GLOVE_DATA* data, uint64_t* seq, unsigned int timeout)
+{
+	MANUS_TRACE_FUNCTION();
+	if (!g_initialized)
+		return MANUS_ERROR;
+
+	if (!data || !seq)
+		return MANUS_INVALID_ARGUMENT;
+
+	// The server publishes through shared memory, nothing signals this process
+	if (g_client)
+		return MANUS_ERROR;
+	if (g_receiver)
+		return g_receiver->GetDataAfter(hand, after_seq, data, seq, timeout);
+
+	device_type_t dev = (hand == GLOVE_LEFT) ? DEV_GLOVE_LEFT : DEV_GLOVE_RIGHT;
+	for (Device* device : g_devices) {
+		if (device->IsConnected(dev))
+			return device->GetDataAfter(data, dev, after_seq, seq, timeout);
+	}
+	return MANUS_DISCONNECTED;
+}
+
+int ManusGetPredictedData(GLOVE_HAND hand, uint64_t target_time_ns, GLOVE_DATA* data)
+{
+	MANUS_TRACE_FUNCTION();
+	if (!g_initialized)
+		return MANUS_ERROR;
+
+	if (!data)
+		return MANUS_INVALID_ARGUMENT;
+
+	// The motion history is kept in the server process
+	if (g_client)
+		return MANUS_ERROR;
+
+	device_type_t dev = (hand == GLOVE_LEFT) ? DEV_GLOVE_LEFT : DEV_GLOVE_RIGHT;
+	for (Device* device : g_devices) {
+		if (device->GetPredictedData(data, dev, target_time_ns)) {
+			return MANUS_SUCCESS;
+		}
+	}
+	return MANUS_DISCONNECTED;
+}
+
+uint64_t ManusGetTimestamp()
+{
+	return DeviceTimestamp();
+}
+
 int ManusGetSkeletal(GLOVE_HAND hand, GLOVE_SKELETAL* model, unsigned int timeout)
 {
-	GLOVE_DATA data;
+	MANUS_TRACE_FUNCTION();
+	if (!g_initialized)
+		return MANUS_ERROR;
+
+	if (g_client)
+		return g_client->GetSkeletal(hand, model, timeout);
 
-	int ret = ManusGetData(hand, &data, timeout);
-	if (ret != MANUS_SUCCESS)
-		return ret;
+#ifdef MANUS_NO_SKELETAL
+	// Built without the FBX SDK
+	return MANUS_ERROR;
+#else
+	if (g_receiver) {
+		GLOVE_DATA data;
+		int ret = g_receiver->GetData(hand, &data, timeout);
+		if (ret != MANUS_SUCCESS)
+			return ret;
+		return g_skeletal.Simulate(data, model, hand) ? MANUS_SUCCESS : MANUS_ERROR;
+	}
 
-	if (g_skeletal.Simulate(data, model, hand))
+	uint64_t begin = DeviceTimestamp();
+	device_type_t dev = (hand == GLOVE_LEFT) ? DEV_GLOVE_LEFT : DEV_GLOVE_RIGHT;
+	for (Device* device : g_devices) {
+		GLOVE_DATA data;
+		uint64_t read_time;
+		if (!device->GetData(&data, dev, timeout, &read_time))
+			continue;
+
+		if (!g_skeletal.Simulate(data, model, hand))
+			return MANUS_ERROR;
+
+		device->RecordLatency(GLOVE_LATENCY_SKELETAL, dev, read_time, begin);
 		return MANUS_SUCCESS;
-	else
+	}
+	return MANUS_DISCONNECTED;
+#endif
+}
+
+int ManusWaitAny(uint32_t hand_mask, uint32_t last_seen[2], unsigned int timeout, GLOVE_HAND* which)
+{
+	MANUS_TRACE_FUNCTION();
+	if (!g_initialized)
 		return MANUS_ERROR;
+
+	if (!last_seen || !which || !hand_mask || (hand_mask & ~(GLOVE_MASK_LEFT | GLOVE_MASK_RIGHT)))
+		return MANUS_INVALID_ARGUMENT;
+
+	// The server publishes through shared memory, nothing signals this process
+	if (g_client)
+		return MANUS_ERROR;
+
+	bool connected = false;
+	for (int hand = 0; hand < 2; hand++)
+		connected |= (hand_mask & (1 << hand)) && ManusIsConnected((GLOVE_HAND)hand);
+	if (!connected)
+		return MANUS_DISCONNECTED;
+
+	return Device::WaitAny(hand_mask, last_seen, timeout, *which);
+}
+
+// Managed callers mirror this layout field by field
+static_assert(sizeof(GLOVE_FRAME) == 3 * sizeof(int32_t) + sizeof(GLOVE_DATA) + sizeof(GLOVE_SKELETAL), "GLOVE_FRAME must not be padded");
+
+int ManusGetFrames(GLOVE_FRAME* frames, unsigned int count, bool skeletal, unsigned int timeout)
+{
+	MANUS_TRACE_FUNCTION();
+	if (!g_initialized)
+		return MANUS_ERROR;
+
+	if (!frames)
+		return MANUS_INVALID_ARGUMENT;
+
+	for (unsigned int i = 0; i < count; i++) {
+		GLOVE_FRAME& frame = frames[i];
+		if (frame.hand != GLOVE_LEFT && frame.hand != GLOVE_RIGHT) {
+			frame.data_result = frame.skeletal_result = MANUS_INVALID_ARGUMENT;
+			continue;
+		}
+		GLOVE_HAND hand = (GLOVE_HAND)frame.hand;
+
+		// Only the first hand waits, the others are read right after it
+		frame.data_result = ManusGetData(hand, &frame.data, i == 0 ? timeout : 0);
+
+		if (!skeletal) {
+			frame.skeletal_result = MANUS_NO_DATA;
+		} else if (g_client) {
+			frame.skeletal_result = g_client->GetSkeletal(hand, &frame.skeletal, 0);
+		} else {
+#ifdef MANUS_NO_SKELETAL
+			frame.skeletal_result = MANUS_ERROR;
+#else
+			if (frame.data_result != MANUS_SUCCESS)
+				frame.skeletal_result = frame.data_result;
+			else
+				frame.skeletal_result = g_skeletal.Simulate(frame.data, &frame.skeletal, hand) ? MANUS_SUCCESS : MANUS_ERROR;
+#endif
+		}
+	}
+	return MANUS_SUCCESS;
+}
+
+int ManusBindOutputBuffer(GLOVE_HAND hand, void* memory, size_t size, GLOVE_OUTPUT_LAYOUT layout)
+{
+	MANUS_TRACE_FUNCTION();
+	// A client reads shared memory already, there's no thread to write the buffer
+	if (!g_initialized || g_client)
+		return MANUS_ERROR;
+
+	if ((hand != GLOVE_LEFT && hand != GLOVE_RIGHT) || (layout != GLOVE_OUTPUT_DATA && layout != GLOVE_OUTPUT_SKELETAL))
+		return MANUS_INVALID_ARGUMENT;
+
+	if (memory && (size < OutputBuffer::Size(layout) || ((uintptr_t)memory & (sizeof(uint32_t) - 1))))
+		return MANUS_INVALID_ARGUMENT;
+
+#ifdef MANUS_NO_SKELETAL
+	if (layout == GLOVE_OUTPUT_SKELETAL)
+		return MANUS_ERROR;
+#endif
+
+	OutputBuffer::Bind(hand, memory, layout);
+	return MANUS_SUCCESS;
 }
 
 int ManusSetVibration(GLOVE_HAND hand, float power){
+	MANUS_TRACE_FUNCTION();
 	device_type_t dev = (hand == GLOVE_LEFT) ? DEV_GLOVE_LEFT : DEV_GLOVE_RIGHT;
 	for (Device* device : g_devices) {
 		if (!device->IsConnected(dev)) continue;
+		HapticScheduler::Cancel(hand);
 		device->SetVibration(power, dev, 200);
 		return MANUS_SUCCESS;
 	}
 	return MANUS_DISCONNECTED;
 }
 
+int ManusPlayHaptic(GLOVE_HAND hand, const GLOVE_HAPTIC_WAVEFORM* waveform)
+{
+	MANUS_TRACE_FUNCTION();
+	if (hand != GLOVE_LEFT && hand != GLOVE_RIGHT)
+		return MANUS_INVALID_ARGUMENT;
+	if (!waveform)
+		return MANUS_INVALID_ARGUMENT;
+
+	device_type_t dev = (hand == GLOVE_LEFT) ? DEV_GLOVE_LEFT : DEV_GLOVE_RIGHT;
+	for (Device* device : g_devices) {
+		if (!device->IsConnected(dev)) continue;
+		return HapticScheduler::Play(hand, *waveform);
+	}
+	return MANUS_DISCONNECTED;
+}
+
+int ManusStopHaptic(GLOVE_HAND hand)
+{
+	MANUS_TRACE_FUNCTION();
+	if (hand != GLOVE_LEFT && hand != GLOVE_RIGHT)
+		return MANUS_INVALID_ARGUMENT;
+
+	return ManusSetVibration(hand, 0.0f);
+}
+
+int ManusSetWriteBudget(unsigned int writes_per_second)
+{
+	MANUS_TRACE_FUNCTION();
+	Device::SetWriteBudget(writes_per_second);
+	return MANUS_SUCCESS;
+}
+
+int ManusGetWriteStats(GLOVE_WRITE_STATS* stats)
+{
+	MANUS_TRACE_FUNCTION();
+	if (!stats)
+		return MANUS_INVALID_ARGUMENT;
+
+	memset(stats, 0, sizeof(*stats));
+	for (Device* device : g_devices)
+		device->AddWriteStats(*stats);
+	return MANUS_SUCCESS;
+}
+
+int ManusGetMetrics(GLOVE_METRICS* metrics)
+{
+	MANUS_TRACE_FUNCTION();
+	if (!metrics)
+		return MANUS_INVALID_ARGUMENT;
+
+	Metrics::Collect(*metrics);
+	return MANUS_SUCCESS;
+}
+
+int ManusWriteMetrics(const char* target)
+{
+	MANUS_TRACE_FUNCTION();
+	if (!target)
+		return MANUS_INVALID_ARGUMENT;
+
+	return Metrics::Write(target) ? MANUS_SUCCESS : MANUS_ERROR;
+}
+
+int ManusSetFilter(GLOVE_HAND hand, GLOVE_FILTER_CHANNEL channel, const GLOVE_FILTER_PARAMS* params)
+{
+	MANUS_TRACE_FUNCTION();
+	if (hand != GLOVE_LEFT && hand != GLOVE_RIGHT)
+		return MANUS_INVALID_ARGUMENT;
+	if (channel < 0 || channel >= GLOVE_FILTER_CHANNELS)
+		return MANUS_INVALID_ARGUMENT;
+	if (params && (params->min_cutoff <= 0 || params->d_cutoff <= 0 || params->beta < 0))
+		return MANUS_INVALID_ARGUMENT;
+
+	Device::SetFilter(hand, channel, params);
+	return MANUS_SUCCESS;
+}
+
+int ManusAddCompassSample(GLOVE_HAND hand, const int16_t compass[3])
+{
+	MANUS_TRACE_FUNCTION();
+	if (!g_initialized)
+		return MANUS_ERROR;
+
+	if (!compass)
+		return MANUS_INVALID_ARGUMENT;
+
+	device_type_t dev = (hand == GLOVE_LEFT) ? DEV_GLOVE_LEFT : DEV_GLOVE_RIGHT;
+	for (Device* device : g_devices) {
+		if (device->AddCompassSample(compass, dev)) {
+			return MANUS_SUCCESS;
+		}
+	}
+	return MANUS_DISCONNECTED;
+}
+
+int ManusGetHeading(GLOVE_HAND hand, float* heading)
+{
+	MANUS_TRACE_FUNCTION();
+	if (!g_initialized)
+		return MANUS_ERROR;
+
+	if (!heading)
+		return MANUS_INVALID_ARGUMENT;
+
+	// The compass is calibrated in the server process
+	if (g_client)
+		return MANUS_ERROR;
+
+	device_type_t dev = (hand == GLOVE_LEFT) ? DEV_GLOVE_LEFT : DEV_GLOVE_RIGHT;
+	for (Device* device : g_devices) {
+		if (device->GetHeading(*heading, dev)) {
+			return MANUS_SUCCESS;
+		}
+	}
+	return MANUS_DISCONNECTED;
+}
+
+int ManusAddGestureTemplate(const float fingers[5], const GLOVE_QUATERNION* orientation, float threshold, int* gesture)
+{
+	MANUS_TRACE_FUNCTION();
+	if (!fingers || !gesture || threshold <= 0)
+		return MANUS_INVALID_ARGUMENT;
+
+	*gesture = GestureRecognizer::AddTemplate(fingers, orientation, threshold);
+	if (*gesture == GLOVE_GESTURE_NONE)
+		return MANUS_ERROR;
+
+	return MANUS_SUCCESS;
+}
+
+int ManusGetGesture(GLOVE_HAND hand, int* gesture)
+{
+	MANUS_TRACE_FUNCTION();
+	if (!g_initialized)
+		return MANUS_ERROR;
+
+	if (!gesture)
+		return MANUS_INVALID_ARGUMENT;
+
+	// Gestures are classified in the server process
+	if (g_client)
+		return MANUS_ERROR;
+
+	device_type_t dev = (hand == GLOVE_LEFT) ? DEV_GLOVE_LEFT : DEV_GLOVE_RIGHT;
+	for (Device* device : g_devices) {
+		if (device->GetGesture(*gesture, dev)) {
+			return MANUS_SUCCESS;
+		}
+	}
+	return MANUS_DISCONNECTED;
+}
+
+int ManusPollGesture(GLOVE_GESTURE_EVENT* event)
+{
+	MANUS_TRACE_FUNCTION();
+	if (!g_initialized)
+		return MANUS_ERROR;
+
+	if (!event)
+		return MANUS_INVALID_ARGUMENT;
+
+	// The gesture events are queued in the server process
+	if (g_client)
+		return MANUS_ERROR;
+
+	for (Device* device : g_devices) {
+		if (device->PollGesture(*event)) {
+			return MANUS_SUCCESS;
+		}
+	}
+	return MANUS_NO_DATA;
+}
+
+int ManusSetGestureCallback(GLOVE_GESTURE_CALLBACK callback, void* user_data)
+{
+	MANUS_TRACE_FUNCTION();
+	GestureRecognizer::SetCallback(callback, user_data);
+	return MANUS_SUCCESS;
+}
+
+int ManusStartFingerCalibration(GLOVE_HAND hand)
+{
+	MANUS_TRACE_FUNCTION();
+	if (!g_initialized)
+		return MANUS_ERROR;
+
+	device_type_t dev = (hand == GLOVE_LEFT) ? DEV_GLOVE_LEFT : DEV_GLOVE_RIGHT;
+	for (Device* device : g_devices) {
+		if (device->StartFingerCalibration(dev)) {
+			return MANUS_SUCCESS;
+		}
+	}
+	return MANUS_DISCONNECTED;
+}
+
+int ManusStopFingerCalibration(GLOVE_HAND hand, bool save)
+{
+	MANUS_TRACE_FUNCTION();
+	if (!g_initialized)
+		return MANUS_ERROR;
+
+	device_type_t dev = (hand == GLOVE_LEFT) ? DEV_GLOVE_LEFT : DEV_GLOVE_RIGHT;
+	for (Device* device : g_devices) {
+		if (!device->IsConnected(dev)) continue;
+		return device->StopFingerCalibration(dev, save) ? MANUS_SUCCESS : MANUS_ERROR;
+	}
+	return MANUS_DISCONNECTED;
+}
+
+int ManusSetFingerResponse(GLOVE_HAND hand, const float gamma[5])
+{
+	MANUS_TRACE_FUNCTION();
+	if (!g_initialized)
+		return MANUS_ERROR;
+
+	if (!gamma)
+		return MANUS_INVALID_ARGUMENT;
+	for (int i = 0; i < 5; i++)
+		if (gamma[i] <= 0)
+			return MANUS_INVALID_ARGUMENT;
+
+	device_type_t dev = (hand == GLOVE_LEFT) ? DEV_GLOVE_LEFT : DEV_GLOVE_RIGHT;
+	for (Device* device : g_devices) {
+		if (!device->IsConnected(dev)) continue;
+		return device->SetFingerResponse(gamma, dev) ? MANUS_SUCCESS : MANUS_ERROR;
+	}
+	return MANUS_DISCONNECTED;
+}
+
+int ManusGetRawReport(GLOVE_HAND hand, GLOVE_RAW_REPORT* report)
+{
+	MANUS_TRACE_FUNCTION();
+	if (!g_initialized)
+		return MANUS_ERROR;
+
+	if (!report)
+		return MANUS_INVALID_ARGUMENT;
+
+	if (g_client)
+		return g_client->GetRawReport(hand, report);
+	if (g_receiver)
+		return g_receiver->GetRawReport(hand, report);
+
+	device_type_t dev = (hand == GLOVE_LEFT) ? DEV_GLOVE_LEFT : DEV_GLOVE_RIGHT;
+	for (Device* device : g_devices) {
+		if (!device->IsConnected(dev)) continue;
+		return device->GetRawReport(report, dev) ? MANUS_SUCCESS : MANUS_NO_DATA;
+	}
+	return MANUS_DISCONNECTED;
+}
+
+int ManusGetRawHistory(GLOVE_HAND hand, GLOVE_RAW_REPORT* reports, unsigned int count, unsigned int* copied)
+{
+	MANUS_TRACE_FUNCTION();
+	if (!g_initialized)
+		return MANUS_ERROR;
+
+	if (!reports || !copied)
+		return MANUS_INVALID_ARGUMENT;
+
+	if (g_client)
+		return g_client->GetRawHistory(hand, reports, count, copied);
+	if (g_receiver)
+		return g_receiver->GetRawHistory(hand, reports, count, copied);
+
+	*copied = 0;
+	device_type_t dev = (hand == GLOVE_LEFT) ? DEV_GLOVE_LEFT : DEV_GLOVE_RIGHT;
+	for (Device* device : g_devices) {
+		if (device->GetRawHistory(reports, count, *copied, dev)) {
+			return *copied ? MANUS_SUCCESS : MANUS_NO_DATA;
+		}
+	}
+	return MANUS_DISCONNECTED;
+}
+
+int ManusSetDecodeFields(uint32_t fields)
+{
+	MANUS_TRACE_FUNCTION();
+	if (!g_initialized)
+		return MANUS_ERROR;
+
+	if (fields & ~GLOVE_DECODE_ALL)
+		return MANUS_INVALID_ARGUMENT;
+
+	Device::SetDecodeFields(fields);
+	return MANUS_SUCCESS;
+}
+
+int ManusStartCapture(const char* path)
+{
+	MANUS_TRACE_FUNCTION();
+	if (!g_initialized)
+		return MANUS_ERROR;
+
+	if (!path)
+		return MANUS_INVALID_ARGUMENT;
+
+	return Recorder::Start(path) ? MANUS_SUCCESS : MANUS_ERROR;
+}
+
+int ManusStartArchive(const char* path)
+{
+	MANUS_TRACE_FUNCTION();
+	if (!g_initialized)
+		return MANUS_ERROR;
+
+	if (!path)
+		return MANUS_INVALID_ARGUMENT;
+
+	return Recorder::Start(path, true) ? MANUS_SUCCESS : MANUS_ERROR;
+}
+
+typedef struct {
+	GLOVE_ARCHIVE_CALLBACK callback;
+	void* user_data;
+} ARCHIVE_READER;
+
+static void ArchiveReport(uint16_t source, const GLOVE_RAW_REPORT& report, void* user_data)
+{
+	ARCHIVE_READER* reader = (ARCHIVE_READER*)user_data;
+	reader->callback(source, &report, reader->user_data);
+}
+
+int ManusReadArchive(const char* path, GLOVE_ARCHIVE_CALLBACK callback, void* user_data)
+{
+	MANUS_TRACE_FUNCTION();
+	if (!path || !callback)
+		return MANUS_INVALID_ARGUMENT;
+
+	ARCHIVE_READER reader = { callback, user_data };
+	PoseDecoder decoder;
+	return decoder.Read(path, ArchiveReport, &reader) ? MANUS_SUCCESS : MANUS_ERROR;
+}
+
+int ManusStopCapture()
+{
+	MANUS_TRACE_FUNCTION();
+	if (!g_initialized)
+		return MANUS_ERROR;
+
+	Recorder::Stop();
+	return MANUS_SUCCESS;
+}
+
+int ManusGetCaptureStats(uint64_t* written, uint64_t* dropped)
+{
+	MANUS_TRACE_FUNCTION();
+	if (!g_initialized)
+		return MANUS_ERROR;
+
+	if (!written || !dropped)
+		return MANUS_INVALID_ARGUMENT;
+
+	Recorder::GetStats(*written, *dropped);
+	return MANUS_SUCCESS;
+}
+
+int ManusGetLatencyHistogram(GLOVE_LATENCY_STAGE stage, GLOVE_HAND hand, GLOVE_LATENCY_HISTOGRAM* histogram)
+{
+	MANUS_TRACE_FUNCTION();
+	if (!g_initialized)
+		return MANUS_ERROR;
+
+	if (!histogram || stage < 0 || stage >= GLOVE_LATENCY_STAGES)
+		return MANUS_INVALID_ARGUMENT;
+
+	// Combine the latencies of every dongle the glove was connected to
+	LATENCY_SNAPSHOT snapshot;
+	LatencyHistogram::ClearSnapshot(snapshot);
+	device_type_t dev = (hand == GLOVE_LEFT) ? DEV_GLOVE_LEFT : DEV_GLOVE_RIGHT;
+	{
+		std::lock_guard<std::mutex> lock(g_gloves_mutex);
+		for (Device* device : g_devices)
+			device->AddLatency(stage, dev, snapshot);
+	}
+
+	LatencyHistogram::Summarize(snapshot, histogram);
+	return histogram->count ? MANUS_SUCCESS : MANUS_NO_DATA;
+}
+
+int ManusResetLatencyHistograms()
+{
+	MANUS_TRACE_FUNCTION();
+	if (!g_initialized)
+		return MANUS_ERROR;
+
+	std::lock_guard<std::mutex> lock(g_gloves_mutex);
+	for (Device* device : g_devices)
+		device->ResetLatency();
+	return MANUS_SUCCESS;
+}
+
+int ManusSetTracing(bool enabled)
+{
+	if (!g_initialized)
+		return MANUS_ERROR;
+
+	LatencyTrace::SetEnabled(enabled);
+	return MANUS_SUCCESS;
+}
+
+int ManusWriteTrace(const char* path)
+{
+	if (!g_initialized)
+		return MANUS_ERROR;
+
+	if (!path)
+		return MANUS_INVALID_ARGUMENT;
+
+	std::vector<TRACE_EVENT> events;
+	{
+		std::lock_guard<std::mutex> lock(g_gloves_mutex);
+		for (Device* device : g_devices)
+			device->CollectTrace(events);
+	}
+	std::vector<TRACE_SPAN> spans;
+	Trace::Collect(spans);
+	return LatencyTrace::Write(path, events, spans) ? MANUS_SUCCESS : MANUS_ERROR;
+}
+
 int ManusGetFlags(GLOVE_HAND hand, uint8_t* flags, unsigned int timeout) {
+	MANUS_TRACE_FUNCTION();
 	if (!g_initialized)
 		return MANUS_ERROR;
 
@@ -120,6 +1002,7 @@ int ManusGetFlags(GLOVE_HAND hand, uint8_t* flags, unsigned int timeout) {
 }
 
 int ManusGetRssi(GLOVE_HAND hand, int32_t* rssi, unsigned int timeout) {
+	MANUS_TRACE_FUNCTION();
 	if (!g_initialized)
 		return MANUS_ERROR;
 
@@ -133,6 +1016,7 @@ int ManusGetRssi(GLOVE_HAND hand, int32_t* rssi, unsigned int timeout) {
 }
 
 int ManusGetBatteryVoltage(GLOVE_HAND hand, uint16_t* battery, unsigned int timeout) {
+	MANUS_TRACE_FUNCTION();
 	if (!g_initialized)
 		return MANUS_ERROR;
 
@@ -146,6 +1030,7 @@ int ManusGetBatteryVoltage(GLOVE_HAND hand, uint16_t* battery, unsigned int time
 }
 
 int ManusGetBatteryPercentage(GLOVE_HAND hand, uint8_t* battery, unsigned int timeout) {
+	MANUS_TRACE_FUNCTION();
 	if (!g_initialized)
 		return MANUS_ERROR;
 
@@ -160,6 +1045,7 @@ int ManusGetBatteryPercentage(GLOVE_HAND hand, uint8_t* battery, unsigned int ti
 
 int ManusCalibrate(GLOVE_HAND hand, bool gyro, bool accel, bool fingers)
 {
+	MANUS_TRACE_FUNCTION();
 	uint8_t flags;
 	device_type_t dev = (hand == GLOVE_LEFT) ? DEV_GLOVE_LEFT : DEV_GLOVE_RIGHT;
 	Device* flags_device = NULL;
@@ -193,6 +1079,7 @@ int ManusCalibrate(GLOVE_HAND hand, bool gyro, bool accel, bool fingers)
 
 int ManusSetHandedness(GLOVE_HAND hand, bool right_hand)
 {
+	MANUS_TRACE_FUNCTION();
 	// Get the glove from the list
 	uint8_t flags;
 	device_type_t dev = (hand == GLOVE_LEFT) ? DEV_GLOVE_LEFT : DEV_GLOVE_RIGHT;
@@ -217,6 +1104,7 @@ int ManusSetHandedness(GLOVE_HAND hand, bool right_hand)
 }
 
 int ManusPowerOff(GLOVE_HAND hand) {
+	MANUS_TRACE_FUNCTION();
 	device_type_t dev = (hand == GLOVE_LEFT) ? DEV_GLOVE_LEFT : DEV_GLOVE_RIGHT;
 	for (Device* device : g_devices) {
 		if (!device->IsConnected(dev)) continue;
@@ -227,6 +1115,11 @@ int ManusPowerOff(GLOVE_HAND hand) {
 }
 
 bool ManusIsConnected(GLOVE_HAND hand) {
+	if (g_client)
+		return g_client->IsConnected(hand);
+	if (g_receiver)
+		return g_receiver->IsConnected(hand);
+
 	device_type_t dev = (hand == GLOVE_LEFT) ? DEV_GLOVE_LEFT : DEV_GLOVE_RIGHT;
 	for (Device* device : g_devices) {
 		if (device->IsConnected(dev)) {
@@ -18,12 +18,22 @@
 #define _MANUS_H
 
 #include <stdint.h>
+#include <stddef.h>
 
+#ifdef _WIN32
 #ifdef MANUS_EXPORTS
 #define MANUS_API __declspec(dllexport)
 #else
 #define MANUS_API __declspec(dllimport)
 #endif
+#else
+// The shared library is built with hidden visibility, only the API is exported
+#ifdef MANUS_EXPORTS
+#define MANUS_API __attribute__((visibility("default")))
+#else
+#define MANUS_API
+#endif
+#endif
 
 /*! Quaternion representing an orientation. */
 typedef struct {
@@ -73,6 +83,297 @@ typedef enum {
 	GLOVE_RIGHT,
 } GLOVE_HAND;
 
+/*! Bits of the hands in a hand mask, see ManusWaitAny(). */
+#define GLOVE_MASK_LEFT  (1 << GLOVE_LEFT)
+#define GLOVE_MASK_RIGHT (1 << GLOVE_RIGHT)
+
+/*! State of a hand for one frame of the application, see ManusGetFrames().
+ *  Only holds fixed size fields so managed callers can pass an array of
+ *  frames to native code without conversion. */
+typedef struct {
+	//! The hand to get, a GLOVE_HAND value set by the caller.
+	int32_t hand;
+	//! Result of getting the data, as returned by ManusGetData().
+	int32_t data_result;
+	//! Result of getting the skeletal model, as returned by ManusGetSkeletal(), MANUS_NO_DATA when it wasn't asked for.
+	int32_t skeletal_result;
+	GLOVE_DATA data;
+	//! The skeletal model of the data.
+	GLOVE_SKELETAL skeletal;
+} GLOVE_FRAME;
+
+/*! What the SDK writes into an output buffer, see ManusBindOutputBuffer(). */
+typedef enum {
+	//! The header and the data.
+	GLOVE_OUTPUT_DATA = 0,
+	//! The header, the data and the skeletal model of the data.
+	GLOVE_OUTPUT_SKELETAL
+} GLOVE_OUTPUT_LAYOUT;
+
+/*! Memory the SDK keeps up to date with the latest sample of a hand, see ManusBindOutputBuffer().
+ *  With the GLOVE_OUTPUT_DATA layout the buffer ends before the skeletal model. */
+typedef struct {
+	//! Odd while the SDK is writing, raised by two for every sample and 0 before the first one.
+	uint32_t version;
+	uint32_t reserved;
+	//! Time the report was read, see ManusGetTimestamp().
+	uint64_t timestamp;
+	GLOVE_DATA data;
+	GLOVE_SKELETAL skeletal;
+} GLOVE_OUTPUT_BUFFER;
+
+/*! Shapes of a haptic waveform, see ManusPlayHaptic(). */
+typedef enum {
+	//! Attack, decay, sustain and release envelope.
+	GLOVE_HAPTIC_ADSR = 0,
+	//! A train of pulses at full power.
+	GLOVE_HAPTIC_PULSES,
+	//! Power sampled at a fixed interval, linearly interpolated.
+	GLOVE_HAPTIC_CURVE
+} GLOVE_HAPTIC_SHAPE;
+
+/*! A haptic waveform, only the fields of its shape are used. All times are in milliseconds. */
+typedef struct {
+	GLOVE_HAPTIC_SHAPE shape;
+	//! Peak power of the waveform, ranging from 0 to 1.
+	float power;
+
+	//! GLOVE_HAPTIC_ADSR: rise to the peak, fall to the sustain level, hold it and fall to zero.
+	unsigned int attack;
+	unsigned int decay;
+	float sustain_level;
+	unsigned int sustain;
+	unsigned int release;
+
+	//! GLOVE_HAPTIC_PULSES: count pulses of on milliseconds separated by off milliseconds.
+	unsigned int on;
+	unsigned int off;
+	unsigned int count;
+
+	//! GLOVE_HAPTIC_CURVE: sample_count samples from 0 to 1, sample_interval milliseconds apart.
+	const float* samples;
+	unsigned int sample_count;
+	unsigned int sample_interval;
+} GLOVE_HAPTIC_WAVEFORM;
+
+/*! Counters of the messages sent to the gloves, see ManusGetWriteStats(). */
+typedef struct {
+	//! Messages the SDK was asked to send.
+	uint64_t requested;
+	//! Messages written to the dongles.
+	uint64_t written;
+	//! Messages dropped because they were pending already or the glove already got them.
+	uint64_t deduplicated;
+	//! Rumble messages replaced by a newer one before they were written.
+	uint64_t superseded;
+	//! Messages dropped because the queue of a dongle was full.
+	uint64_t dropped;
+	//! Messages held back by the write budget before they were written, each counted once.
+	uint64_t throttled;
+} GLOVE_WRITE_STATS;
+
+// Dongles reported by ManusGetMetrics()
+#define GLOVE_METRICS_MAX_DONGLES 8
+
+/*! Health of a dongle and its gloves, see ManusGetMetrics(). */
+typedef struct {
+	//! Reports received per hand.
+	uint64_t packets[2];
+	//! Reports received per hand in the last second.
+	float packets_per_second[2];
+	//! Smoothed variation of the time between reports per hand, in nanoseconds.
+	uint64_t jitter_ns[2];
+	//! Mean time to decode a report, in nanoseconds.
+	uint64_t decode_ns;
+	//! Messages waiting to be written to the dongle.
+	uint32_t queue_depth;
+	//! Times the dongle was opened again after it was lost.
+	uint32_t reconnects;
+	//! Messages dropped because the queue of the dongle was full.
+	uint64_t dropped_commands;
+} GLOVE_DONGLE_METRICS;
+
+/*! Health of the SDK, see ManusGetMetrics(). */
+typedef struct {
+	//! Dongles in order of discovery, dongles beyond GLOVE_METRICS_MAX_DONGLES are left out.
+	uint32_t dongle_count;
+	GLOVE_DONGLE_METRICS dongles[GLOVE_METRICS_MAX_DONGLES];
+	//! Threads reading glove data right now.
+	int32_t readers;
+	//! Scans for dongles and the duration of the last one in nanoseconds.
+	uint64_t enumerations;
+	uint64_t enumeration_ns;
+	//! Skeletal models computed and served from the cache of the last model per hand.
+	uint64_t skeletal_evaluations;
+	uint64_t skeletal_cache_hits;
+} GLOVE_METRICS;
+
+/*! Channels of the glove data that can be filtered independently. */
+typedef enum {
+	GLOVE_FILTER_THUMB = 0,
+	GLOVE_FILTER_INDEX,
+	GLOVE_FILTER_MIDDLE,
+	GLOVE_FILTER_RING,
+	GLOVE_FILTER_PINKY,
+	GLOVE_FILTER_ORIENTATION,
+	GLOVE_FILTER_CHANNELS
+} GLOVE_FILTER_CHANNEL;
+
+/*! Parameters of the adaptive (One Euro) smoothing filter. */
+typedef struct {
+	//! Cutoff frequency in Hz when the channel is not moving, lower values smooth more.
+	float min_cutoff;
+	//! Increase of the cutoff frequency per unit of speed, higher values reduce lag.
+	float beta;
+	//! Cutoff frequency in Hz used to smooth the speed estimate.
+	float d_cutoff;
+} GLOVE_FILTER_PARAMS;
+
+
+/*! Built-in hand gestures, user defined templates are numbered from GLOVE_GESTURE_USER. */
+typedef enum {
+	GLOVE_GESTURE_NONE = -1,
+	GLOVE_GESTURE_FIST = 0,
+	GLOVE_GESTURE_POINT,
+	GLOVE_GESTURE_PINCH,
+	GLOVE_GESTURE_OPEN,
+	GLOVE_GESTURE_THUMBS_UP,
+	GLOVE_GESTURE_USER = 16
+} GLOVE_GESTURE;
+
+/*! Event raised when a gesture starts or ends. */
+typedef struct {
+	//! The hand that made the gesture.
+	GLOVE_HAND hand;
+	//! The gesture, either a GLOVE_GESTURE value or a user defined template.
+	int gesture;
+	//! 1 when the gesture started, 0 when it ended.
+	int active;
+	//! Time of the sample that triggered the event, see ManusGetTimestamp().
+	uint64_t timestamp;
+} GLOVE_GESTURE_EVENT;
+
+/*! Callback for gesture events, called from the device thread. */
+typedef void (*GLOVE_GESTURE_CALLBACK)(const GLOVE_GESTURE_EVENT* event, void* user_data);
+
+#pragma pack(push, 1) // the report fields are copied as received
+/*! Report as received from the glove, without any conversion. */
+typedef struct {
+	//! Time the report was received, see ManusGetTimestamp().
+	uint64_t timestamp;
+	//! Sequence number of the report, matches GLOVE_DATA::PacketNumber.
+	uint32_t packet_number;
+	//! Type of the device that sent the report.
+	uint8_t device_type;
+	//! Orientation quaternion (w, x, y, z) scaled by 16384.
+	int16_t quat[4];
+	//! Linear acceleration scaled by 16384 per G.
+	int16_t accel[3];
+	//! Finger bends from 0 to 255, pinky first on the left hand.
+	uint8_t fingers[5];
+	uint8_t flags;
+	int32_t rssi;
+} GLOVE_RAW_REPORT;
+#pragma pack(pop)
+
+/*! Callback for the reports of an archive, source identifies the dongle the report was received from. */
+typedef void (*GLOVE_ARCHIVE_CALLBACK)(unsigned int source, const GLOVE_RAW_REPORT* report, void* user_data);
+
+/*! Points in the data path latency is measured to, from the moment the report was read from the device. */
+typedef enum {
+	//! Time between two reports of the same device, shows delays in the radio and the USB polling.
+	GLOVE_LATENCY_REPORT_INTERVAL = 0,
+	//! Until the report is decoded.
+	GLOVE_LATENCY_DECODE,
+	//! Until readers waiting for new data are woken up.
+	GLOVE_LATENCY_PUBLISH,
+	//! Until the application reads the data.
+	GLOVE_LATENCY_CONSUMER,
+	//! Until the skeletal model of the data is done.
+	GLOVE_LATENCY_SKELETAL,
+	//! Time spent waiting for the lock on the data of a device, by the device thread and the readers.
+	GLOVE_LATENCY_LOCK_WAIT,
+	GLOVE_LATENCY_STAGES
+} GLOVE_LATENCY_STAGE;
+
+/*! Summary of the latencies measured at a stage, values are in nanoseconds with 6% precision. */
+typedef struct {
+	uint64_t count;
+	uint64_t min_ns;
+	uint64_t max_ns;
+	uint64_t mean_ns;
+	uint64_t p50_ns;
+	uint64_t p90_ns;
+	uint64_t p99_ns;
+	uint64_t p999_ns;
+} GLOVE_LATENCY_HISTOGRAM;
+
+/*! Motion generated by the glove simulator. */
+typedef enum {
+	//! The hand rests with straight fingers.
+	GLOVE_SIM_STATIC = 0,
+	//! The fingers open and close and the hand sways at the motion frequency.
+	GLOVE_SIM_WAVE,
+	//! The fingers and orientation wander randomly.
+	GLOVE_SIM_RANDOM,
+	//! The motion callback provides every sample.
+	GLOVE_SIM_SCRIPT
+} GLOVE_SIM_MOTION;
+
+/*! Callback providing the state of a simulated device at a time in seconds, called from the device thread. */
+typedef void (*GLOVE_SIM_CALLBACK)(unsigned int device, double time, GLOVE_DATA* data, void* user_data);
+
+/*! Configuration of the glove simulator, see ManusSetSimulation(). */
+typedef struct {
+	//! Number of virtual dongles, from 1 to 32.
+	unsigned int dongles;
+	//! Devices per dongle from 1 to 4, in order left glove, right glove, left and right bracelet.
+	unsigned int gloves;
+	//! Reports per second sent by each device.
+	float rate;
+	//! Fraction of the reports that is lost, from 0 to 1.
+	float loss;
+	//! Largest random delay of a report in microseconds.
+	float jitter_us;
+	GLOVE_SIM_MOTION motion;
+	//! Frequency of the wave motion in Hz, step size of the random motion per second.
+	float motion_frequency;
+	//! Seed of the random generators, equal seeds give equal traffic.
+	uint32_t seed;
+	GLOVE_SIM_CALLBACK callback;
+	void* user_data;
+} GLOVE_SIM_CONFIG;
+
+/*! Content of a glove stream, see ManusStartStream(). */
+typedef enum {
+	//! The decoded samples, as returned by ManusGetData().
+	GLOVE_STREAM_DATA = 0x1,
+	//! The raw reports, as returned by ManusGetRawReport().
+	GLOVE_STREAM_RAW = 0x2
+} GLOVE_STREAM_CONTENT;
+
+/*! Configuration of a glove stream, see ManusStartStream(). */
+typedef struct {
+	//! IPv4 address to send to, unicast or multicast.
+	const char* address;
+	unsigned short port;
+	//! Combination of GLOVE_STREAM_CONTENT values.
+	uint32_t content;
+	//! Longest time in microseconds a sample waits to share a datagram with later ones, 0 sends every sample right away.
+	unsigned int latency_us;
+	//! Routers a multicast datagram may pass, 1 keeps it on the local network.
+	unsigned int ttl;
+} GLOVE_STREAM_CONFIG;
+
+/*! Fields of GLOVE_DATA that are decoded from the reports. */
+typedef enum {
+	GLOVE_DECODE_ACCELERATION = 0x1,
+	GLOVE_DECODE_QUATERNION = 0x2,
+	GLOVE_DECODE_FINGERS = 0x4,
+	GLOVE_DECODE_EULER = 0x8,
+	GLOVE_DECODE_ALL = 0xF
+} GLOVE_DECODE_FIELD;
+
 
 //-- going to redefine -- 
 
@@ -85,6 +386,7 @@ typedef enum {
 #define MANUS_SUCCESS 0
 #define MANUS_INVALID_ARGUMENT 1
 #define MANUS_DISCONNECTED 2
+#define MANUS_NO_DATA 3
 
 #ifdef __cplusplus
 extern "C" {
@@ -96,6 +398,101 @@ extern "C" {
 	*/
 	MANUS_API int ManusInit();
 
+	/*! \brief Replay a capture instead of using the connected devices.
+	*
+	*  Must be called before ManusInit(). The captured reports are fed
+	*  through the same processing as live data. Without this call the
+	*  MANUS_REPLAY and MANUS_REPLAY_SPEED environment variables are used.
+	*
+	*  \param path The capture file, see ManusStartCapture(), or NULL for live data.
+	*  \param speed Playback speed relative to real time, 0 plays as fast as possible.
+	*/
+	MANUS_API int ManusSetReplay(const char* path, float speed);
+
+	/*! \brief Simulate dongles and gloves instead of using the connected devices.
+	*
+	*  Must be called before ManusInit(). The simulated devices send reports
+	*  and answer requests like real ones and are fed through the same
+	*  processing as live data. Without this call the MANUS_SIM_DONGLES,
+	*  MANUS_SIM_GLOVES and MANUS_SIM_RATE environment variables are used.
+	*
+	*  \param config The simulator configuration, or NULL for live data.
+	*/
+	MANUS_API int ManusSetSimulation(const GLOVE_SIM_CONFIG* config);
+
+	/*! \brief Plug a simulated dongle in or out.
+	*
+	*  Unplugging ends the connection like removing a real dongle does,
+	*  after plugging it back in the dongle is connected again right away.
+	*  All dongles are plugged in when the SDK is initialized.
+	*
+	*  \param dongle Index of the simulated dongle.
+	*  \param plugged True to plug the dongle in, false to pull it out.
+	*/
+	MANUS_API int ManusSetSimulatedDongle(unsigned int dongle, bool plugged);
+
+	/*! \brief Read the gloves of a server process instead of the connected devices.
+	*
+	*  Must be called before ManusInit(). Only one process can open the
+	*  dongles, the others read the data that process publishes with
+	*  ManusStartServer(). The data, skeletal model and raw reports are
+	*  read straight from shared memory. The predicted data, heading and
+	*  gestures aren't published and return MANUS_ERROR, the other
+	*  functions report the gloves as disconnected. Without this call the
+	*  MANUS_CLIENT environment variable is used.
+	*
+	*  \param name The name the server was started with, "" for the default
+	*  name or NULL to use the connected devices.
+	*/
+	MANUS_API int ManusSetClient(const char* name);
+
+	/*! \brief Publish the gloves to other processes.
+	*
+	*  Every sample, raw report and skeletal model is stored in a shared
+	*  memory segment that processes using ManusSetClient() read from.
+	*  Stops when ManusStopServer() or ManusExit() is called.
+	*
+	*  \param name Name of the segment, NULL for the default name.
+	*/
+	MANUS_API int ManusStartServer(const char* name);
+
+	/*! \brief Stop publishing the gloves, the clients see them disconnect. */
+	MANUS_API int ManusStopServer();
+
+	/*! \brief Receive the gloves streamed by another machine instead of using the connected devices.
+	*
+	*  Must be called before ManusInit(). The samples are received from a
+	*  process that called ManusStartStream(). The data, skeletal model and
+	*  raw reports are available, the other functions report the gloves
+	*  as disconnected. Without this call the MANUS_STREAM environment
+	*  variable is used, in the form "address:port".
+	*
+	*  \param address Local or multicast IPv4 address to receive on, NULL to use the connected devices.
+	*  \param port UDP port to receive on.
+	*/
+	MANUS_API int ManusSetStreamReceiver(const char* address, unsigned short port);
+
+	/*! \brief Send the gloves to other machines over UDP.
+	*
+	*  Samples are batched into datagrams of up to 1400 bytes, a sample
+	*  waits at most the configured latency for others to join it.
+	*  Stops when ManusStopStream() or ManusExit() is called.
+	*
+	*  \param config Where to send to and what.
+	*/
+	MANUS_API int ManusStartStream(const GLOVE_STREAM_CONFIG* config);
+
+	/*! \brief Stop sending the gloves. */
+	MANUS_API int ManusStopStream();
+
+	/*! \brief Get the traffic of the stream that is sent or received.
+	*
+	*  \param datagrams Output variable to receive the number of datagrams sent or received.
+	*  \param samples Output variable to receive the number of samples sent or received.
+	*  \param lost Output variable to receive the number of samples dropped by the sender or datagrams lost on the way.
+	*/
+	MANUS_API int ManusGetStreamStats(uint64_t* datagrams, uint64_t* samples, uint64_t* lost);
+
 	/*! \brief Shutdown the Manus SDK.
 	*
 	*  Must be called when the SDK is no longer
@@ -111,6 +508,45 @@ extern "C" {
 	*/
 	MANUS_API int ManusGetData(GLOVE_HAND hand, GLOVE_DATA* data, unsigned int timeout = 0);
 
+	/*! \brief Get the first sample of a glove after one the caller already has.
+	*
+	*  Returns at once when the glove has a sample newer than after_seq,
+	*  otherwise the calling thread sleeps until one arrives. Unlike
+	*  ManusGetData() with a timeout, a sample that arrived between two
+	*  calls isn't missed and the same sample isn't returned twice.
+	*  Sequences belong to the dongle the glove is paired with, a sample
+	*  from another dongle always counts as newer. Not available in client
+	*  mode, see ManusSetClient().
+	*
+	*  \param hand The left or right hand index.
+	*  \param after_seq Sequence of the last sample the caller has, 0 for none.
+	*  \param data Output variable to receive the data.
+	*  \param seq Output variable to receive the sequence of the data, pass it as after_seq in the next call.
+	*  \param timeout Time to wait in milliseconds, MANUS_NO_DATA is returned when it runs out.
+	*/
+	MANUS_API int ManusGetDataAfter(GLOVE_HAND hand, uint64_t after_seq, GLOVE_DATA* data, uint64_t* seq, unsigned int timeout);
+
+	/*! \brief Get the state of a glove extrapolated to a future time.
+	*
+	*  The palm orientation and finger bends are extrapolated using the
+	*  angular and finger velocities estimated from the most recent samples.
+	*  The prediction horizon is clamped to 100 ms, a target time before the
+	*  latest sample returns the latest sample. Not available in client
+	*  mode, see ManusSetClient().
+	*
+	*  \param hand The left or right hand index.
+	*  \param target_time_ns Time to predict for, as returned by ManusGetTimestamp().
+	*  \param data Output variable to receive the predicted data.
+	*/
+	MANUS_API int ManusGetPredictedData(GLOVE_HAND hand, uint64_t target_time_ns, GLOVE_DATA* data);
+
+	/*! \brief Get the current time of the SDK clock in nanoseconds.
+	*
+	*  Sample timestamps and prediction target times are expressed in this
+	*  monotonic clock.
+	*/
+	MANUS_API uint64_t ManusGetTimestamp();
+
 	/*! \brief Get a skeletal model for the given glove state.
 	*
 	*  The skeletal model gives the orientation and position of each bone
@@ -127,6 +563,50 @@ extern "C" {
 	*/
 	MANUS_API int ManusGetSkeletal(GLOVE_HAND hand, GLOVE_SKELETAL* model, unsigned int timeout = 0);
 
+	/*! \brief Wait until any of several hands has a new sample.
+	*
+	*  Returns at once when a hand already has a sample the caller hasn't
+	*  seen, otherwise the calling thread sleeps until one arrives. A hand
+	*  that isn't connected doesn't hold up the others. ManusExit() ends the
+	*  wait with MANUS_DISCONNECTED. Not available in client mode, see
+	*  ManusSetClient().
+	*
+	*  \param hand_mask The hands to wait for, GLOVE_MASK_LEFT and/or GLOVE_MASK_RIGHT.
+	*  \param last_seen Sample sequence per hand, start with zeros. The sequence of the returned hand is updated.
+	*  \param timeout Time to wait in milliseconds, MANUS_NO_DATA is returned when it runs out.
+	*  \param which Output variable to receive the hand with a new sample, get it with ManusGetData().
+	*/
+	MANUS_API int ManusWaitAny(uint32_t hand_mask, uint32_t last_seen[2], unsigned int timeout, GLOVE_HAND* which);
+
+	/*! \brief Get the data and skeletal model of several hands in one call.
+	*
+	*  Meant for callers that pay for every call, like managed code. The
+	*  skeletal model of a frame is computed from the data in the same
+	*  frame. The results are reported per frame, a hand that isn't
+	*  connected doesn't fail the call.
+	*
+	*  \param frames The frames to fill in, the caller sets the hand of every frame.
+	*  \param count Number of frames.
+	*  \param skeletal Also compute the skeletal models.
+	*  \param timeout Milliseconds to wait for the next sample of the first hand.
+	*/
+	MANUS_API int ManusGetFrames(GLOVE_FRAME* frames, unsigned int count, bool skeletal, unsigned int timeout);
+
+	/*! \brief Have the SDK write every new sample of a hand into memory of the caller.
+	*
+	*  The sample is written by the thread that receives it, so reading
+	*  the buffer needs no call into the SDK, see ManusReadOutputBuffer().
+	*  The buffer stays bound until another buffer is bound for the hand,
+	*  it's unbound or ManusExit() is called. After unbinding the SDK no
+	*  longer touches the memory.
+	*
+	*  \param hand The left or right hand index.
+	*  \param memory Buffer of at least the size of the layout, 4 byte aligned, or NULL to unbind.
+	*  \param size Size of the buffer in bytes.
+	*  \param layout What to write, with GLOVE_OUTPUT_SKELETAL the skeletal model is computed on the receiving thread.
+	*/
+	MANUS_API int ManusBindOutputBuffer(GLOVE_HAND hand, void* memory, size_t size, GLOVE_OUTPUT_LAYOUT layout);
+
 	/*! \brief Set the ouput power of the vibration motor.
 	*
 	*  This sets the output power of the vibration motor.
@@ -136,7 +616,260 @@ extern "C" {
 	*/
 	MANUS_API int ManusSetVibration(GLOVE_HAND hand, float power);
 
+	/*! \brief Play a haptic waveform on the vibration motor.
+	*
+	*  The waveform replaces the one that is playing on the hand. It is turned
+	*  into a few timed rumble messages on a host side scheduler, power changes
+	*  shorter than the radio can deliver are averaged out.
+	*  ManusSetVibration() stops the waveform.
+	*
+	*  \param hand The hand to play the waveform on.
+	*  \param waveform The waveform, it is copied.
+	*/
+	MANUS_API int ManusPlayHaptic(GLOVE_HAND hand, const GLOVE_HAPTIC_WAVEFORM* waveform);
+
+	/*! \brief Stop the haptic waveform and the vibration motor of a hand. */
+	MANUS_API int ManusStopHaptic(GLOVE_HAND hand);
+
+	/*! \brief Limit the messages written to each dongle.
+	*
+	*  Messages are held back while the budget is spent, pending rumble
+	*  messages keep being replaced by newer ones meanwhile.
+	*
+	*  \param writes_per_second Most writes per second to a dongle, 0 is unlimited (default).
+	*/
+	MANUS_API int ManusSetWriteBudget(unsigned int writes_per_second);
+
+	/*! \brief Get the message counters of all dongles together. */
+	MANUS_API int ManusGetWriteStats(GLOVE_WRITE_STATS* stats);
+
+	/*! \brief Get the health of the SDK and the dongles.
+	*
+	*  The counters are kept with relaxed atomics, so a snapshot is not
+	*  taken at a single instant.
+	*/
+	MANUS_API int ManusGetMetrics(GLOVE_METRICS* metrics);
+
+	/*! \brief Write the metrics in the Prometheus text format.
+	*
+	*  A file is replaced as a whole, so a collector never reads half a
+	*  snapshot. A target of the form "unix:<path>" is written to the Unix
+	*  domain socket at the path instead.
+	*
+	*  \param target The file or socket to write to.
+	*/
+	MANUS_API int ManusWriteMetrics(const char* target);
+
+
+
+	/*! \brief Configure the smoothing filter of a glove data channel.
+	*
+	*  The filter runs in the device thread for every received sample, so
+	*  the data returned by ManusGetData() is already smoothed. The filter
+	*  is disabled by default.
+	*
+	*  \param hand The left or right hand index.
+	*  \param channel The channel to configure.
+	*  \param params The filter parameters, or NULL to disable the filter.
+	*/
+	MANUS_API int ManusSetFilter(GLOVE_HAND hand, GLOVE_FILTER_CHANNEL channel, const GLOVE_FILTER_PARAMS* params);
+
+	/*! \brief Add a raw magnetometer sample to the compass calibration.
+	*
+	*  The samples are collected in a fixed size buffer and the hard and
+	*  soft iron calibration is refitted in the background as the glove is
+	*  rotated through different orientations.
+	*
+	*  \param hand The left or right hand index.
+	*  \param compass The raw magnetometer reading in sensor counts.
+	*/
+	MANUS_API int ManusAddCompassSample(GLOVE_HAND hand, const int16_t compass[3]);
+
+	/*! \brief Get the tilt compensated heading of a glove.
+	*
+	*  Only available once the compass calibration has converged. Not
+	*  available in client mode, see ManusSetClient().
+	*
+	*  \param hand The left or right hand index.
+	*  \param heading Output variable to receive the heading in radians.
+	*/
+	MANUS_API int ManusGetHeading(GLOVE_HAND hand, float* heading);
+
+	/*! \brief Add a user defined gesture template.
+	*
+	*  Gestures are classified in the device thread for every sample by
+	*  comparing the finger bends, and optionally the direction of the palm,
+	*  against all templates.
+	*
+	*  \param fingers Bend of each finger ranging from 0 to 1, thumb first.
+	*  \param orientation Palm orientation to match, or NULL to ignore the orientation.
+	*  \param threshold Squared distance below which the template matches.
+	*  \param gesture Output variable to receive the gesture number.
+	*/
+	MANUS_API int ManusAddGestureTemplate(const float fingers[5], const GLOVE_QUATERNION* orientation, float threshold, int* gesture);
+
+	/*! \brief Get the gesture a hand is currently making.
+	*
+	*  Not available in client mode, see ManusSetClient().
+	*
+	*  \param hand The left or right hand index.
+	*  \param gesture Output variable to receive the gesture or GLOVE_GESTURE_NONE.
+	*/
+	MANUS_API int ManusGetGesture(GLOVE_HAND hand, int* gesture);
+
+	/*! \brief Get the next gesture event.
+	*
+	*  Events are queued without locking, this function should only be
+	*  called from a single thread. Returns MANUS_NO_DATA if the queue is empty.
+	*  Not available in client mode, see ManusSetClient().
+	*
+	*  \param event Output variable to receive the event.
+	*/
+	MANUS_API int ManusPollGesture(GLOVE_GESTURE_EVENT* event);
+
+	/*! \brief Set a callback that is invoked for every gesture event.
+	*
+	*  The callback is called from the device thread and should return quickly.
+	*  When this function returns the previous callback has finished and is
+	*  no longer called, so its user data can be freed. It must not be called
+	*  from within the callback.
+	*
+	*  \param callback The callback, or NULL to remove it.
+	*  \param user_data Pointer passed to the callback.
+	*/
+	MANUS_API int ManusSetGestureCallback(GLOVE_GESTURE_CALLBACK callback, void* user_data);
+
+	/*! \brief Start recording the finger range of a glove.
+	*
+	*  The calibration is done on the host from the received data, the user
+	*  should bend and stretch all fingers until ManusStopFingerCalibration()
+	*  is called.
+	*
+	*  \param hand The left or right hand index.
+	*/
+	MANUS_API int ManusStartFingerCalibration(GLOVE_HAND hand);
+
+	/*! \brief Stop recording and apply the recorded finger range.
+	*
+	*  Profiles are stored per glove and applied automatically when the
+	*  glove connects again.
+	*
+	*  \param hand The left or right hand index.
+	*  \param save Store the profile for this glove.
+	*/
+	MANUS_API int ManusStopFingerCalibration(GLOVE_HAND hand, bool save);
+
+	/*! \brief Set the response curve of the fingers.
+	*
+	*  The normalized bend value is raised to the power gamma,
+	*  1 gives a linear response. The curve is stored in the profile of
+	*  the glove right away, see ManusStopFingerCalibration().
+	*
+	*  \param hand The left or right hand index.
+	*  \param gamma The exponent for each finger, thumb first.
+	*/
+	MANUS_API int ManusSetFingerResponse(GLOVE_HAND hand, const float gamma[5]);
+
+	/*! \brief Get the latest report of a glove as it was received.
+	*
+	*  \param hand The left or right hand index.
+	*  \param report Output variable to receive the report.
+	*/
+	MANUS_API int ManusGetRawReport(GLOVE_HAND hand, GLOVE_RAW_REPORT* report);
+
+	/*! \brief Get the most recent reports of a glove as they were received.
+	*
+	*  The reports are returned oldest first, at most the last 64 reports
+	*  are kept.
+	*
+	*  \param hand The left or right hand index.
+	*  \param reports Output array to receive the reports.
+	*  \param count The number of elements in the array.
+	*  \param copied Output variable to receive the number of reports copied.
+	*/
+	MANUS_API int ManusGetRawHistory(GLOVE_HAND hand, GLOVE_RAW_REPORT* reports, unsigned int count, unsigned int* copied);
+
+	/*! \brief Select the fields of GLOVE_DATA that are decoded from the reports.
+	*
+	*  Fields that are not decoded keep their last value, applications that
+	*  only use the raw reports can turn off decoding entirely. Filtering,
+	*  prediction and gestures require both the quaternion and the fingers.
+	*  The selection lasts until ManusExit() is called.
+	*
+	*  \param fields A combination of GLOVE_DECODE_FIELD values.
+	*/
+	MANUS_API int ManusSetDecodeFields(uint32_t fields);
+
+	/*! \brief Start capturing the HID traffic of all devices to a file.
+	*
+	*  Every received report and every sent packet is stored with its
+	*  timestamp. Packets are dropped rather than delaying the devices
+	*  when the disk can't keep up, the drops are marked in the file.
+	*
+	*  \param path The file to write the capture to.
+	*/
+	MANUS_API int ManusStartCapture(const char* path);
+
+	/*! \brief Start archiving the glove reports of all devices to a file.
+	*
+	*  Like ManusStartCapture(), but only the glove reports are stored and
+	*  they are compressed to a few bytes each. The orientation is kept to
+	*  within 0.06 degrees and the timestamps to a microsecond, the other
+	*  fields are stored exactly. Stop it with ManusStopCapture().
+	*
+	*  \param path The file to write the archive to.
+	*/
+	MANUS_API int ManusStartArchive(const char* path);
+
+	/*! \brief Read the reports of an archive.
+	*
+	*  The callback is called for every report in the order they were
+	*  stored. The packet number of a report counts the reports of its
+	*  glove in the archive. Does not need ManusInit().
+	*
+	*  \param path The archive file, see ManusStartArchive().
+	*  \param callback Called for every report.
+	*  \param user_data Passed to the callback.
+	*/
+	MANUS_API int ManusReadArchive(const char* path, GLOVE_ARCHIVE_CALLBACK callback, void* user_data);
+
+	/*! \brief Stop the capture and close the file. */
+	MANUS_API int ManusStopCapture();
+
+	/*! \brief Get the number of packets written and dropped by the current capture.
+	*
+	*  \param written Output variable to receive the number of records written.
+	*  \param dropped Output variable to receive the number of packets dropped.
+	*/
+	MANUS_API int ManusGetCaptureStats(uint64_t* written, uint64_t* dropped);
+
+	/*! \brief Get the latencies measured at a stage of the data path.
+	*
+	*  The latencies are measured from the moment a report was read from
+	*  the device, so the stages show where the time goes between the
+	*  glove and the application.
+	*
+	*  \param stage The stage to get the latencies of.
+	*  \param hand The left or right hand index.
+	*  \param histogram Output variable to receive the latencies.
+	*/
+	MANUS_API int ManusGetLatencyHistogram(GLOVE_LATENCY_STAGE stage, GLOVE_HAND hand, GLOVE_LATENCY_HISTOGRAM* histogram);
+
+	/*! \brief Clear the latencies measured so far. */
+	MANUS_API int ManusResetLatencyHistograms();
 
+	/*! \brief Enable recording of trace events for ManusWriteTrace(). */
+	MANUS_API int ManusSetTracing(bool enabled);
+
+	/*! \brief Write the most recent trace events to a file.
+	*
+	*  The file is in the Chrome trace event format and can be opened in
+	*  chrome://tracing or Perfetto. Builds with MANUS_TRACE defined add
+	*  the most recent spans of the SDK's own trace points, per thread.
+	*
+	*  \param path The file to write the trace to.
+	*/
+	MANUS_API int ManusWriteTrace(const char* path);
 
 	MANUS_API int ManusGetRssi(GLOVE_HAND hand, int32_t* rssi, unsigned int timeout);
 	MANUS_API int ManusGetFlags(GLOVE_HAND hand, uint8_t* flags, unsigned int timeout);
@@ -153,6 +886,52 @@ extern "C" {
 }
 #endif
 
+#ifdef __cplusplus
+#include <atomic>
+#include <thread>
+
+/*! \brief Copy a consistent sample out of a bound output buffer.
+*
+*  Only reads memory, so it's as cheap as copying the buffer and never
+*  waits for the SDK. Retries when the SDK wrote the buffer during the
+*  copy, and gives up when the buffer stays in the middle of a write,
+*  which happens when the writing thread was stopped during a write.
+*
+*  \param buffer The buffer passed to ManusBindOutputBuffer().
+*  \param layout The layout the buffer was bound with.
+*  \param copy Output variable to receive the sample.
+*  \return Number of samples written to the buffer so far, 0 when there is no sample yet,
+*  or MANUS_ERROR when the buffer stayed in the middle of a write and nothing was copied.
+*/
+inline int ManusReadOutputBuffer(const GLOVE_OUTPUT_BUFFER* buffer, GLOVE_OUTPUT_LAYOUT layout, GLOVE_OUTPUT_BUFFER* copy)
+{
+	// A write takes well under a microsecond, this is a lot longer
+	const unsigned int max_tries = 100000;
+
+	// The SDK writes the buffer as 32 bit words
+	const std::atomic<uint32_t>* words = reinterpret_cast<const std::atomic<uint32_t>*>(buffer);
+	uint32_t* out = reinterpret_cast<uint32_t*>(copy);
+	size_t count = (offsetof(GLOVE_OUTPUT_BUFFER, skeletal) + (layout == GLOVE_OUTPUT_SKELETAL ? sizeof(GLOVE_SKELETAL) : 0)) / sizeof(uint32_t);
+
+	for (unsigned int tries = 0; tries < max_tries; tries++) {
+		uint32_t version = words[0].load(std::memory_order_acquire);
+		if (version & 1) {
+			// The writing thread may have been preempted, let it finish
+			std::this_thread::yield();
+			continue;
+		}
+		for (size_t i = 1; i < count; i++)
+			out[i] = words[i].load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (words[0].load(std::memory_order_relaxed) == version) {
+			out[0] = version;
+			return (int)(version / 2);
+		}
+	}
+	return MANUS_ERROR;
+}
+#endif
+
 /**@}*/
 
 #endif
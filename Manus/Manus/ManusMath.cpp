@@ -19,6 +19,8 @@
 #include "Device.h"
 #include "ManusMath.h"
 
+#include <math.h>
+
 ManusMath::ManusMath()
 {
 }
@@ -80,4 +82,42 @@ GLOVE_QUATERNION ManusMath::QuaternionMultiply(GLOVE_QUATERNION q1, GLOVE_QUATER
 	return result;
 }
 
+GLOVE_QUATERNION ManusMath::QuaternionConjugate(GLOVE_QUATERNION q) {
+	GLOVE_QUATERNION result;
+	result.w = q.w;
+	result.x = -q.x;
+	result.y = -q.y;
+	result.z = -q.z;
+	return result;
+}
+
+GLOVE_VECTOR ManusMath::QuaternionToRotationVector(GLOVE_QUATERNION q) {
+	GLOVE_VECTOR v;
+
+	// q and -q are the same orientation, take the one with the shortest path
+	if (q.w < 0) {
+		q.w = -q.w; q.x = -q.x; q.y = -q.y; q.z = -q.z;
+	}
+
+	float sin_half = sqrtf(q.x * q.x + q.y * q.y + q.z * q.z);
+	// small angle approximation avoids dividing by a vanishing sine
+	float scale = (sin_half > 1e-6f) ? 2.0f * atan2f(sin_half, q.w) / sin_half : 2.0f;
+
+	v.x = q.x * scale;
+	v.y = q.y * scale;
+	v.z = q.z * scale;
+	return v;
+}
+
+GLOVE_QUATERNION ManusMath::QuaternionFromRotationVector(GLOVE_VECTOR v) {
+	GLOVE_QUATERNION result;
 
+	float angle = sqrtf(v.x * v.x + v.y * v.y + v.z * v.z);
+	float scale = (angle > 1e-6f) ? sinf(angle * 0.5f) / angle : 0.5f;
+
+	result.w = cosf(angle * 0.5f);
+	result.x = v.x * scale;
+	result.y = v.y * scale;
+	result.z = v.z * scale;
+	return result;
+}
@@ -50,6 +50,19 @@ public:
 
 	static GLOVE_QUATERNION QuaternionMultiply(GLOVE_QUATERNION q1, GLOVE_QUATERNION q2);
 
+	/*! \brief Return the conjugate (inverse rotation) of a unit quaternion. */
+	static GLOVE_QUATERNION QuaternionConjugate(GLOVE_QUATERNION q);
+
+	/*! \brief Convert a unit quaternion to a rotation vector.
+	*
+	*  The rotation vector points along the rotation axis and its length
+	*  is the rotation angle in radians. The shortest rotation is returned.
+	*/
+	static GLOVE_VECTOR QuaternionToRotationVector(GLOVE_QUATERNION q);
+
+	/*! \brief Convert a rotation vector to a unit quaternion. */
+	static GLOVE_QUATERNION QuaternionFromRotationVector(GLOVE_VECTOR v);
+
 private:
 	ManusMath();
 };
@@ -0,0 +1,195 @@
+/*
+   Copyright 2015 Manus VR
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+
+#include "stdafx.h"
+#include "Metrics.h"
+#include "Device.h"
+#include "DeviceManager.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+#endif
+
+// Prefix of a target that names a Unix domain socket
+#define METRICS_UNIX_PREFIX "unix:"
+
+extern DeviceList g_devices;
+
+std::atomic<uint64_t> Metrics::s_enumerations(0);
+std::atomic<uint64_t> Metrics::s_enumeration_ns(0);
+std::atomic<uint64_t> Metrics::s_skeletal_evaluations(0);
+std::atomic<uint64_t> Metrics::s_skeletal_cache_hits(0);
+std::atomic<int32_t> Metrics::s_readers(0);
+
+void Metrics::Collect(GLOVE_METRICS& metrics)
+{
+	memset(&metrics, 0, sizeof(metrics));
+	for (Device* device : g_devices) {
+		if (metrics.dongle_count >= GLOVE_METRICS_MAX_DONGLES)
+			break;
+		device->GetMetrics(metrics.dongles[metrics.dongle_count++]);
+	}
+
+	metrics.readers = s_readers.load(std::memory_order_relaxed);
+	metrics.enumerations = s_enumerations.load(std::memory_order_relaxed);
+	metrics.enumeration_ns = s_enumeration_ns.load(std::memory_order_relaxed);
+	metrics.skeletal_evaluations = s_skeletal_evaluations.load(std::memory_order_relaxed);
+	metrics.skeletal_cache_hits = s_skeletal_cache_hits.load(std::memory_order_relaxed);
+}
+
+static void Header(std::string& text, const char* name, const char* type, const char* help)
+{
+	char line[256];
+	snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+	text += line;
+}
+
+static void Sample(std::string& text, const char* name, const char* labels, double value)
+{
+	char line[256];
+	snprintf(line, sizeof(line), "%s%s %.9g\n", name, labels, value);
+	text += line;
+}
+
+void Metrics::Format(const GLOVE_METRICS& metrics, std::string& text)
+{
+	static const char* hands[2] = { "left", "right" };
+	char labels[64];
+	text.clear();
+
+	Header(text, "manus_packets_total", "counter", "Reports received from a glove.");
+	for (uint32_t d = 0; d < metrics.dongle_count; d++) {
+		for (int h = 0; h < 2; h++) {
+			snprintf(labels, sizeof(labels), "{dongle=\"%u\",hand=\"%s\"}", d, hands[h]);
+			Sample(text, "manus_packets_total", labels, (double)metrics.dongles[d].packets[h]);
+		}
+	}
+	Header(text, "manus_packets_per_second", "gauge", "Reports received from a glove in the last second.");
+	for (uint32_t d = 0; d < metrics.dongle_count; d++) {
+		for (int h = 0; h < 2; h++) {
+			snprintf(labels, sizeof(labels), "{dongle=\"%u\",hand=\"%s\"}", d, hands[h]);
+			Sample(text, "manus_packets_per_second", labels, metrics.dongles[d].packets_per_second[h]);
+		}
+	}
+	Header(text, "manus_jitter_seconds", "gauge", "Smoothed variation of the time between reports.");
+	for (uint32_t d = 0; d < metrics.dongle_count; d++) {
+		for (int h = 0; h < 2; h++) {
+			snprintf(labels, sizeof(labels), "{dongle=\"%u\",hand=\"%s\"}", d, hands[h]);
+			Sample(text, "manus_jitter_seconds", labels, metrics.dongles[d].jitter_ns[h] * 1e-9);
+		}
+	}
+
+	Header(text, "manus_decode_seconds", "gauge", "Mean time to decode a report.");
+	for (uint32_t d = 0; d < metrics.dongle_count; d++) {
+		snprintf(labels, sizeof(labels), "{dongle=\"%u\"}", d);
+		Sample(text, "manus_decode_seconds", labels, metrics.dongles[d].decode_ns * 1e-9);
+	}
+	Header(text, "manus_queue_depth", "gauge", "Messages waiting to be written to a dongle.");
+	for (uint32_t d = 0; d < metrics.dongle_count; d++) {
+		snprintf(labels, sizeof(labels), "{dongle=\"%u\"}", d);
+		Sample(text, "manus_queue_depth", labels, metrics.dongles[d].queue_depth);
+	}
+	Header(text, "manus_dropped_commands_total", "counter", "Messages dropped because the queue of a dongle was full.");
+	for (uint32_t d = 0; d < metrics.dongle_count; d++) {
+		snprintf(labels, sizeof(labels), "{dongle=\"%u\"}", d);
+		Sample(text, "manus_dropped_commands_total", labels, (double)metrics.dongles[d].dropped_commands);
+	}
+	Header(text, "manus_reconnects_total", "counter", "Times a dongle was opened again after it was lost.");
+	for (uint32_t d = 0; d < metrics.dongle_count; d++) {
+		snprintf(labels, sizeof(labels), "{dongle=\"%u\"}", d);
+		Sample(text, "manus_reconnects_total", labels, metrics.dongles[d].reconnects);
+	}
+
+	Header(text, "manus_readers", "gauge", "Threads reading glove data.");
+	Sample(text, "manus_readers", "", metrics.readers);
+	Header(text, "manus_enumerations_total", "counter", "Scans for dongles.");
+	Sample(text, "manus_enumerations_total", "", (double)metrics.enumerations);
+	Header(text, "manus_enumeration_seconds", "gauge", "Duration of the last scan for dongles.");
+	Sample(text, "manus_enumeration_seconds", "", metrics.enumeration_ns * 1e-9);
+	Header(text, "manus_skeletal_evaluations_total", "counter", "Skeletal models computed.");
+	Sample(text, "manus_skeletal_evaluations_total", "", (double)metrics.skeletal_evaluations);
+	Header(text, "manus_skeletal_cache_hits_total", "counter", "Skeletal models served from the cache.");
+	Sample(text, "manus_skeletal_cache_hits_total", "", (double)metrics.skeletal_cache_hits);
+}
+
+static bool WriteSocket(const char* path, const std::string& text)
+{
+#ifdef _WIN32
+	return false;
+#else
+	struct sockaddr_un address;
+	if (strlen(path) >= sizeof(address.sun_path))
+		return false;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, path);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		return false;
+	bool ok = connect(fd, (struct sockaddr*)&address, sizeof(address)) == 0;
+	for (size_t sent = 0; ok && sent < text.size();) {
+		ssize_t n = send(fd, text.data() + sent, text.size() - sent, MSG_NOSIGNAL);
+		ok = n > 0;
+		sent += ok ? n : 0;
+	}
+	close(fd);
+	return ok;
+#endif
+}
+
+static bool WriteFile(const char* path, const std::string& text)
+{
+	// Written next to the target and renamed over it
+	std::string temp = std::string(path) + ".tmp";
+	FILE* file = fopen(temp.c_str(), "wb");
+	if (!file)
+		return false;
+	bool ok = fwrite(text.data(), 1, text.size(), file) == text.size();
+	ok = fclose(file) == 0 && ok;
+#ifdef _WIN32
+	// rename doesn't replace an existing file on Windows
+	if (ok)
+		remove(path);
+#endif
+	if (!ok || rename(temp.c_str(), path) != 0) {
+		remove(temp.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool Metrics::Write(const char* target)
+{
+	GLOVE_METRICS metrics;
+	Collect(metrics);
+	std::string text;
+	Format(metrics, text);
+
+	size_t prefix = strlen(METRICS_UNIX_PREFIX);
+	if (strncmp(target, METRICS_UNIX_PREFIX, prefix) == 0)
+		return WriteSocket(target + prefix, text);
+	return WriteFile(target, text);
+}
@@ -0,0 +1,55 @@
+/*
+   Copyright 2015 Manus VR
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+
+#pragma once
+
+#include "Manus.h"
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+
+// Counters of the SDK as a whole, see ManusGetMetrics().
+// The hot paths only do relaxed atomic adds, the counters of the devices
+// are collected when the metrics are read.
+class Metrics
+{
+public:
+	static std::atomic<uint64_t> s_enumerations;
+	static std::atomic<uint64_t> s_enumeration_ns;
+	static std::atomic<uint64_t> s_skeletal_evaluations;
+	static std::atomic<uint64_t> s_skeletal_cache_hits;
+	static std::atomic<int32_t> s_readers;
+
+	static void Add(std::atomic<uint64_t>& counter, uint64_t value = 1) {
+		counter.fetch_add(value, std::memory_order_relaxed);
+	}
+
+	static void Collect(GLOVE_METRICS& metrics);
+	/*! \brief Format the metrics in the Prometheus text exposition format. */
+	static void Format(const GLOVE_METRICS& metrics, std::string& text);
+	/*! \brief Write the metrics to a file, or a Unix socket for a "unix:" target. */
+	static bool Write(const char* target);
+};
+
+// Counts a thread as a reader while it's in scope
+class MetricsReader
+{
+public:
+	MetricsReader() { Metrics::s_readers.fetch_add(1, std::memory_order_relaxed); }
+	~MetricsReader() { Metrics::s_readers.fetch_sub(1, std::memory_order_relaxed); }
+};
@@ -0,0 +1,109 @@
+/*
+   Copyright 2015 Manus VR
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include "stdafx.h"
+#include "MotionPredictor.h"
+#include "ManusMath.h"
+
+#include <string.h>
+
+MotionPredictor::MotionPredictor()
+{
+	Reset();
+}
+
+void MotionPredictor::Reset()
+{
+	memset(m_history, 0, sizeof(m_history));
+	memset(&m_last, 0, sizeof(m_last));
+	memset(&m_angular_velocity, 0, sizeof(m_angular_velocity));
+	memset(m_finger_velocity, 0, sizeof(m_finger_velocity));
+	m_last.Quaternion.w = 1.0f;
+	m_last_timestamp = 0;
+	m_count = 0;
+	m_head = 0;
+}
+
+void MotionPredictor::Update(const GLOVE_DATA& data, uint64_t timestamp)
+{
+	// Start over after a gap, the old samples say nothing about the current motion
+	if (m_count && (timestamp <= m_last_timestamp || timestamp - m_last_timestamp > PREDICTION_MAX_GAP_NS))
+		Reset();
+
+	m_last = data;
+	m_last_timestamp = timestamp;
+
+	SAMPLE& sample = m_history[m_head];
+	sample.quat = data.Quaternion;
+	memcpy(sample.fingers, data.Fingers, sizeof(sample.fingers));
+	sample.timestamp = timestamp;
+
+	m_head = (m_head + 1) % PREDICTION_HISTORY;
+	if (m_count < PREDICTION_HISTORY)
+		m_count++;
+
+	if (m_count < 2)
+		return;
+
+	// Finite difference against the oldest sample in the history,
+	// spreading the difference over several samples reduces the noise.
+	const SAMPLE& oldest = m_history[(m_head + PREDICTION_HISTORY - m_count) % PREDICTION_HISTORY];
+	float dt = (timestamp - oldest.timestamp) / 1e9f;
+
+	// Rotation from the oldest to the newest sample in the frame of the glove
+	GLOVE_QUATERNION delta = ManusMath::QuaternionMultiply(ManusMath::QuaternionConjugate(oldest.quat), data.Quaternion);
+	GLOVE_VECTOR rotation = ManusMath::QuaternionToRotationVector(delta);
+	m_angular_velocity.x = rotation.x / dt;
+	m_angular_velocity.y = rotation.y / dt;
+	m_angular_velocity.z = rotation.z / dt;
+
+	for (int i = 0; i < 5; i++)
+		m_finger_velocity[i] = (data.Fingers[i] - oldest.fingers[i]) / dt;
+}
+
+bool MotionPredictor::Predict(GLOVE_DATA* data, uint64_t target_time) const
+{
+	if (!m_count)
+		return false;
+
+	*data = m_last;
+
+	// Clamp the prediction horizon, never extrapolate backwards
+	if (target_time <= m_last_timestamp || m_count < 2)
+		return true;
+	uint64_t horizon_ns = target_time - m_last_timestamp;
+	if (horizon_ns > PREDICTION_MAX_HORIZON_NS)
+		horizon_ns = PREDICTION_MAX_HORIZON_NS;
+	float horizon = horizon_ns / 1e9f;
+
+	// Integrate the angular velocity over the horizon
+	GLOVE_VECTOR rotation;
+	rotation.x = m_angular_velocity.x * horizon;
+	rotation.y = m_angular_velocity.y * horizon;
+	rotation.z = m_angular_velocity.z * horizon;
+	data->Quaternion = ManusMath::QuaternionMultiply(m_last.Quaternion, ManusMath::QuaternionFromRotationVector(rotation));
+
+	for (int i = 0; i < 5; i++) {
+		float finger = m_last.Fingers[i] + m_finger_velocity[i] * horizon;
+		if (finger < 0.0f) finger = 0.0f;
+		if (finger > 1.0f) finger = 1.0f;
+		data->Fingers[i] = finger;
+	}
+
+	ManusMath::GetEuler(&data->Euler, &data->Quaternion);
+
+	return true;
+}
@@ -0,0 +1,72 @@
+/*
+   Copyright 2015 Manus VR
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include "Manus.h"
+
+// Number of samples kept to estimate the velocities
+#define PREDICTION_HISTORY 4
+// Never extrapolate further than this into the future
+#define PREDICTION_MAX_HORIZON_NS 100000000ULL
+// Samples further apart than this are not used for velocity estimation
+#define PREDICTION_MAX_GAP_NS 250000000ULL
+
+class MotionPredictor
+{
+private:
+	typedef struct {
+		GLOVE_QUATERNION quat;
+		float fingers[5];
+		uint64_t timestamp;
+	} SAMPLE;
+
+	SAMPLE m_history[PREDICTION_HISTORY];
+	unsigned int m_count;
+	unsigned int m_head;
+
+	GLOVE_DATA m_last;
+	uint64_t m_last_timestamp;
+
+	// Angular velocity in radians per second, in the frame of the glove
+	GLOVE_VECTOR m_angular_velocity;
+	// Finger bend velocity in normalized units per second
+	float m_finger_velocity[5];
+
+public:
+	MotionPredictor();
+
+	void Reset();
+
+	/*! \brief Add a decoded sample and update the velocity estimates.
+	*
+	*  Called from the device thread at sensor rate.
+	*
+	*  \param data The freshly decoded glove data.
+	*  \param timestamp Time at which the sample was received in nanoseconds.
+	*/
+	void Update(const GLOVE_DATA& data, uint64_t timestamp);
+
+	/*! \brief Extrapolate the last sample to the target time.
+	*
+	*  The horizon is clamped to [0, PREDICTION_MAX_HORIZON_NS], a target
+	*  time in the past returns the last sample unmodified.
+	*
+	*  \param data Output variable to receive the predicted data.
+	*  \param target_time Time to predict for in nanoseconds.
+	*/
+	bool Predict(GLOVE_DATA* data, uint64_t target_time) const;
+};
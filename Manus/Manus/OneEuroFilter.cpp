@@ -0,0 +1,101 @@
+/*
+   Copyright 2015 Manus VR
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include "stdafx.h"
+#include "OneEuroFilter.h"
+#include "ManusMath.h"
+
+#include <math.h>
+
+// Smoothing factor of an exponential filter with the given cutoff frequency
+static float SmoothingFactor(float cutoff, float dt)
+{
+	float tau = 1.0f / (2.0f * 3.14159265f * cutoff);
+	return 1.0f / (1.0f + tau / dt);
+}
+
+OneEuroFilter::OneEuroFilter()
+{
+	Reset();
+}
+
+void OneEuroFilter::Reset()
+{
+	m_value = 0.0f;
+	m_derivative = 0.0f;
+	m_initialized = false;
+}
+
+float OneEuroFilter::Filter(float value, float dt, const GLOVE_FILTER_PARAMS& params)
+{
+	if (!m_initialized || dt <= 0.0f) {
+		m_value = value;
+		m_derivative = 0.0f;
+		m_initialized = true;
+		return value;
+	}
+
+	// Filter the derivative to get a stable estimate of the speed
+	float derivative = (value - m_value) / dt;
+	m_derivative += SmoothingFactor(params.d_cutoff, dt) * (derivative - m_derivative);
+
+	// Raise the cutoff with the speed to reduce lag during fast movements
+	float cutoff = params.min_cutoff + params.beta * fabsf(m_derivative);
+	m_value += SmoothingFactor(cutoff, dt) * (value - m_value);
+
+	return m_value;
+}
+
+OrientationFilter::OrientationFilter()
+{
+	Reset();
+}
+
+void OrientationFilter::Reset()
+{
+	m_value.w = 1.0f;
+	m_value.x = m_value.y = m_value.z = 0.0f;
+	m_speed = 0.0f;
+	m_initialized = false;
+}
+
+GLOVE_QUATERNION OrientationFilter::Filter(const GLOVE_QUATERNION& value, float dt, const GLOVE_FILTER_PARAMS& params)
+{
+	if (!m_initialized || dt <= 0.0f) {
+		m_value = value;
+		m_speed = 0.0f;
+		m_initialized = true;
+		return value;
+	}
+
+	// Rotation from the filtered orientation to the new sample
+	GLOVE_QUATERNION delta = ManusMath::QuaternionMultiply(ManusMath::QuaternionConjugate(m_value), value);
+	GLOVE_VECTOR rotation = ManusMath::QuaternionToRotationVector(delta);
+	float angle = sqrtf(rotation.x * rotation.x + rotation.y * rotation.y + rotation.z * rotation.z);
+
+	m_speed += SmoothingFactor(params.d_cutoff, dt) * (angle / dt - m_speed);
+
+	float cutoff = params.min_cutoff + params.beta * m_speed;
+	float alpha = SmoothingFactor(cutoff, dt);
+
+	// Move the filtered orientation a fraction of the way towards the sample
+	rotation.x *= alpha;
+	rotation.y *= alpha;
+	rotation.z *= alpha;
+	m_value = ManusMath::QuaternionMultiply(m_value, ManusMath::QuaternionFromRotationVector(rotation));
+
+	return m_value;
+}
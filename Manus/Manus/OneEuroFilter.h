@@ -0,0 +1,61 @@
+/*
+   Copyright 2015 Manus VR
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include "Manus.h"
+
+// Adaptive low-pass filter as described in "1 Euro Filter: A Simple Speed-based
+// Low-pass Filter for Noisy Input in Interactive Systems" (Casiez et al. 2012).
+// The cutoff frequency rises with the speed of the signal, so slow movements
+// are smoothed heavily while fast movements get little added latency.
+class OneEuroFilter
+{
+private:
+	float m_value;
+	float m_derivative;
+	bool m_initialized;
+
+public:
+	OneEuroFilter();
+
+	void Reset();
+
+	/*! \brief Filter a new sample.
+	*
+	*  \param value The raw sample.
+	*  \param dt Time since the previous sample in seconds.
+	*  \param params The filter parameters.
+	*/
+	float Filter(float value, float dt, const GLOVE_FILTER_PARAMS& params);
+};
+
+// One Euro filter applied to an orientation, the speed is taken from
+// the angular velocity and the smoothing is done by interpolating on the
+// unit sphere so the output stays a unit quaternion.
+class OrientationFilter
+{
+private:
+	GLOVE_QUATERNION m_value;
+	float m_speed;
+	bool m_initialized;
+
+public:
+	OrientationFilter();
+
+	void Reset();
+	GLOVE_QUATERNION Filter(const GLOVE_QUATERNION& value, float dt, const GLOVE_FILTER_PARAMS& params);
+};
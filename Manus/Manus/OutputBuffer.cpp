@@ -0,0 +1,86 @@
+/*
+   Copyright 2015 Manus VR
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include "stdafx.h"
+#include "OutputBuffer.h"
+#ifndef MANUS_NO_SKELETAL
+#include "SkeletalModel.h"
+#endif
+
+#include <string.h>
+
+#ifndef MANUS_NO_SKELETAL
+extern SkeletalModel g_skeletal;
+#endif
+
+static_assert(offsetof(GLOVE_OUTPUT_BUFFER, skeletal) % sizeof(uint32_t) == 0, "GLOVE_OUTPUT_BUFFER must be made of 32 bit words");
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "the output buffer is written through 32 bit atomics");
+
+std::mutex OutputBuffer::s_mutex[2];
+std::atomic<uint32_t>* OutputBuffer::s_words[2];
+GLOVE_OUTPUT_LAYOUT OutputBuffer::s_layout[2];
+std::atomic<bool> OutputBuffer::s_bound[2];
+
+size_t OutputBuffer::Size(GLOVE_OUTPUT_LAYOUT layout)
+{
+	return offsetof(GLOVE_OUTPUT_BUFFER, skeletal) + (layout == GLOVE_OUTPUT_SKELETAL ? sizeof(GLOVE_SKELETAL) : 0);
+}
+
+void OutputBuffer::Bind(GLOVE_HAND hand, void* memory, GLOVE_OUTPUT_LAYOUT layout)
+{
+	std::lock_guard<std::mutex> lk(s_mutex[hand]);
+	s_words[hand] = (std::atomic<uint32_t>*)memory;
+	s_layout[hand] = layout;
+	s_bound[hand] = memory != NULL;
+
+	// Version 0 tells the application there's no sample yet
+	if (memory) {
+		size_t count = Size(layout) / sizeof(uint32_t);
+		for (size_t i = 0; i < count; i++)
+			s_words[hand][i].store(0, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+	}
+}
+
+void OutputBuffer::Publish(GLOVE_HAND hand, const GLOVE_DATA& data, uint64_t read_time)
+{
+	std::lock_guard<std::mutex> lk(s_mutex[hand]);
+	std::atomic<uint32_t>* words = s_words[hand];
+	if (!words)
+		return;
+
+	// Everything is prepared before the version goes odd, so readers retry as little as possible
+	GLOVE_OUTPUT_BUFFER sample;
+	sample.version = 0;
+	sample.reserved = 0;
+	sample.timestamp = read_time;
+	sample.data = data;
+#ifndef MANUS_NO_SKELETAL
+	if (s_layout[hand] == GLOVE_OUTPUT_SKELETAL && !g_skeletal.Simulate(data, &sample.skeletal, hand))
+		memset(&sample.skeletal, 0, sizeof(sample.skeletal));
+#endif
+
+	uint32_t source[sizeof(GLOVE_OUTPUT_BUFFER) / sizeof(uint32_t)];
+	memcpy(source, &sample, sizeof(sample));
+	size_t count = Size(s_layout[hand]) / sizeof(uint32_t);
+
+	uint32_t version = words[0].load(std::memory_order_relaxed);
+	words[0].store(version + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	for (size_t i = 1; i < count; i++)
+		words[i].store(source[i], std::memory_order_relaxed);
+	words[0].store(version + 2, std::memory_order_release);
+}
@@ -0,0 +1,51 @@
+/*
+   Copyright 2015 Manus VR
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include "Manus.h"
+
+#include <atomic>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+
+// Writes the samples of a hand into a buffer owned by the application.
+// The buffer is written as 32 bit words under a version word that's odd
+// during the write, the same protocol as the Seqlock, so the application
+// reads it with ManusReadOutputBuffer() without calling into the SDK.
+class OutputBuffer
+{
+private:
+	// Two dongles can receive the same hand, and unbinding waits for a write in progress
+	static std::mutex s_mutex[2];
+	static std::atomic<uint32_t>* s_words[2];
+	static GLOVE_OUTPUT_LAYOUT s_layout[2];
+	// Read without the lock, so threads without a buffer skip it
+	static std::atomic<bool> s_bound[2];
+
+public:
+	/*! \brief Size of a buffer with the layout. */
+	static size_t Size(GLOVE_OUTPUT_LAYOUT layout);
+
+	/*! \brief Bind a buffer to the hand, NULL unbinds. */
+	static void Bind(GLOVE_HAND hand, void* memory, GLOVE_OUTPUT_LAYOUT layout);
+
+	static bool IsBound(GLOVE_HAND hand) { return s_bound[hand].load(std::memory_order_relaxed); }
+
+	/*! \brief Write a sample, called from the thread that received it. */
+	static void Publish(GLOVE_HAND hand, const GLOVE_DATA& data, uint64_t read_time);
+};
@@ -0,0 +1,403 @@
+/*
+   Copyright 2015 Manus VR
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include "stdafx.h"
+#include "PoseCodec.h"
+
+#include <string.h>
+#include <math.h>
+
+// Layout of the tag byte that starts every record
+#define TAG_SLOT_MASK     0x03
+#define TAG_SOURCE        0x04 // the source differs from the previous record
+#define TAG_QUAT          0x08
+#define TAG_ACCEL         0x10
+#define TAG_FINGERS       0x20
+#define TAG_STATUS        0x40 // flags and rssi
+#define TAG_GAP           0x80 // reports were lost, a count follows instead of a report
+
+#define QUAT_SCALE 16384.0f
+#define QUAT_RANGE 0.70710678f // largest value of the three smallest components
+
+static inline uint64_t ZigZag(int64_t value)
+{
+	return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static inline int64_t UnZigZag(uint64_t value)
+{
+	return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+static inline uint8_t* PutVarint(uint8_t* out, uint64_t value)
+{
+	while (value >= 0x80) {
+		*out++ = (uint8_t)(value | 0x80);
+		value >>= 7;
+	}
+	*out++ = (uint8_t)value;
+	return out;
+}
+
+static inline const uint8_t* GetVarint(const uint8_t* in, const uint8_t* end, uint64_t& value)
+{
+	value = 0;
+	for (int shift = 0; shift < 64 && in < end; shift += 7) {
+		uint8_t byte = *in++;
+		value |= (uint64_t)(byte & 0x7F) << shift;
+		if (!(byte & 0x80))
+			return in;
+	}
+	return NULL;
+}
+
+PoseEncoder::PoseEncoder()
+	: m_file(NULL), m_size(0), m_records(0), m_last_source(0), m_bytes(0)
+{
+}
+
+bool PoseEncoder::Open(FILE* file)
+{
+	m_file = file;
+	m_size = 0;
+	m_records = 0;
+	m_channels.clear();
+	m_channels.reserve(64);
+
+	POSE_ARCHIVE_HEADER header;
+	header.magic = POSE_ARCHIVE_MAGIC;
+	header.version = POSE_ARCHIVE_VERSION;
+	header.quat_bits = POSE_QUAT_BITS;
+	header.reserved = 0;
+	m_bytes = fwrite(&header, sizeof(header), 1, m_file) * sizeof(header);
+	return m_bytes == sizeof(header);
+}
+
+POSE_CHANNEL& PoseEncoder::Channel(uint16_t source, uint8_t slot)
+{
+	// A handful of gloves, a linear search beats hashing
+	for (POSE_CHANNEL& channel : m_channels)
+		if (channel.source == source && channel.slot == slot)
+			return channel;
+
+	POSE_CHANNEL channel;
+	memset(&channel, 0, sizeof(channel));
+	channel.source = source;
+	channel.slot = slot;
+	m_channels.push_back(channel);
+	return m_channels.back();
+}
+
+bool PoseEncoder::Reserve()
+{
+	if (m_size + POSE_MAX_RECORD <= POSE_BLOCK_SIZE)
+		return true;
+	return Flush();
+}
+
+bool PoseEncoder::Flush()
+{
+	if (!m_records)
+		return true;
+
+	POSE_BLOCK_HEADER header;
+	header.size = (uint32_t)m_size;
+	header.records = m_records;
+	bool ok = fwrite(&header, sizeof(header), 1, m_file) == 1 &&
+		fwrite(m_block, 1, m_size, m_file) == m_size;
+	m_bytes += sizeof(header) + m_size;
+
+	m_size = 0;
+	m_records = 0;
+	m_channels.clear();
+	return ok;
+}
+
+uint64_t PoseEncoder::QuantizeQuaternion(const int16_t quat[GLOVE_QUATS])
+{
+	float q[GLOVE_QUATS];
+	float norm = 0.0f;
+	for (int i = 0; i < GLOVE_QUATS; i++) {
+		q[i] = quat[i] / QUAT_SCALE;
+		norm += q[i] * q[i];
+	}
+	if (norm <= 0.0f)
+		return 0;
+	norm = 1.0f / sqrtf(norm);
+
+	int largest = 0;
+	for (int i = 1; i < GLOVE_QUATS; i++)
+		if (fabsf(q[i]) > fabsf(q[largest]))
+			largest = i;
+
+	// q and -q are the same rotation, flip so the dropped component is positive
+	if (q[largest] < 0.0f)
+		norm = -norm;
+
+	const uint32_t max = (1u << POSE_QUAT_BITS) - 1;
+	uint64_t code = (uint64_t)largest;
+	for (int i = 0; i < GLOVE_QUATS; i++) {
+		if (i == largest)
+			continue;
+		float value = (q[i] * norm + QUAT_RANGE) / (2.0f * QUAT_RANGE);
+		int32_t level = (int32_t)(value * max + 0.5f);
+		if (level < 0) level = 0;
+		if (level > (int32_t)max) level = (int32_t)max;
+		code = (code << POSE_QUAT_BITS) | (uint64_t)level;
+	}
+	return code;
+}
+
+void PoseEncoder::DequantizeQuaternion(uint64_t code, int16_t quat[GLOVE_QUATS])
+{
+	const uint32_t max = (1u << POSE_QUAT_BITS) - 1;
+	int largest = (int)(code >> (3 * POSE_QUAT_BITS));
+
+	float q[GLOVE_QUATS];
+	float sum = 0.0f;
+	for (int i = GLOVE_QUATS - 1; i >= 0; i--) {
+		if (i == largest)
+			continue;
+		q[i] = (code & max) / (float)max * (2.0f * QUAT_RANGE) - QUAT_RANGE;
+		code >>= POSE_QUAT_BITS;
+		sum += q[i] * q[i];
+	}
+	q[largest] = sum < 1.0f ? sqrtf(1.0f - sum) : 0.0f;
+
+	for (int i = 0; i < GLOVE_QUATS; i++)
+		quat[i] = (int16_t)lrintf(fminf(fmaxf(q[i] * QUAT_SCALE, -32768.0f), 32767.0f));
+}
+
+bool PoseEncoder::Encode(uint16_t source, uint64_t timestamp, const GLOVE_REPORT& report)
+{
+	uint8_t slot = report.device_id - DEVICE_TYPE_LOW;
+	if (slot >= DEVICE_TYPE_COUNT || !Reserve())
+		return false;
+
+	POSE_CHANNEL& channel = Channel(source, slot);
+	const GLOVE_REPORT& last = channel.report;
+	uint64_t quat = QuantizeQuaternion(report.quat);
+
+	uint8_t* start = m_block + m_size;
+	uint8_t* out = start + 1;
+	uint8_t tag = slot;
+
+	if (source != m_last_source || !m_records) {
+		tag |= TAG_SOURCE;
+		out = PutVarint(out, source);
+		m_last_source = source;
+	}
+
+	// The first report of a glove in a block carries the full time
+	uint64_t timestamp_us = timestamp / 1000;
+	if (channel.count)
+		out = PutVarint(out, ZigZag((int64_t)(timestamp_us - channel.timestamp_us)));
+	else
+		out = PutVarint(out, timestamp_us);
+	channel.timestamp_us = timestamp_us;
+
+	if (!channel.count || quat != channel.quat) {
+		tag |= TAG_QUAT;
+		for (int shift = 0; shift < 3 * POSE_QUAT_BITS + 2; shift += 8)
+			*out++ = (uint8_t)(quat >> shift);
+		channel.quat = quat;
+	}
+
+	if (!channel.count || memcmp(report.accel, last.accel, sizeof(report.accel))) {
+		tag |= TAG_ACCEL;
+		for (int i = 0; i < GLOVE_AXES; i++)
+			out = PutVarint(out, ZigZag((int64_t)report.accel[i] - last.accel[i]));
+	}
+
+	if (!channel.count || memcmp(report.fingers, last.fingers, sizeof(report.fingers))) {
+		// One bit per finger that changed, followed by the changes wrapped to a byte
+		tag |= TAG_FINGERS;
+		uint8_t* mask = out++;
+		*mask = 0;
+		for (int i = 0; i < GLOVE_FINGERS; i++) {
+			if (report.fingers[i] != last.fingers[i]) {
+				*mask |= 1 << i;
+				*out++ = (uint8_t)ZigZag((int8_t)(report.fingers[i] - last.fingers[i]));
+			}
+		}
+	}
+
+	if (!channel.count || report.flags != last.flags || report.rssi != last.rssi) {
+		tag |= TAG_STATUS;
+		*out++ = report.flags;
+		out = PutVarint(out, ZigZag((int64_t)report.rssi - last.rssi));
+	}
+
+	*start = tag;
+	channel.report = report;
+	channel.count++;
+	m_size = out - m_block;
+	m_records++;
+	return true;
+}
+
+bool PoseEncoder::EncodeGap(uint16_t source, uint32_t count)
+{
+	if (!Reserve())
+		return false;
+
+	uint8_t* out = m_block + m_size;
+	*out++ = TAG_GAP | TAG_SOURCE;
+	out = PutVarint(out, source);
+	out = PutVarint(out, count);
+	m_last_source = source;
+	m_size = out - m_block;
+	m_records++;
+	return true;
+}
+
+bool PoseDecoder::DecodeBlock(const uint8_t* data, size_t size, uint32_t records, std::vector<POSE_COUNTER>& counters,
+	REPORT_CALLBACK callback, void* user_data)
+{
+	std::vector<POSE_CHANNEL> channels;
+	const uint8_t* in = data;
+	const uint8_t* end = data + size;
+	uint16_t source = 0;
+	uint64_t value;
+
+	for (uint32_t r = 0; r < records; r++) {
+		if (in >= end)
+			return false;
+		uint8_t tag = *in++;
+
+		if (tag & TAG_SOURCE) {
+			if (!(in = GetVarint(in, end, value)))
+				return false;
+			source = (uint16_t)value;
+		}
+
+		// Lost reports leave a gap in the timestamps, there's nothing to report
+		if (tag & TAG_GAP) {
+			if (!(in = GetVarint(in, end, value)))
+				return false;
+			continue;
+		}
+
+		uint8_t slot = tag & TAG_SLOT_MASK;
+		POSE_CHANNEL* channel = NULL;
+		for (POSE_CHANNEL& c : channels)
+			if (c.source == source && c.slot == slot)
+				channel = &c;
+		if (!channel) {
+			POSE_CHANNEL c;
+			memset(&c, 0, sizeof(c));
+			c.source = source;
+			c.slot = slot;
+			c.report.device_id = (device_type_t)(DEVICE_TYPE_LOW + slot);
+			channels.push_back(c);
+			channel = &channels.back();
+		}
+		GLOVE_REPORT& report = channel->report;
+
+		if (!(in = GetVarint(in, end, value)))
+			return false;
+		channel->timestamp_us = channel->count ? channel->timestamp_us + UnZigZag(value) : value;
+
+		if (tag & TAG_QUAT) {
+			const int bytes = (3 * POSE_QUAT_BITS + 2 + 7) / 8;
+			if (end - in < bytes)
+				return false;
+			uint64_t quat = 0;
+			for (int i = 0; i < bytes; i++)
+				quat |= (uint64_t)*in++ << (8 * i);
+			PoseEncoder::DequantizeQuaternion(quat, report.quat);
+		} else if (!channel->count) {
+			return false;
+		}
+
+		if (tag & TAG_ACCEL) {
+			for (int i = 0; i < GLOVE_AXES; i++) {
+				if (!(in = GetVarint(in, end, value)))
+					return false;
+				report.accel[i] = (int16_t)(report.accel[i] + UnZigZag(value));
+			}
+		}
+
+		if (tag & TAG_FINGERS) {
+			if (in >= end)
+				return false;
+			uint8_t mask = *in++;
+			for (int i = 0; i < GLOVE_FINGERS; i++) {
+				if (!(mask & (1 << i)))
+					continue;
+				if (in >= end)
+					return false;
+				report.fingers[i] = (uint8_t)(report.fingers[i] + UnZigZag(*in++));
+			}
+		}
+
+		if (tag & TAG_STATUS) {
+			if (in >= end)
+				return false;
+			report.flags = *in++;
+			if (!(in = GetVarint(in, end, value)))
+				return false;
+			report.rssi = (int32_t)(report.rssi + UnZigZag(value));
+		}
+
+		channel->count++;
+		POSE_COUNTER* counter = NULL;
+		for (POSE_COUNTER& c : counters)
+			if (c.source == source && c.slot == slot)
+				counter = &c;
+		if (!counter) {
+			POSE_COUNTER c = { source, slot, 0 };
+			counters.push_back(c);
+			counter = &counters.back();
+		}
+		counter->count++;
+
+		GLOVE_RAW_REPORT raw;
+		raw.timestamp = channel->timestamp_us * 1000;
+		raw.packet_number = counter->count;
+		memcpy(&raw.device_type, &report, sizeof(GLOVE_REPORT));
+		callback(source, raw, user_data);
+	}
+	return in == end;
+}
+
+bool PoseDecoder::Read(const char* path, REPORT_CALLBACK callback, void* user_data)
+{
+	FILE* file = fopen(path, "rb");
+	if (!file)
+		return false;
+
+	m_counters.clear();
+	POSE_ARCHIVE_HEADER header;
+	bool ok = fread(&header, sizeof(header), 1, file) == 1 && header.magic == POSE_ARCHIVE_MAGIC &&
+		header.version == POSE_ARCHIVE_VERSION && header.quat_bits == POSE_QUAT_BITS;
+
+	std::vector<uint8_t> block;
+	POSE_BLOCK_HEADER block_header;
+	while (ok && fread(&block_header, sizeof(block_header), 1, file) == 1) {
+		// The encoder never writes larger blocks, anything else is corrupt
+		if (block_header.size > POSE_BLOCK_SIZE) {
+			ok = false;
+			break;
+		}
+		block.resize(block_header.size);
+		ok = fread(block.data(), 1, block.size(), file) == block.size() &&
+			DecodeBlock(block.data(), block.size(), block_header.records, m_counters, callback, user_data);
+	}
+
+	fclose(file);
+	return ok;
+}
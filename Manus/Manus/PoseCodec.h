@@ -0,0 +1,125 @@
+/*
+   Copyright 2015 Manus VR
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include "Manus.h"
+#include "Device.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+#define POSE_ARCHIVE_MAGIC 0x41504E4D // "MNPA"
+#define POSE_ARCHIVE_VERSION 1
+// Bits per quaternion component, the three smallest components are stored
+#define POSE_QUAT_BITS 12
+// Encoded records are collected in blocks of this size, the coding state
+// starts over in every block so blocks can be decoded on their own
+#define POSE_BLOCK_SIZE (64 * 1024)
+// Largest encoded record: tag, source, timestamp, quaternion, accel, fingers, flags and rssi
+#define POSE_MAX_RECORD 64
+
+#pragma pack(push, 1) // stored as is in the archive
+typedef struct {
+	uint32_t magic;
+	uint16_t version;
+	uint8_t quat_bits;
+	uint8_t reserved;
+} POSE_ARCHIVE_HEADER;
+
+typedef struct {
+	uint32_t size;
+	uint32_t records;
+} POSE_BLOCK_HEADER;
+#pragma pack(pop)
+
+// Coding state of one glove, the previous report it sent
+typedef struct {
+	uint16_t source;
+	uint8_t slot;
+	uint64_t timestamp_us;
+	uint64_t quat;
+	GLOVE_REPORT report;
+	uint32_t count;
+} POSE_CHANNEL;
+
+// Compresses glove reports for long recordings.
+// Every report is coded against the previous report of the same glove:
+// the orientation as smallest-three quantized quaternion, the other fields
+// as deltas in variable length integers, and fields that didn't change not
+// at all. Only the orientation (to POSE_QUAT_BITS) and the timestamp (to
+// microseconds) are lossy. Encoding doesn't allocate and appends to a
+// fixed block buffer, so it runs in the capture writer at sensor rate.
+class PoseEncoder
+{
+private:
+	FILE* m_file;
+	uint8_t m_block[POSE_BLOCK_SIZE];
+	size_t m_size;
+	uint32_t m_records;
+	uint16_t m_last_source;
+	std::vector<POSE_CHANNEL> m_channels;
+	uint64_t m_bytes;
+
+	POSE_CHANNEL& Channel(uint16_t source, uint8_t slot);
+	bool Reserve();
+
+public:
+	PoseEncoder();
+
+	/*! \brief Write the archive header and encode into the file, which stays owned by the caller. */
+	bool Open(FILE* file);
+	bool Encode(uint16_t source, uint64_t timestamp, const GLOVE_REPORT& report);
+	/*! \brief Mark that reports of the source were lost. */
+	bool EncodeGap(uint16_t source, uint32_t count);
+	/*! \brief Write the current block, the next one starts with fresh state. */
+	bool Flush();
+
+	/*! \brief Bytes written to the file so far. */
+	uint64_t GetBytes() const { return m_bytes; }
+
+	static uint64_t QuantizeQuaternion(const int16_t quat[GLOVE_QUATS]);
+	static void DequantizeQuaternion(uint64_t code, int16_t quat[GLOVE_QUATS]);
+};
+
+// Number of reports of one glove decoded so far, unlike the coding state
+// it runs on across blocks
+typedef struct {
+	uint16_t source;
+	uint8_t slot;
+	uint32_t count;
+} POSE_COUNTER;
+
+// Decodes an archive written by PoseEncoder block by block.
+class PoseDecoder
+{
+public:
+	/*! \brief Called for every report, the packet number counts the reports of the glove in the archive. */
+	typedef void (*REPORT_CALLBACK)(uint16_t source, const GLOVE_RAW_REPORT& report, void* user_data);
+
+private:
+	std::vector<POSE_COUNTER> m_counters;
+
+public:
+	bool Read(const char* path, REPORT_CALLBACK callback, void* user_data);
+	/*! \brief Decode one block, returns false when it is corrupt.
+	*
+	*  The counters carry the packet numbers over from the previous blocks.
+	*/
+	static bool DecodeBlock(const uint8_t* data, size_t size, uint32_t records, std::vector<POSE_COUNTER>& counters,
+		REPORT_CALLBACK callback, void* user_data);
+};
@@ -0,0 +1,194 @@
+/*
+   Copyright 2015 Manus VR
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include "stdafx.h"
+#include "Recorder.h"
+#include "PoseCodec.h"
+
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+
+// Time the writer sleeps when all queues are empty
+#define CAPTURE_IDLE_MS 5
+
+std::mutex Recorder::s_mutex;
+std::vector<Recorder::Channel*> Recorder::s_channels;
+uint16_t Recorder::s_next_source = 0;
+std::atomic<bool> Recorder::s_recording(false);
+std::thread Recorder::s_thread;
+FILE* Recorder::s_file = NULL;
+char* Recorder::s_buffer = NULL;
+PoseEncoder* Recorder::s_encoder = NULL;
+std::atomic<uint64_t> Recorder::s_written(0);
+std::atomic<uint64_t> Recorder::s_dropped(0);
+
+Recorder::Channel::Channel()
+	: m_dropped(0), m_dropped_written(0)
+{
+	std::lock_guard<std::mutex> lk(s_mutex);
+	m_source = s_next_source++;
+	s_channels.push_back(this);
+}
+
+Recorder::Channel::~Channel()
+{
+	// The writer drains the channels under the same lock
+	std::lock_guard<std::mutex> lk(s_mutex);
+	s_channels.erase(std::remove(s_channels.begin(), s_channels.end(), this), s_channels.end());
+}
+
+bool Recorder::Start(const char* path, bool archive)
+{
+	std::lock_guard<std::mutex> lk(s_mutex);
+	if (s_file)
+		return false;
+
+	s_file = fopen(path, "wb");
+	if (!s_file)
+		return false;
+
+	// Large writes keep the number of system calls down
+	s_buffer = new char[CAPTURE_WRITE_BUFFER];
+	setvbuf(s_file, s_buffer, _IOFBF, CAPTURE_WRITE_BUFFER);
+
+	if (archive) {
+		s_encoder = new PoseEncoder();
+		s_encoder->Open(s_file);
+	} else {
+		CAPTURE_HEADER header;
+		header.magic = CAPTURE_MAGIC;
+		header.version = CAPTURE_VERSION;
+		header.record_size = sizeof(CAPTURE_RECORD);
+		fwrite(&header, sizeof(header), 1, s_file);
+	}
+
+	// Packets staged before the start belong to no capture
+	CAPTURE_RECORD record;
+	for (Channel* channel : s_channels) {
+		while (channel->m_queue.Pop(record));
+		channel->m_dropped_written = channel->m_dropped;
+	}
+
+	s_written = 0;
+	s_dropped = 0;
+	s_recording = true;
+	s_thread = std::thread(WriterThread);
+	return true;
+}
+
+void Recorder::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lk(s_mutex);
+		if (!s_file)
+			return;
+		s_recording = false;
+	}
+	if (s_thread.joinable())
+		s_thread.join();
+
+	std::lock_guard<std::mutex> lk(s_mutex);
+	delete s_encoder;
+	s_encoder = NULL;
+	fclose(s_file);
+	s_file = NULL;
+	delete[] s_buffer;
+	s_buffer = NULL;
+}
+
+void Recorder::GetStats(uint64_t &written, uint64_t &dropped)
+{
+	written = s_written;
+	dropped = s_dropped;
+}
+
+size_t Recorder::Drain(std::vector<CAPTURE_RECORD>& batch)
+{
+	std::lock_guard<std::mutex> lk(s_mutex);
+	batch.clear();
+
+	CAPTURE_RECORD record;
+	for (Channel* channel : s_channels) {
+		// Mark where packets were lost so readers can tell a gap from silence
+		uint32_t dropped = channel->m_dropped;
+		if (dropped != channel->m_dropped_written) {
+			uint32_t count = dropped - channel->m_dropped_written;
+			memset(&record, 0, sizeof(record));
+			record.timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now().time_since_epoch()).count();
+			record.source = channel->m_source;
+			record.direction = CAPTURE_DROPPED;
+			record.length = sizeof(count);
+			memcpy(record.data, &count, sizeof(count));
+			batch.push_back(record);
+			channel->m_dropped_written = dropped;
+			s_dropped += count;
+		}
+
+		// Bounded so one busy channel can't starve the others
+		for (size_t i = 0; i < CAPTURE_QUEUE_SIZE && channel->m_queue.Pop(record); i++)
+			batch.push_back(record);
+	}
+	return batch.size();
+}
+
+void Recorder::Write(const std::vector<CAPTURE_RECORD>& batch)
+{
+	if (!s_encoder) {
+		s_written += fwrite(batch.data(), sizeof(CAPTURE_RECORD), batch.size(), s_file);
+		return;
+	}
+
+	// The archive keeps the glove reports and where reports were lost
+	uint64_t written = 0;
+	for (const CAPTURE_RECORD& record : batch) {
+		if (record.direction == CAPTURE_DROPPED) {
+			uint32_t count;
+			memcpy(&count, record.data, sizeof(count));
+			written += s_encoder->EncodeGap(record.source, count);
+		} else if (record.direction == CAPTURE_IN && record.length >= sizeof(GLOVE_REPORT) &&
+			record.data[0] >= DEVICE_TYPE_LOW && record.data[0] < DEVICE_TYPE_LOW + DEVICE_TYPE_COUNT) {
+			GLOVE_REPORT report;
+			memcpy(&report, record.data, sizeof(report));
+			written += s_encoder->Encode(record.source, record.timestamp, report);
+		}
+	}
+	s_written += written;
+}
+
+void Recorder::WriterThread()
+{
+	std::vector<CAPTURE_RECORD> batch;
+	batch.reserve(CAPTURE_QUEUE_SIZE);
+
+	while (s_recording) {
+		if (!Drain(batch)) {
+			// Nothing staged, push out what's buffered while the disk is idle
+			fflush(s_file);
+			std::this_thread::sleep_for(std::chrono::milliseconds(CAPTURE_IDLE_MS));
+			continue;
+		}
+		Write(batch);
+	}
+
+	// Write what was staged before the stop
+	while (Drain(batch))
+		Write(batch);
+	if (s_encoder)
+		s_encoder->Flush();
+	fflush(s_file);
+}
@@ -0,0 +1,123 @@
+/*
+   Copyright 2015 Manus VR
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include "SpscQueue.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define CAPTURE_MAGIC 0x43534E4D // "MNSC"
+#define CAPTURE_VERSION 1
+// Largest packet stored in a record, fits an inbound report and a USB_OUT_PACKET
+#define CAPTURE_MAX_DATA 36
+// Records staged per device, a few seconds of traffic to ride out disk stalls
+#define CAPTURE_QUEUE_SIZE 4096
+// Size of the stdio buffer of the capture file
+#define CAPTURE_WRITE_BUFFER (1 << 20)
+
+// Direction of a captured packet
+#define CAPTURE_IN      0
+#define CAPTURE_OUT     1
+// Records were lost because the staging queue was full, data[0..3] holds the count
+#define CAPTURE_DROPPED 2
+
+#pragma pack(push, 1) // stored as is in the capture file
+typedef struct {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t record_size;
+} CAPTURE_HEADER;
+
+typedef struct {
+	uint64_t timestamp;
+	// Identifies the device (dongle) within the capture
+	uint16_t source;
+	uint8_t direction;
+	uint8_t length;
+	uint8_t data[CAPTURE_MAX_DATA];
+} CAPTURE_RECORD;
+#pragma pack(pop)
+
+class PoseEncoder;
+
+// Captures the HID traffic of all devices to a binary file.
+// The device threads only copy packets into a lock-free queue per device,
+// a separate writer thread drains the queues into the file. When the disk
+// can't keep up the packets are dropped and counted instead of blocking
+// the device thread. Instead of the raw traffic the writer can store the
+// glove reports compressed, see PoseEncoder.
+class Recorder
+{
+public:
+	class Channel
+	{
+	private:
+		friend class Recorder;
+		SpscQueue<CAPTURE_RECORD, CAPTURE_QUEUE_SIZE> m_queue;
+		std::atomic<uint32_t> m_dropped;
+		uint32_t m_dropped_written;
+		uint16_t m_source;
+
+	public:
+		Channel();
+		~Channel();
+
+		/*! \brief Stage a packet, called from the device thread. Never blocks. */
+		void Record(uint8_t direction, const void* data, size_t length, uint64_t timestamp) {
+			if (!s_recording.load(std::memory_order_relaxed))
+				return;
+
+			CAPTURE_RECORD record;
+			record.timestamp = timestamp;
+			record.source = m_source;
+			record.direction = direction;
+			record.length = (uint8_t)(length < CAPTURE_MAX_DATA ? length : CAPTURE_MAX_DATA);
+			memcpy(record.data, data, record.length);
+			if (!m_queue.Push(record))
+				m_dropped.fetch_add(1, std::memory_order_relaxed);
+		}
+	};
+
+	/*! \brief Start capturing to a new file, fails when a capture is running.
+	 *  An archive only holds the glove reports, compressed. */
+	static bool Start(const char* path, bool archive = false);
+	static void Stop();
+	static bool IsRecording() { return s_recording; }
+	static void GetStats(uint64_t &written, uint64_t &dropped);
+
+private:
+	static std::mutex s_mutex;
+	static std::vector<Channel*> s_channels;
+	static uint16_t s_next_source;
+	static std::atomic<bool> s_recording;
+	static std::thread s_thread;
+	static FILE* s_file;
+	static char* s_buffer;
+	static PoseEncoder* s_encoder;
+	static std::atomic<uint64_t> s_written;
+	static std::atomic<uint64_t> s_dropped;
+
+	static void WriterThread();
+	static size_t Drain(std::vector<CAPTURE_RECORD>& batch);
+	static void Write(const std::vector<CAPTURE_RECORD>& batch);
+};
@@ -0,0 +1,137 @@
+/*
+   Copyright 2015 Manus VR
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include "stdafx.h"
+#include "ReplayBackend.h"
+#include "Device.h"
+
+#include <string.h>
+#include <algorithm>
+#include <thread>
+
+static bool ReadHeader(FILE* file)
+{
+	CAPTURE_HEADER header;
+	return fread(&header, sizeof(header), 1, file) == 1 && header.magic == CAPTURE_MAGIC &&
+		header.version == CAPTURE_VERSION && header.record_size == sizeof(CAPTURE_RECORD);
+}
+
+ReplayBackend::ReplayBackend(const char* path, uint16_t source, double speed)
+	: m_source(source), m_speed(speed), m_file(NULL), m_pending(false),
+	m_first_recorded(0), m_start(0), m_timestamp(0)
+{
+	size_t len = strlen(path) + 1;
+	m_path = new char[len];
+	memcpy(m_path, path, len * sizeof(char));
+}
+
+ReplayBackend::~ReplayBackend()
+{
+	Close();
+	delete[] m_path;
+}
+
+bool ReplayBackend::Open()
+{
+	m_file = fopen(m_path, "rb");
+	if (!m_file)
+		return false;
+
+	if (!ReadHeader(m_file)) {
+		Close();
+		return false;
+	}
+
+	m_pending = false;
+	m_first_recorded = 0;
+	m_start = DeviceTimestamp();
+	return true;
+}
+
+void ReplayBackend::Close()
+{
+	if (m_file)
+		fclose(m_file);
+	m_file = NULL;
+}
+
+bool ReplayBackend::Next()
+{
+	// Skip the outbound packets and the other sources
+	while (fread(&m_record, sizeof(m_record), 1, m_file) == 1) {
+		if (m_record.source == m_source && m_record.direction == CAPTURE_IN) {
+			if (!m_first_recorded)
+				m_first_recorded = m_record.timestamp;
+			return true;
+		}
+	}
+	return false;
+}
+
+int ReplayBackend::Read(uint8_t* data, size_t length, int timeout_ms)
+{
+	if (!m_pending) {
+		if (!Next())
+			return -1; // end of the capture, the device disconnects
+		m_pending = true;
+	}
+
+	uint64_t offset = m_record.timestamp - m_first_recorded;
+	if (m_speed > 0.0) {
+		uint64_t due = m_start + (uint64_t)((double)offset / m_speed);
+		uint64_t now = DeviceTimestamp();
+		if (due > now) {
+			// Like a real device, wait at most the timeout for the next packet
+			uint64_t wait = due - now;
+			if (wait > (uint64_t)timeout_ms * 1000000) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(timeout_ms));
+				return 0;
+			}
+			std::this_thread::sleep_for(std::chrono::nanoseconds(wait));
+		}
+	}
+
+	m_pending = false;
+	m_timestamp = m_start + offset;
+	// The length comes from the file, don't trust it beyond the record
+	size_t copy = std::min<size_t>(std::min<size_t>(length, m_record.length), sizeof(m_record.data));
+	memcpy(data, m_record.data, copy);
+	return (int)copy;
+}
+
+int ReplayBackend::Write(const uint8_t*, size_t length)
+{
+	// The replies to the requests are part of the capture
+	return (int)length;
+}
+
+bool ReplayBackend::GetSources(const char* path, std::vector<uint16_t>& sources)
+{
+	sources.clear();
+	FILE* file = fopen(path, "rb");
+	if (!file)
+		return false;
+
+	bool ok = ReadHeader(file);
+	CAPTURE_RECORD record;
+	while (ok && fread(&record, sizeof(record), 1, file) == 1) {
+		if (record.direction == CAPTURE_IN && std::find(sources.begin(), sources.end(), record.source) == sources.end())
+			sources.push_back(record.source);
+	}
+
+	fclose(file);
+	return ok;
+}
@@ -0,0 +1,59 @@
+/*
+   Copyright 2015 Manus VR
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include "DeviceBackend.h"
+#include "Recorder.h"
+
+#include <stdio.h>
+#include <vector>
+
+// Plays back the inbound packets of one source in a capture file.
+// The packets are paced by their recorded timestamps divided by the speed
+// factor, a speed of 0 delivers them as fast as they're read. The
+// reported timestamps keep the recorded spacing at any speed so the
+// filters and the predictor see the same input on every run.
+class ReplayBackend : public DeviceBackend
+{
+private:
+	char* m_path;
+	uint16_t m_source;
+	double m_speed;
+
+	FILE* m_file;
+	CAPTURE_RECORD m_record;
+	bool m_pending;
+
+	uint64_t m_first_recorded;
+	uint64_t m_start;
+	uint64_t m_timestamp;
+
+	bool Next();
+
+public:
+	ReplayBackend(const char* path, uint16_t source, double speed);
+	~ReplayBackend();
+
+	bool Open();
+	void Close();
+	int Read(uint8_t* data, size_t length, int timeout_ms);
+	int Write(const uint8_t* data, size_t length);
+	uint64_t Timestamp() { return m_timestamp; }
+
+	/*! \brief Get the sources that sent packets in a capture file. */
+	static bool GetSources(const char* path, std::vector<uint16_t>& sources);
+};
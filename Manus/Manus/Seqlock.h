@@ -0,0 +1,92 @@
+/*
+   Copyright 2015 Manus VR
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <stdint.h>
+#include <string.h>
+
+// Times a reader tries before it gives up on a value that stays busy
+#define SEQLOCK_MAX_TRIES 100000
+
+// Holds a value that one writer updates and any number of readers copy
+// without locks. The sequence is odd while the value is being written, a
+// reader retries when it changed during the copy. The value is kept in
+// atomic words so the concurrent copy is well defined, which also makes
+// it safe to place in memory shared between processes. A writer that dies
+// while storing leaves the sequence odd for good, so readers give up after
+// SEQLOCK_MAX_TRIES instead of waiting for it.
+template <typename T>
+class Seqlock
+{
+private:
+	static const size_t WORDS = (sizeof(T) + 7) / 8;
+
+	std::atomic<uint32_t> m_sequence;
+	std::atomic<uint64_t> m_words[WORDS];
+
+public:
+	Seqlock() : m_sequence(0) {
+		for (size_t i = 0; i < WORDS; i++)
+			m_words[i].store(0, std::memory_order_relaxed);
+	}
+
+	/*! \brief Replace the value, only one thread may write at a time. */
+	void Store(const T& value) {
+		uint64_t words[WORDS];
+		words[WORDS - 1] = 0;
+		memcpy(words, &value, sizeof(T));
+
+		uint32_t sequence = m_sequence.load(std::memory_order_relaxed);
+		m_sequence.store(sequence + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		for (size_t i = 0; i < WORDS; i++)
+			m_words[i].store(words[i], std::memory_order_relaxed);
+		m_sequence.store(sequence + 2, std::memory_order_release);
+	}
+
+	/*! \brief Copy the value, returns false when it stayed busy.
+	*
+	*  \param version Optional output variable to receive the number of
+	*  times the value was stored, 0 if nothing was stored yet.
+	*/
+	bool Load(T& value, uint32_t* version = NULL) const {
+		uint64_t words[WORDS];
+		for (unsigned int tries = 0; tries < SEQLOCK_MAX_TRIES; tries++) {
+			uint32_t sequence = m_sequence.load(std::memory_order_acquire);
+			if (sequence & 1) {
+				// The writer may have been preempted, let it finish
+				std::this_thread::yield();
+				continue;
+			}
+			for (size_t i = 0; i < WORDS; i++)
+				words[i] = m_words[i].load(std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (m_sequence.load(std::memory_order_relaxed) == sequence) {
+				memcpy(&value, words, sizeof(T));
+				if (version)
+					*version = sequence / 2;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	/*! \brief Number of times the value was stored. */
+	uint32_t Version() const { return m_sequence.load(std::memory_order_acquire) / 2; }
+};
@@ -0,0 +1,474 @@
+/*
+   Copyright 2015 Manus VR
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include "stdafx.h"
+#include "SharedMemory.h"
+#include "Device.h"
+
+#include <new>
+#include <string.h>
+#include <chrono>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <limits.h>
+#endif
+
+// Clients without a process-shared wait poll at this interval for the next sample
+#define SHARED_POLL_INTERVAL_US 100
+
+std::mutex SharedServer::s_mutex;
+SharedMapping SharedServer::s_mapping;
+std::atomic<SHARED_SEGMENT*> SharedServer::s_segment(NULL);
+std::atomic<bool> SharedServer::s_running(false);
+std::thread SharedServer::s_threads[2];
+std::mutex SharedServer::s_publish_mutex[2];
+
+// A segment is still in use when its server updated the heartbeat recently
+static bool IsAlive(const SHARED_SEGMENT* segment)
+{
+	if (segment->magic.load(std::memory_order_acquire) != SHARED_MAGIC)
+		return false;
+	uint64_t heartbeat = segment->heartbeat.load(std::memory_order_relaxed);
+	return heartbeat && DeviceTimestamp() - heartbeat < SHARED_HEARTBEAT_TIMEOUT_NS;
+}
+
+SharedMapping::SharedMapping()
+	: m_segment(NULL),
+#ifdef _WIN32
+	m_handle(NULL), m_events()
+#else
+	m_fd(-1), m_owner(false)
+#endif
+{
+}
+
+SharedMapping::~SharedMapping()
+{
+	Close();
+}
+
+#ifdef _WIN32
+bool SharedMapping::OpenEvents(bool create)
+{
+	for (int hand = 0; hand < 2; hand++) {
+		for (int parity = 0; parity < 2; parity++) {
+			std::string name = m_name + (hand ? ".right" : ".left") + (parity ? ".odd" : ".even");
+			// Manual reset, so a set event wakes every client
+			m_events[hand][parity] = create ? CreateEventA(NULL, TRUE, FALSE, name.c_str()) :
+				OpenEventA(SYNCHRONIZE, FALSE, name.c_str());
+			if (!m_events[hand][parity])
+				return false;
+		}
+	}
+	return true;
+}
+
+bool SharedMapping::Create(const char* name)
+{
+	m_name = std::string("Local\\") + name;
+	m_handle = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, sizeof(SHARED_SEGMENT), m_name.c_str());
+	if (!m_handle)
+		return false;
+	m_segment = (SHARED_SEGMENT*)MapViewOfFile(m_handle, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(SHARED_SEGMENT));
+	// Don't take over the segment of a server that is still running
+	if (!m_segment || IsAlive(m_segment) || !OpenEvents(true)) {
+		Close();
+		return false;
+	}
+	return true;
+}
+
+bool SharedMapping::Open(const char* name)
+{
+	m_name = std::string("Local\\") + name;
+	m_handle = OpenFileMappingA(FILE_MAP_READ, FALSE, m_name.c_str());
+	if (!m_handle)
+		return false;
+	m_segment = (SHARED_SEGMENT*)MapViewOfFile(m_handle, FILE_MAP_READ, 0, 0, sizeof(SHARED_SEGMENT));
+	if (!m_segment || !OpenEvents(false)) {
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void SharedMapping::Close()
+{
+	if (m_segment)
+		UnmapViewOfFile(m_segment);
+	if (m_handle)
+		CloseHandle(m_handle);
+	for (int hand = 0; hand < 2; hand++) {
+		for (int parity = 0; parity < 2; parity++) {
+			if (m_events[hand][parity])
+				CloseHandle(m_events[hand][parity]);
+			m_events[hand][parity] = NULL;
+		}
+	}
+	m_segment = NULL;
+	m_handle = NULL;
+}
+
+// The event of the next update is reset before the count is raised and set
+// after, so a client that read the count waits on an event that is set by
+// the next update. It's reset again an update later, a client that only
+// starts waiting by then sleeps until the update after.
+void SharedMapping::Notify(int hand)
+{
+	std::atomic<uint32_t>& updates = m_segment->hands[hand].updates;
+	uint32_t next = updates.load(std::memory_order_relaxed) + 1;
+	ResetEvent(m_events[hand][(next + 1) & 1]);
+	updates.store(next, std::memory_order_release);
+	SetEvent(m_events[hand][next & 1]);
+}
+
+void SharedMapping::Wait(int hand, uint32_t updates, uint64_t timeout_ns) const
+{
+	if (m_segment->hands[hand].updates.load(std::memory_order_acquire) != updates)
+		return;
+	DWORD ms = (DWORD)((timeout_ns + 999999) / 1000000);
+	WaitForSingleObject(m_events[hand][(updates + 1) & 1], ms);
+}
+#else
+bool SharedMapping::Create(const char* name)
+{
+	m_name = std::string("/") + name;
+	m_fd = shm_open(m_name.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+	if (m_fd < 0)
+		return false;
+	void* base = MAP_FAILED;
+	if (ftruncate(m_fd, sizeof(SHARED_SEGMENT)) == 0)
+		base = mmap(NULL, sizeof(SHARED_SEGMENT), PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+	m_segment = base == MAP_FAILED ? NULL : (SHARED_SEGMENT*)base;
+	// Don't take over the segment of a server that is still running, its name stays
+	if (!m_segment || IsAlive(m_segment)) {
+		Close();
+		return false;
+	}
+	m_owner = true;
+	return true;
+}
+
+bool SharedMapping::Open(const char* name)
+{
+	m_name = std::string("/") + name;
+	m_fd = shm_open(m_name.c_str(), O_RDONLY | O_CLOEXEC, 0);
+	if (m_fd < 0)
+		return false;
+	m_owner = false;
+	struct stat st;
+	void* base = MAP_FAILED;
+	if (fstat(m_fd, &st) == 0 && (size_t)st.st_size >= sizeof(SHARED_SEGMENT))
+		base = mmap(NULL, sizeof(SHARED_SEGMENT), PROT_READ, MAP_SHARED, m_fd, 0);
+	if (base == MAP_FAILED) {
+		Close();
+		return false;
+	}
+	m_segment = (SHARED_SEGMENT*)base;
+	return true;
+}
+
+void SharedMapping::Close()
+{
+	if (m_segment)
+		munmap(m_segment, sizeof(SHARED_SEGMENT));
+	if (m_fd >= 0)
+		close(m_fd);
+	// Clients that still have the segment mapped keep their copy
+	if (m_owner)
+		shm_unlink(m_name.c_str());
+	m_segment = NULL;
+	m_fd = -1;
+	m_owner = false;
+}
+
+void SharedMapping::Notify(int hand)
+{
+	std::atomic<uint32_t>& updates = m_segment->hands[hand].updates;
+	updates.fetch_add(1, std::memory_order_release);
+#ifdef __linux__
+	// Not private, the waiters are in other processes
+	syscall(SYS_futex, (uint32_t*)&updates, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+#endif
+}
+
+void SharedMapping::Wait(int hand, uint32_t updates, uint64_t timeout_ns) const
+{
+	const std::atomic<uint32_t>& word = m_segment->hands[hand].updates;
+	if (word.load(std::memory_order_acquire) != updates)
+		return;
+#ifdef __linux__
+	struct timespec timeout;
+	timeout.tv_sec = (time_t)(timeout_ns / 1000000000ull);
+	timeout.tv_nsec = (long)(timeout_ns % 1000000000ull);
+	syscall(SYS_futex, (uint32_t*)&word, FUTEX_WAIT, updates, &timeout, NULL, 0);
+#else
+	uint64_t interval_ns = SHARED_POLL_INTERVAL_US * 1000ull;
+	std::this_thread::sleep_for(std::chrono::nanoseconds(timeout_ns < interval_ns ? timeout_ns : interval_ns));
+#endif
+}
+#endif
+
+bool SharedServer::Start(const char* name)
+{
+	std::lock_guard<std::mutex> lk(s_mutex);
+	if (s_running)
+		return false;
+
+	if (!s_mapping.Create(name ? name : SHARED_DEFAULT_NAME))
+		return false;
+
+	SHARED_SEGMENT* segment = s_mapping.Get();
+	// Clients of a previous server see the segment as invalid while it's rebuilt
+	segment->magic.store(0, std::memory_order_release);
+	new (segment) SHARED_SEGMENT();
+	segment->version = SHARED_VERSION;
+	segment->size = sizeof(SHARED_SEGMENT);
+#ifdef MANUS_NO_SKELETAL
+	segment->flags = 0;
+#else
+	segment->flags = SHARED_HAS_SKELETAL;
+#endif
+	segment->heartbeat.store(DeviceTimestamp(), std::memory_order_relaxed);
+	segment->magic.store(SHARED_MAGIC, std::memory_order_release);
+
+	s_segment = segment;
+	s_running = true;
+	for (int hand = 0; hand < 2; hand++)
+		s_threads[hand] = std::thread(SkeletalThread, (GLOVE_HAND)hand);
+	return true;
+}
+
+void SharedServer::Stop()
+{
+	std::lock_guard<std::mutex> lk(s_mutex);
+	if (!s_running)
+		return;
+
+	s_running = false;
+	for (int hand = 0; hand < 2; hand++)
+		s_threads[hand].join();
+
+	// Wait for a device thread that is still publishing
+	SHARED_SEGMENT* segment = s_segment.exchange(NULL);
+	for (int hand = 0; hand < 2; hand++) {
+		s_publish_mutex[hand].lock();
+		s_publish_mutex[hand].unlock();
+	}
+
+	// Tell the clients the gloves are gone
+	segment->heartbeat.store(0, std::memory_order_relaxed);
+	s_mapping.Close();
+}
+
+void SharedServer::Publish(GLOVE_HAND hand, const GLOVE_DATA& data, const GLOVE_RAW_REPORT& raw, uint64_t read_time)
+{
+	std::lock_guard<std::mutex> lk(s_publish_mutex[hand]);
+	SHARED_SEGMENT* segment = s_segment.load(std::memory_order_acquire);
+	if (!segment)
+		return;
+
+	SHARED_HAND& shared = segment->hands[hand];
+	SHARED_SAMPLE sample;
+	sample.data = data;
+	sample.read_time = read_time;
+	shared.sample.Store(sample);
+
+	// The slot is written before the count is raised, so a client never copies a slot in progress
+	uint32_t index = shared.raw_count.load(std::memory_order_relaxed);
+	SHARED_RAW slot;
+	slot.index = index;
+	slot.report = raw;
+	shared.raw[index & (SHARED_HISTORY_SIZE - 1)].Store(slot);
+	shared.raw_count.store(index + 1, std::memory_order_release);
+	s_mapping.Notify(hand);
+}
+
+void SharedServer::SkeletalThread(GLOVE_HAND hand)
+{
+	SHARED_SEGMENT* segment = s_segment;
+	while (s_running) {
+		segment->heartbeat.store(DeviceTimestamp(), std::memory_order_relaxed);
+
+#ifdef MANUS_NO_SKELETAL
+		// Only keeps the heartbeat going, there's no model to publish
+		(void)hand;
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+#else
+		// Waits for the next sample, so the model is updated at sensor rate
+		GLOVE_SKELETAL model;
+		if (ManusGetSkeletal(hand, &model, 100) == MANUS_SUCCESS) {
+			std::lock_guard<std::mutex> lk(s_publish_mutex[hand]);
+			segment->hands[hand].skeletal.Store(model);
+			s_mapping.Notify(hand);
+		} else
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+#endif
+	}
+}
+
+SharedClient::SharedClient()
+	: m_segment(NULL)
+{
+}
+
+bool SharedClient::Open(const char* name)
+{
+	if (!m_mapping.Open(name ? name : SHARED_DEFAULT_NAME))
+		return false;
+
+	const SHARED_SEGMENT* segment = m_mapping.Get();
+	if (segment->magic.load(std::memory_order_acquire) != SHARED_MAGIC ||
+		segment->version != SHARED_VERSION || segment->size != sizeof(SHARED_SEGMENT)) {
+		m_mapping.Close();
+		return false;
+	}
+	m_segment = segment;
+	return true;
+}
+
+void SharedClient::Close()
+{
+	m_mapping.Close();
+	m_segment = NULL;
+}
+
+bool SharedClient::IsServerAlive() const
+{
+	return m_segment && IsAlive(m_segment);
+}
+
+bool SharedClient::IsConnected(GLOVE_HAND hand) const
+{
+	if (!IsServerAlive())
+		return false;
+
+	// A busy sample means the server died while storing it
+	SHARED_SAMPLE sample;
+	uint32_t version;
+	if (!Hand(hand).sample.Load(sample, &version) || !version)
+		return false;
+	return DeviceTimestamp() - sample.read_time < DEVICE_TIMEOUT_NS;
+}
+
+// Wait until the seqlock was stored again, sleeping on the update count of the hand
+template <typename T>
+void SharedClient::WaitForUpdate(GLOVE_HAND hand, const Seqlock<T>& seqlock, unsigned int timeout) const
+{
+	int index = hand == GLOVE_LEFT ? 0 : 1;
+	uint32_t version = seqlock.Version();
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+	for (;;) {
+		// Read before the version, a store after the check raises the count past it
+		uint32_t updates = Hand(hand).updates.load(std::memory_order_acquire);
+		if (seqlock.Version() != version)
+			return;
+		auto now = std::chrono::steady_clock::now();
+		if (now >= deadline)
+			return;
+		m_mapping.Wait(index, updates, std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - now).count());
+	}
+}
+
+int SharedClient::GetData(GLOVE_HAND hand, GLOVE_DATA* data, unsigned int timeout) const
+{
+	if (!IsConnected(hand))
+		return MANUS_DISCONNECTED;
+
+	const Seqlock<SHARED_SAMPLE>& seqlock = Hand(hand).sample;
+	if (timeout > 0)
+		WaitForUpdate(hand, seqlock, timeout);
+
+	SHARED_SAMPLE sample;
+	if (!seqlock.Load(sample))
+		return MANUS_DISCONNECTED;
+	*data = sample.data;
+	return IsConnected(hand) ? MANUS_SUCCESS : MANUS_DISCONNECTED;
+}
+
+int SharedClient::GetSkeletal(GLOVE_HAND hand, GLOVE_SKELETAL* model, unsigned int timeout) const
+{
+	if (!(m_segment->flags & SHARED_HAS_SKELETAL))
+		return MANUS_ERROR;
+	if (!IsConnected(hand))
+		return MANUS_DISCONNECTED;
+
+	const Seqlock<GLOVE_SKELETAL>& seqlock = Hand(hand).skeletal;
+	if (timeout > 0)
+		WaitForUpdate(hand, seqlock, timeout);
+
+	uint32_t version;
+	if (!seqlock.Load(*model, &version))
+		return MANUS_DISCONNECTED;
+	return version ? MANUS_SUCCESS : MANUS_NO_DATA;
+}
+
+int SharedClient::GetRawReport(GLOVE_HAND hand, GLOVE_RAW_REPORT* report) const
+{
+	if (!IsConnected(hand))
+		return MANUS_DISCONNECTED;
+
+	const SHARED_HAND& shared = Hand(hand);
+	uint32_t count = shared.raw_count.load(std::memory_order_acquire);
+	if (!count)
+		return MANUS_NO_DATA;
+
+	SHARED_RAW slot;
+	if (!shared.raw[(count - 1) & (SHARED_HISTORY_SIZE - 1)].Load(slot))
+		return MANUS_DISCONNECTED;
+	*report = slot.report;
+	return MANUS_SUCCESS;
+}
+
+int SharedClient::GetRawHistory(GLOVE_HAND hand, GLOVE_RAW_REPORT* reports, unsigned int count, unsigned int* copied) const
+{
+	*copied = 0;
+	if (!IsConnected(hand))
+		return MANUS_DISCONNECTED;
+
+	const SHARED_HAND& shared = Hand(hand);
+	for (;;) {
+		uint32_t total = shared.raw_count.load(std::memory_order_acquire);
+		uint32_t available = total < SHARED_HISTORY_SIZE ? total : SHARED_HISTORY_SIZE;
+		unsigned int n = count < available ? count : available;
+
+		// Copy the most recent reports, oldest first. Start over when the
+		// server wrapped around the history while copying.
+		uint32_t first = total - n;
+		unsigned int i;
+		for (i = 0; i < n; i++) {
+			SHARED_RAW slot;
+			if (!shared.raw[(first + i) & (SHARED_HISTORY_SIZE - 1)].Load(slot))
+				return MANUS_DISCONNECTED;
+			if (slot.index != first + i)
+				break;
+			reports[i] = slot.report;
+		}
+		if (i == n) {
+			*copied = n;
+			return n ? MANUS_SUCCESS : MANUS_NO_DATA;
+		}
+	}
+}
@@ -0,0 +1,161 @@
+/*
+   Copyright 2015 Manus VR
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include "Manus.h"
+#include "Seqlock.h"
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <stdint.h>
+
+#define SHARED_MAGIC 0x53534E4D // "MNSS"
+#define SHARED_VERSION 2
+// Name of the segment when none is given
+#define SHARED_DEFAULT_NAME "ManusGloves"
+// Raw reports kept per hand, must be a power of two
+#define SHARED_HISTORY_SIZE 64
+// Clients treat the server as gone when it didn't update the heartbeat for this long
+#define SHARED_HEARTBEAT_TIMEOUT_NS 1000000000ull
+
+// Segment flags
+#define SHARED_HAS_SKELETAL 0x01
+
+typedef struct {
+	GLOVE_DATA data;
+	// DeviceTimestamp() of the report, the clock is the same in every process
+	uint64_t read_time;
+} SHARED_SAMPLE;
+
+typedef struct {
+	// Number of the report in the history, tells a slot that was overwritten apart
+	uint32_t index;
+	GLOVE_RAW_REPORT report;
+} SHARED_RAW;
+
+typedef struct {
+	Seqlock<SHARED_SAMPLE> sample;
+	Seqlock<GLOVE_SKELETAL> skeletal;
+	// Raised after every store to the hand, the clients sleep on it
+	std::atomic<uint32_t> updates;
+	std::atomic<uint32_t> raw_count;
+	Seqlock<SHARED_RAW> raw[SHARED_HISTORY_SIZE];
+} SHARED_HAND;
+
+// Layout of the shared memory segment. The server is the only writer,
+// clients map the segment read-only and copy out of the seqlocks.
+typedef struct {
+	std::atomic<uint32_t> magic;
+	uint32_t version;
+	uint32_t size;
+	uint32_t flags;
+	std::atomic<uint64_t> heartbeat;
+	SHARED_HAND hands[2];
+} SHARED_SEGMENT;
+
+// A named shared memory segment, the platform specific part
+class SharedMapping
+{
+private:
+	std::string m_name;
+	SHARED_SEGMENT* m_segment;
+#ifdef _WIN32
+	HANDLE m_handle;
+	// Per hand, the event of the odd updates and the one of the even updates
+	HANDLE m_events[2][2];
+
+	bool OpenEvents(bool create);
+#else
+	int m_fd;
+	bool m_owner;
+#endif
+
+public:
+	SharedMapping();
+	~SharedMapping();
+
+	/*! \brief Create the segment or reuse one left behind, for writing. */
+	bool Create(const char* name);
+	/*! \brief Map an existing segment read-only. */
+	bool Open(const char* name);
+	void Close();
+
+	SHARED_SEGMENT* Get() const { return m_segment; }
+
+	/*! \brief Raise the update count of a hand and wake the clients waiting for it, for the server. */
+	void Notify(int hand);
+	/*! \brief Sleep until the update count of a hand changed from the given one or the timeout, may wake up spuriously. */
+	void Wait(int hand, uint32_t updates, uint64_t timeout_ns) const;
+};
+
+// Publishes the gloves of this process to other processes.
+// The device threads store every decoded sample and raw report in the
+// segment, one thread per hand adds the skeletal model. The stores are
+// seqlocked so the server never waits for a client.
+class SharedServer
+{
+private:
+	static std::mutex s_mutex;
+	static SharedMapping s_mapping;
+	static std::atomic<SHARED_SEGMENT*> s_segment;
+	static std::atomic<bool> s_running;
+	static std::thread s_threads[2];
+	// Two dongles can receive the same hand and the skeletal thread stores
+	// to it too, the seqlocks and the update count need one writer
+	static std::mutex s_publish_mutex[2];
+
+	static void SkeletalThread(GLOVE_HAND hand);
+
+public:
+	static bool Start(const char* name);
+	static void Stop();
+	static bool IsRunning() { return s_running.load(std::memory_order_relaxed); }
+
+	/*! \brief Store a sample of a glove, called from the device thread. */
+	static void Publish(GLOVE_HAND hand, const GLOVE_DATA& data, const GLOVE_RAW_REPORT& raw, uint64_t read_time);
+};
+
+// Reads the gloves published by a SharedServer in another process.
+// A read copies straight out of the mapped segment without a system call,
+// a read with a timeout sleeps on the update count of the hand. Where
+// there's no process-shared wait (not Linux or Windows) it polls instead,
+// at the granularity of the system timer.
+class SharedClient
+{
+private:
+	SharedMapping m_mapping;
+	const SHARED_SEGMENT* m_segment;
+
+	bool IsServerAlive() const;
+	template <typename T>
+	void WaitForUpdate(GLOVE_HAND hand, const Seqlock<T>& seqlock, unsigned int timeout) const;
+	const SHARED_HAND& Hand(GLOVE_HAND hand) const { return m_segment->hands[hand == GLOVE_LEFT ? 0 : 1]; }
+
+public:
+	SharedClient();
+
+	bool Open(const char* name);
+	void Close();
+
+	bool IsConnected(GLOVE_HAND hand) const;
+	int GetData(GLOVE_HAND hand, GLOVE_DATA* data, unsigned int timeout) const;
+	int GetSkeletal(GLOVE_HAND hand, GLOVE_SKELETAL* model, unsigned int timeout) const;
+	int GetRawReport(GLOVE_HAND hand, GLOVE_RAW_REPORT* report) const;
+	int GetRawHistory(GLOVE_HAND hand, GLOVE_RAW_REPORT* reports, unsigned int count, unsigned int* copied) const;
+};
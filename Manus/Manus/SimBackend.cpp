@@ -0,0 +1,263 @@
+/*
+   Copyright 2015 Manus VR
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include "stdafx.h"
+#include "SimBackend.h"
+#include "Device.h"
+#include "ManusMath.h"
+
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <thread>
+
+#define SIM_PI 3.14159265358979f
+// Devices that fall further behind than this skip ahead instead of catching up
+#define SIM_MAX_BACKLOG_NS 100000000ull
+
+std::mutex SimBackend::s_mutex;
+bool SimBackend::s_enabled = false;
+GLOVE_SIM_CONFIG SimBackend::s_config;
+std::atomic<uint32_t> SimBackend::s_unplugged(0);
+
+static int16_t Quantize(float value, float scale)
+{
+	float scaled = value * scale;
+	if (scaled > 32767.0f) return 32767;
+	if (scaled < -32768.0f) return -32768;
+	return (int16_t)scaled;
+}
+
+SimBackend::SimBackend(unsigned int index)
+	: m_index(index), m_start(0), m_timestamp(0), m_reply_count(0)
+{
+	GetConfig(m_config);
+	m_period = (uint64_t)(1e9 / m_config.rate);
+	// xorshift must not start at zero
+	m_random = (m_config.seed ^ (index * 0x9E3779B9)) | 1;
+}
+
+void SimBackend::Configure(const GLOVE_SIM_CONFIG* config)
+{
+	std::lock_guard<std::mutex> lk(s_mutex);
+	s_enabled = config != NULL;
+	if (config)
+		s_config = *config;
+}
+
+void SimBackend::SetPlugged(unsigned int index, bool plugged)
+{
+	if (index >= SIM_MAX_DONGLES)
+		return;
+	if (plugged)
+		s_unplugged &= ~(1u << index);
+	else
+		s_unplugged |= 1u << index;
+}
+
+bool SimBackend::GetConfig(GLOVE_SIM_CONFIG& config)
+{
+	std::lock_guard<std::mutex> lk(s_mutex);
+	config = s_config;
+	return s_enabled;
+}
+
+float SimBackend::Random()
+{
+	m_random ^= m_random << 13;
+	m_random ^= m_random >> 17;
+	m_random ^= m_random << 5;
+	return (m_random >> 8) / 16777216.0f;
+}
+
+bool SimBackend::Open()
+{
+	if (!IsPlugged(m_index))
+		return false;
+
+	m_start = DeviceTimestamp();
+	m_timestamp = m_start;
+	m_reply_count = 0;
+
+	for (unsigned int slot = 0; slot < m_config.gloves; slot++) {
+		SIM_DEVICE& device = m_devices[slot];
+		memset(&device, 0, sizeof(device));
+		device.state.Quaternion.w = 1.0f;
+		device.flags = (slot + DEVICE_TYPE_LOW == DEV_GLOVE_RIGHT) ? GLOVE_FLAGS_HANDEDNESS : 0;
+		// Spread the devices over the period like independent radios
+		device.next = m_start + (uint64_t)(m_period * Random());
+		device.due = device.next;
+	}
+	return true;
+}
+
+void SimBackend::Schedule(SIM_DEVICE& device)
+{
+	device.next += m_period;
+	if (device.next + SIM_MAX_BACKLOG_NS < m_timestamp)
+		device.next = m_timestamp;
+	device.due = device.next + (uint64_t)(m_config.jitter_us * 1000.0f * Random());
+}
+
+void SimBackend::Generate(unsigned int slot, uint64_t time, uint8_t* report)
+{
+	GLOVE_DATA& state = m_devices[slot].state;
+	float t = (time - m_start) / 1e9f;
+	float phase = 2.0f * SIM_PI * m_config.motion_frequency * t;
+
+	switch (m_config.motion) {
+	case GLOVE_SIM_STATIC:
+		break;
+	case GLOVE_SIM_WAVE: {
+		for (int j = 0; j < GLOVE_FINGERS; j++)
+			state.Fingers[j] = 0.5f - 0.5f * cosf(phase + 0.4f * j);
+		GLOVE_VECTOR rotation = { 0.3f * sinf(phase), 0.2f * sinf(0.7f * phase), 0.5f * sinf(0.5f * phase) };
+		state.Quaternion = ManusMath::QuaternionFromRotationVector(rotation);
+		break;
+	}
+	case GLOVE_SIM_RANDOM: {
+		float step = m_config.motion_frequency * m_period / 1e9f;
+		for (int j = 0; j < GLOVE_FINGERS; j++)
+			state.Fingers[j] = std::min(1.0f, std::max(0.0f, state.Fingers[j] + step * (2.0f * Random() - 1.0f)));
+		GLOVE_VECTOR rotation = { step * (2.0f * Random() - 1.0f), step * (2.0f * Random() - 1.0f), step * (2.0f * Random() - 1.0f) };
+		state.Quaternion = ManusMath::QuaternionMultiply(state.Quaternion, ManusMath::QuaternionFromRotationVector(rotation));
+		break;
+	}
+	case GLOVE_SIM_SCRIPT:
+		if (m_config.callback)
+			m_config.callback(m_index * DEVICE_TYPE_COUNT + slot, (time - m_start) / 1e9, &state, m_config.user_data);
+		break;
+	}
+
+	// A resting hand only measures gravity
+	if (m_config.motion != GLOVE_SIM_SCRIPT)
+		ManusMath::GetGravity(&state.Acceleration, &state.Quaternion);
+
+	GLOVE_REPORT* glove = (GLOVE_REPORT*)report;
+	glove->device_id = (device_type_t)(DEVICE_TYPE_LOW + slot);
+	glove->quat[0] = Quantize(state.Quaternion.w, 16384.0f);
+	glove->quat[1] = Quantize(state.Quaternion.x, 16384.0f);
+	glove->quat[2] = Quantize(state.Quaternion.y, 16384.0f);
+	glove->quat[3] = Quantize(state.Quaternion.z, 16384.0f);
+	glove->accel[0] = Quantize(state.Acceleration.x, 16384.0f);
+	glove->accel[1] = Quantize(state.Acceleration.y, 16384.0f);
+	glove->accel[2] = Quantize(state.Acceleration.z, 16384.0f);
+	for (int j = 0; j < GLOVE_FINGERS; j++) {
+		// The fingers are sent pinky first except on the right glove
+		uint8_t value = (uint8_t)(std::min(1.0f, std::max(0.0f, state.Fingers[j])) * 255.0f + 0.5f);
+		if (glove->device_id == DEV_GLOVE_RIGHT)
+			glove->fingers[j] = value;
+		else
+			glove->fingers[GLOVE_FINGERS - (j + 1)] = value;
+	}
+	glove->flags = m_devices[slot].flags;
+	glove->rssi = -50 - (int32_t)(10.0f * Random());
+}
+
+int SimBackend::Read(uint8_t* data, size_t length, int timeout_ms)
+{
+	if (!IsPlugged(m_index))
+		return -1;
+
+	m_timestamp = DeviceTimestamp();
+
+	// Replies go out first, the dongle answers between two reports
+	if (m_reply_count) {
+		size_t copy = std::min<size_t>(length, m_replies[0].length);
+		memcpy(data, m_replies[0].data, copy);
+		m_reply_count--;
+		memmove(m_replies, m_replies + 1, m_reply_count * sizeof(REPLY));
+		return (int)copy;
+	}
+
+	unsigned int slot = 0;
+	for (unsigned int i = 1; i < m_config.gloves; i++)
+		if (m_devices[i].due < m_devices[slot].due)
+			slot = i;
+
+	SIM_DEVICE& device = m_devices[slot];
+	if (device.due > m_timestamp) {
+		uint64_t wait = device.due - m_timestamp;
+		if (wait > (uint64_t)timeout_ms * 1000000) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(timeout_ms));
+			m_timestamp = DeviceTimestamp();
+			return 0;
+		}
+		std::this_thread::sleep_for(std::chrono::nanoseconds(wait));
+		m_timestamp = DeviceTimestamp();
+	}
+
+	uint64_t time = device.next;
+	Schedule(device);
+
+	// A lost report looks like a read timeout to the device thread
+	if (Random() < m_config.loss)
+		return 0;
+
+	uint8_t report[32] = { 0 };
+	Generate(slot, time, report);
+	device.sent++;
+
+	size_t copy = std::min<size_t>(length, sizeof(report));
+	memcpy(data, report, copy);
+	return (int)copy;
+}
+
+int SimBackend::Write(const uint8_t* data, size_t length)
+{
+	if (length < sizeof(USB_OUT_PACKET))
+		return -1;
+
+	// Skip the report id
+	const ESB_DATA_PACKET* request = (const ESB_DATA_PACKET*)(data + 1);
+	unsigned int slot = request->device_type - DEVICE_TYPE_LOW;
+	if (slot >= m_config.gloves)
+		return (int)length; // the dongle sends it, nobody answers
+
+	SIM_DEVICE& device = m_devices[slot];
+	ESB_DATA_PACKET reply;
+	memset(&reply, 0, sizeof(reply));
+	reply.message_type = request->message_type;
+	reply.device_type = request->device_type;
+	reply.device_id = DeviceId(slot);
+
+	switch (request->message_type) {
+	case MSG_FLAGS_SET:
+		device.flags = request->flags.flags;
+		return (int)length;
+	case MSG_FLAGS_GET:
+		reply.flags.flags = device.flags;
+		break;
+	case MSG_STATS_GET:
+		reply.stats.tx_success = device.sent;
+		reply.stats.tx_rssi = -50;
+		reply.stats.battery_voltage = 3900;
+		reply.stats.battery_percentage = 80;
+		break;
+	default:
+		return (int)length; // vibration and power off have no reply
+	}
+
+	if (m_reply_count < SIM_MAX_REPLIES) {
+		// The reply is cut to the size of a report like on the dongle
+		REPLY& queued = m_replies[m_reply_count++];
+		queued.data[0] = DEVICE_MESSAGE;
+		size_t copy = std::min(sizeof(reply), sizeof(queued.data) - 1);
+		memcpy(queued.data + 1, &reply, copy);
+		queued.length = (uint8_t)(copy + 1);
+	}
+	return (int)length;
+}
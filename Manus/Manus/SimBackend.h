@@ -0,0 +1,89 @@
+/*
+   Copyright 2015 Manus VR
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include "Manus.h"
+#include "DeviceBackend.h"
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+// Replies are queued until the next read, a few are enough for the request rate
+#define SIM_MAX_REPLIES 8
+// Dongles that can be unplugged, see SetPlugged()
+#define SIM_MAX_DONGLES 32
+
+// Simulates a dongle with up to four devices.
+// Reports are generated at the configured rate per device, with random
+// loss and delay, and requests get the replies a glove would send. The
+// packets are byte compatible with the dongle so the whole stack above
+// the backend runs unchanged.
+class SimBackend : public DeviceBackend
+{
+private:
+	typedef struct {
+		uint8_t length;
+		uint8_t data[32];
+	} REPLY;
+
+	typedef struct {
+		uint64_t next;      // schedule without jitter
+		uint64_t due;       // time the pending report is delivered
+		uint8_t flags;
+		uint32_t sent;
+		GLOVE_DATA state;
+	} SIM_DEVICE;
+
+	unsigned int m_index;
+	GLOVE_SIM_CONFIG m_config;
+	uint64_t m_period;
+	uint64_t m_start;
+	uint64_t m_timestamp;
+	uint32_t m_random;
+
+	SIM_DEVICE m_devices[4];
+	REPLY m_replies[SIM_MAX_REPLIES];
+	unsigned int m_reply_count;
+
+	float Random();
+	void Schedule(SIM_DEVICE& device);
+	void Generate(unsigned int slot, uint64_t time, uint8_t* report);
+	uint32_t DeviceId(unsigned int slot) const { return 0x53000000 | (m_index << 4) | slot; }
+
+	static std::mutex s_mutex;
+	static bool s_enabled;
+	static GLOVE_SIM_CONFIG s_config;
+	// One bit per dongle that is pulled out
+	static std::atomic<uint32_t> s_unplugged;
+
+public:
+	SimBackend(unsigned int index);
+
+	bool Open();
+	void Close() {}
+	int Read(uint8_t* data, size_t length, int timeout_ms);
+	int Write(const uint8_t* data, size_t length);
+	uint64_t Timestamp() { return m_timestamp; }
+
+	/*! \brief Enable the simulator for the devices created from now on, NULL disables it. */
+	static void Configure(const GLOVE_SIM_CONFIG* config);
+	static bool GetConfig(GLOVE_SIM_CONFIG& config);
+	static void SetPlugged(unsigned int index, bool plugged);
+	static bool IsPlugged(unsigned int index) { return index >= SIM_MAX_DONGLES || !(s_unplugged & (1u << index)); }
+	static void PlugAll() { s_unplugged = 0; }
+};
@@ -16,10 +16,20 @@
 
 #include "stdafx.h"
 #include "SkeletalModel.h"
-#include "FbxMemStream.h"
-#include "resource.h"
 #include "ManusMath.h"
 #include "Device.h"
+#include "Metrics.h"
+#include "Trace.h"
+
+#include <string.h>
+
+#ifdef _WIN32
+#include "FbxMemStream.h"
+#include "resource.h"
+#else
+#include <stdlib.h>
+#include <string>
+#endif
 
 const char* s_bone_names[GLOVE_FINGERS][4] = {
 	{ "Finger_00", "Finger_01", "Finger_02", "Finger_03" },
@@ -60,6 +70,8 @@ GLOVE_POSE SkeletalModel::ToGlovePose(FbxAMatrix mat, GLOVE_QUATERNION &Quat)
 // and use the SDK manager to create a new scene
 SkeletalModel::SkeletalModel()
 {
+	m_cache[0].valid = false;
+	m_cache[1].valid = false;
 }
 
 SkeletalModel::~SkeletalModel()
@@ -89,6 +101,10 @@ bool SkeletalModel::InitializeScene()
 
 	for (int i = 0; i < 2; i++)
 	{
+		// Create an importer and initialize the importer.
+		FbxImporter* importer = FbxImporter::Create(m_sdk_manager, "");
+
+#ifdef _WIN32
 		// Get pointer and size to resource.
 		HRSRC hRes = FindResource(GetModuleHandle(L"Manus.dll"),
 			i ? MAKEINTRESOURCE(IDR_FBX_RIGHT) : MAKEINTRESOURCE(IDR_FBX_LEFT),
@@ -97,11 +113,17 @@ bool SkeletalModel::InitializeScene()
 		DWORD dSize = SizeofResource(GetModuleHandle(L"Manus.dll"), hRes);
 		void* pMem = LockResource(hMem);
 
-		// Create an importer and initialize the importer.
-		FbxImporter* importer = FbxImporter::Create(m_sdk_manager, "");
 		FbxMemStream mem_stream(m_sdk_manager, pMem, dSize);
-
-		if (!importer->Initialize(&mem_stream, nullptr, -1, m_sdk_manager->GetIOSettings()))
+		bool initialized = importer->Initialize(&mem_stream, nullptr, -1, m_sdk_manager->GetIOSettings());
+#else
+		// There are no resources in a shared object, the models are installed next to it
+		const char* model_dir = getenv("MANUS_MODEL_DIR");
+		std::string path = std::string(model_dir ? model_dir : MANUS_MODEL_DIR) +
+			(i ? "/Manus_Handv2_Right_Meshless.FBX" : "/Manus_Handv2_Left_Meshless.FBX");
+		bool initialized = importer->Initialize(path.c_str(), -1, m_sdk_manager->GetIOSettings());
+#endif
+
+		if (!initialized)
 		{
 			FBXSDK_printf("Call to FbxExporter::Initialize() failed.\n");
 			FBXSDK_printf("Error returned: %s\n\n", importer->GetStatus().GetErrorString());
@@ -140,6 +162,20 @@ bool SkeletalModel::InitializeScene()
 
 bool SkeletalModel::Simulate(const GLOVE_DATA data, GLOVE_SKELETAL* model, GLOVE_HAND hand, bool OSVR_Compat)
 {
+	MANUS_TRACE_SCOPE("SkeletalModel::Simulate");
+	std::lock_guard<std::mutex> lk(m_scene_mutex[hand]);
+
+	// The model only depends on the orientation and the fingers
+	CACHE& cache = m_cache[hand];
+	if (cache.valid && cache.osvr == OSVR_Compat &&
+		memcmp(&cache.quaternion, &data.Quaternion, sizeof(cache.quaternion)) == 0 &&
+		memcmp(cache.fingers, data.Fingers, sizeof(cache.fingers)) == 0) {
+		*model = cache.model;
+		Metrics::Add(Metrics::s_skeletal_cache_hits);
+		return true;
+	}
+	Metrics::Add(Metrics::s_skeletal_evaluations);
+
 	// Get the animation evaluator for this scene
 	FbxAnimEvaluator* eval = m_scene[hand]->GetAnimationEvaluator();
 	FbxTime normalizedAmount;
@@ -201,5 +237,10 @@ bool SkeletalModel::Simulate(const GLOVE_DATA data, GLOVE_SKELETAL* model, GLOVE
 	model->pinky.intermediate = ToGlovePose(eval->GetNodeGlobalTransform(m_bone_nodes[hand][4][2], normalizedAmount), Quat );
 	model->pinky.distal = ToGlovePose(eval->GetNodeGlobalTransform(m_bone_nodes[hand][4][3], normalizedAmount), Quat );
 
+	cache.valid = true;
+	cache.osvr = OSVR_Compat;
+	cache.quaternion = data.Quaternion;
+	memcpy(cache.fingers, data.Fingers, sizeof(cache.fingers));
+	cache.model = *model;
 	return true;
 }
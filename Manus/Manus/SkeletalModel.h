@@ -20,6 +20,7 @@
 //#include "Glove.h"
 #include "Device.h"
 #include <fbxsdk.h>
+#include <mutex>
 
 class SkeletalModel
 {
@@ -27,6 +28,18 @@ private:
 	FbxManager* m_sdk_manager;
 	FbxScene* m_scene[2];
 	FbxNode* m_bone_nodes[2][GLOVE_FINGERS][4];
+	// The evaluator of a scene caches its results, so only one thread can use it at a time
+	std::mutex m_scene_mutex[2];
+
+	// The last model of each hand, consumers often ask for the same sample
+	typedef struct {
+		bool valid;
+		bool osvr;
+		GLOVE_QUATERNION quaternion;
+		float fingers[GLOVE_FINGERS];
+		GLOVE_SKELETAL model;
+	} CACHE;
+	CACHE m_cache[2];
 	
 	GLOVE_POSE ToGlovePose(FbxAMatrix mat, GLOVE_QUATERNION &Quat);
 	
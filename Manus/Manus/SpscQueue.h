@@ -0,0 +1,61 @@
+/*
+   Copyright 2015 Manus VR
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+
+// Bounded lock-free queue for exactly one producer and one consumer thread.
+// The capacity must be a power of two. Push fails instead of blocking
+// when the queue is full, so the producer is never held up.
+template <typename T, size_t N>
+class SpscQueue
+{
+	static_assert((N & (N - 1)) == 0, "SpscQueue capacity must be a power of two");
+
+private:
+	T m_items[N];
+	// Written by the producer only
+	std::atomic<size_t> m_head;
+	// Written by the consumer only
+	std::atomic<size_t> m_tail;
+
+public:
+	SpscQueue() : m_head(0), m_tail(0) {}
+
+	bool Push(const T& item) {
+		size_t head = m_head.load(std::memory_order_relaxed);
+		if (head - m_tail.load(std::memory_order_acquire) >= N)
+			return false;
+		m_items[head & (N - 1)] = item;
+		m_head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool Pop(T& item) {
+		size_t tail = m_tail.load(std::memory_order_relaxed);
+		if (tail == m_head.load(std::memory_order_acquire))
+			return false;
+		item = m_items[tail & (N - 1)];
+		m_tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	size_t Size() const {
+		return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire);
+	}
+};
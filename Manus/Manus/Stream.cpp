@@ -0,0 +1,566 @@
+/*
+   Copyright 2015 Manus VR
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include "stdafx.h"
+#include "Stream.h"
+#include "Device.h"
+#include "ManusMath.h"
+#include "OutputBuffer.h"
+
+#include <string.h>
+#include <chrono>
+#include <limits>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#define closesocket close
+#define INVALID_SOCKET -1
+#endif
+
+// Time the receiver waits for a datagram before it checks for a stop
+#define STREAM_RECEIVE_TIMEOUT_MS 100
+// Longest time the sender sleeps without samples, covers a missed wake up
+#define STREAM_IDLE_MS 100
+
+std::mutex StreamSender::s_mutex;
+std::vector<StreamSender::Channel*> StreamSender::s_channels;
+std::atomic<bool> StreamSender::s_streaming(false);
+std::thread StreamSender::s_thread;
+intptr_t StreamSender::s_socket = (intptr_t)INVALID_SOCKET;
+uint32_t StreamSender::s_content = 0;
+uint64_t StreamSender::s_latency_ns = 0;
+std::atomic<uint64_t> StreamSender::s_datagrams(0);
+std::atomic<uint64_t> StreamSender::s_samples(0);
+std::atomic<uint64_t> StreamSender::s_dropped(0);
+std::mutex StreamSender::s_wake_mutex;
+std::condition_variable StreamSender::s_wake_cv;
+std::atomic<bool> StreamSender::s_idle(false);
+
+static bool IsMulticast(const in_addr& address)
+{
+	return (ntohl(address.s_addr) & 0xF0000000) == 0xE0000000;
+}
+
+// Windows needs the socket library started for every user, it counts them
+static bool StartSockets()
+{
+#ifdef _WIN32
+	WSADATA data;
+	return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+#else
+	return true;
+#endif
+}
+
+static void StopSockets()
+{
+#ifdef _WIN32
+	WSACleanup();
+#endif
+}
+
+StreamSender::Channel::Channel()
+{
+	std::lock_guard<std::mutex> lk(s_mutex);
+	s_channels.push_back(this);
+}
+
+StreamSender::Channel::~Channel()
+{
+	// The sender drains the channels under the same lock
+	std::lock_guard<std::mutex> lk(s_mutex);
+	for (size_t i = 0; i < s_channels.size(); i++) {
+		if (s_channels[i] == this) {
+			s_channels.erase(s_channels.begin() + i);
+			break;
+		}
+	}
+}
+
+bool StreamSender::Start(const GLOVE_STREAM_CONFIG& config)
+{
+	std::lock_guard<std::mutex> lk(s_mutex);
+	if (s_streaming)
+		return false;
+
+	sockaddr_in destination;
+	memset(&destination, 0, sizeof(destination));
+	destination.sin_family = AF_INET;
+	destination.sin_port = htons(config.port);
+	if (inet_pton(AF_INET, config.address, &destination.sin_addr) != 1)
+		return false;
+
+	if (!StartSockets())
+		return false;
+
+	s_socket = (intptr_t)socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (s_socket == (intptr_t)INVALID_SOCKET) {
+		StopSockets();
+		return false;
+	}
+
+	bool ok = true;
+	if (IsMulticast(destination.sin_addr)) {
+		int ttl = config.ttl ? (int)config.ttl : 1;
+		ok = setsockopt(s_socket, IPPROTO_IP, IP_MULTICAST_TTL, (const char*)&ttl, sizeof(ttl)) == 0;
+	}
+	// Connected, so every send goes to the destination without looking it up
+	if (!ok || connect(s_socket, (const sockaddr*)&destination, sizeof(destination)) != 0) {
+		closesocket(s_socket);
+		s_socket = (intptr_t)INVALID_SOCKET;
+		StopSockets();
+		return false;
+	}
+
+	s_content = config.content;
+	s_latency_ns = (uint64_t)config.latency_us * 1000;
+
+	// Samples staged before the start belong to no stream
+	STREAM_SAMPLE sample;
+	for (Channel* channel : s_channels)
+		while (channel->m_queue.Pop(sample));
+
+	s_datagrams = 0;
+	s_samples = 0;
+	s_dropped = 0;
+	s_streaming = true;
+	s_thread = std::thread(SenderThread);
+	return true;
+}
+
+void StreamSender::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lk(s_mutex);
+		if (!s_streaming)
+			return;
+		s_streaming = false;
+	}
+	Wake();
+	if (s_thread.joinable())
+		s_thread.join();
+
+	std::lock_guard<std::mutex> lk(s_mutex);
+	closesocket(s_socket);
+	s_socket = (intptr_t)INVALID_SOCKET;
+	StopSockets();
+}
+
+void StreamSender::GetStats(uint64_t &datagrams, uint64_t &samples, uint64_t &dropped)
+{
+	datagrams = s_datagrams;
+	samples = s_samples;
+	dropped = s_dropped;
+}
+
+void StreamSender::Wake()
+{
+	// Under the lock, so the sender is either waiting already or sees the sample
+	std::lock_guard<std::mutex> lk(s_wake_mutex);
+	s_wake_cv.notify_one();
+}
+
+size_t StreamSender::Drain(std::vector<STREAM_SAMPLE>& batch)
+{
+	std::lock_guard<std::mutex> lk(s_mutex);
+	batch.clear();
+
+	STREAM_SAMPLE sample;
+	for (Channel* channel : s_channels) {
+		// Bounded so one busy channel can't starve the others
+		for (size_t i = 0; i < STREAM_QUEUE_SIZE && channel->m_queue.Pop(sample); i++)
+			batch.push_back(sample);
+	}
+	return batch.size();
+}
+
+bool StreamSender::IsEmpty()
+{
+	std::lock_guard<std::mutex> lk(s_mutex);
+	for (Channel* channel : s_channels)
+		if (channel->m_queue.Size())
+			return false;
+	return true;
+}
+
+void StreamSender::SenderThread()
+{
+	std::vector<STREAM_SAMPLE> batch;
+	batch.reserve(STREAM_QUEUE_SIZE);
+
+	uint8_t kind = 0;
+	if (s_content & GLOVE_STREAM_DATA) kind |= STREAM_KIND_DATA;
+	if (s_content & GLOVE_STREAM_RAW) kind |= STREAM_KIND_RAW;
+	size_t record_size = sizeof(STREAM_RECORD) +
+		((kind & STREAM_KIND_DATA) ? sizeof(STREAM_DATA) : 0) + ((kind & STREAM_KIND_RAW) ? STREAM_RAW_SIZE : 0);
+
+	// The datagram being filled, the ages are filled in when it's sent
+	uint8_t datagram[STREAM_MAX_DATAGRAM];
+	size_t length = sizeof(STREAM_HEADER);
+	uint64_t read_times[STREAM_MAX_DATAGRAM / sizeof(STREAM_RECORD)];
+	uint8_t count = 0;
+	uint32_t sequence = 0;
+
+	auto send_datagram = [&]() {
+		STREAM_HEADER header;
+		header.magic = STREAM_MAGIC;
+		header.version = STREAM_VERSION;
+		header.count = count;
+		header.reserved = 0;
+		header.sequence = sequence++;
+		memcpy(datagram, &header, sizeof(header));
+
+		uint64_t now = DeviceTimestamp();
+		for (uint8_t i = 0; i < count; i++) {
+			uint64_t age = now > read_times[i] ? now - read_times[i] : 0;
+			uint32_t age_ns = age < std::numeric_limits<uint32_t>::max() ? (uint32_t)age : std::numeric_limits<uint32_t>::max();
+			memcpy(datagram + sizeof(STREAM_HEADER) + i * record_size + offsetof(STREAM_RECORD, age_ns), &age_ns, sizeof(age_ns));
+		}
+
+		// A datagram that can't be sent is lost like one dropped on the way
+		send(s_socket, (const char*)datagram, (int)length, 0);
+		s_datagrams++;
+		s_samples += count;
+		length = sizeof(STREAM_HEADER);
+		count = 0;
+	};
+
+	while (s_streaming) {
+		Drain(batch);
+		for (const STREAM_SAMPLE& sample : batch) {
+			if (length + record_size > STREAM_MAX_DATAGRAM || count == 255)
+				send_datagram();
+
+			STREAM_RECORD record;
+			record.kind = kind;
+			record.hand = (uint8_t)sample.hand;
+			record.packet_number = sample.raw.packet_number;
+			record.age_ns = 0;
+			memcpy(datagram + length, &record, sizeof(record));
+			length += sizeof(record);
+
+			if (kind & STREAM_KIND_DATA) {
+				STREAM_DATA data;
+				data.quaternion[0] = sample.data.Quaternion.w;
+				data.quaternion[1] = sample.data.Quaternion.x;
+				data.quaternion[2] = sample.data.Quaternion.y;
+				data.quaternion[3] = sample.data.Quaternion.z;
+				data.acceleration[0] = sample.data.Acceleration.x;
+				data.acceleration[1] = sample.data.Acceleration.y;
+				data.acceleration[2] = sample.data.Acceleration.z;
+				memcpy(data.fingers, sample.data.Fingers, sizeof(data.fingers));
+				memcpy(datagram + length, &data, sizeof(data));
+				length += sizeof(data);
+			}
+			if (kind & STREAM_KIND_RAW) {
+				memcpy(datagram + length, (const uint8_t*)&sample.raw + STREAM_RAW_OFFSET, STREAM_RAW_SIZE);
+				length += STREAM_RAW_SIZE;
+			}
+			read_times[count++] = sample.read_time;
+		}
+
+		if (count) {
+			// The first sample in the datagram sets the deadline
+			uint64_t age = DeviceTimestamp() - read_times[0];
+			if (age >= s_latency_ns)
+				send_datagram();
+			else
+				std::this_thread::sleep_for(std::chrono::nanoseconds(s_latency_ns - age));
+			continue;
+		}
+
+		if (!batch.empty())
+			continue;
+
+		// Nothing staged, sleep until a device thread stages a sample
+		std::unique_lock<std::mutex> lk(s_wake_mutex);
+		s_idle = true;
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (s_streaming && IsEmpty())
+			s_wake_cv.wait_for(lk, std::chrono::milliseconds(STREAM_IDLE_MS));
+		s_idle = false;
+	}
+
+	if (count)
+		send_datagram();
+}
+
+StreamReceiver::StreamReceiver()
+	: m_socket((intptr_t)INVALID_SOCKET), m_running(false),
+	m_sequence_valid(false), m_sequence(0), m_datagrams(0), m_samples(0), m_lost(0)
+{
+	for (int hand = 0; hand < 2; hand++) {
+		memset(&m_hands[hand], 0, sizeof(m_hands[hand]));
+		m_last_seen[hand] = 0;
+	}
+}
+
+StreamReceiver::~StreamReceiver()
+{
+	Close();
+}
+
+bool StreamReceiver::Open(const char* address, unsigned short port)
+{
+	sockaddr_in local;
+	memset(&local, 0, sizeof(local));
+	local.sin_family = AF_INET;
+	local.sin_port = htons(port);
+	if (inet_pton(AF_INET, address, &local.sin_addr) != 1)
+		return false;
+
+	if (!StartSockets())
+		return false;
+
+	m_socket = (intptr_t)socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (m_socket == (intptr_t)INVALID_SOCKET) {
+		StopSockets();
+		return false;
+	}
+
+	// Several receivers on one machine can join the same group
+	int reuse = 1;
+	setsockopt(m_socket, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+
+#ifdef _WIN32
+	DWORD timeout = STREAM_RECEIVE_TIMEOUT_MS;
+#else
+	timeval timeout;
+	timeout.tv_sec = 0;
+	timeout.tv_usec = STREAM_RECEIVE_TIMEOUT_MS * 1000;
+#endif
+	bool ok = setsockopt(m_socket, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout)) == 0;
+
+	if (ok && IsMulticast(local.sin_addr)) {
+		ip_mreq group;
+		group.imr_multiaddr = local.sin_addr;
+		group.imr_interface.s_addr = htonl(INADDR_ANY);
+		local.sin_addr.s_addr = htonl(INADDR_ANY);
+		ok = bind(m_socket, (const sockaddr*)&local, sizeof(local)) == 0 &&
+			setsockopt(m_socket, IPPROTO_IP, IP_ADD_MEMBERSHIP, (const char*)&group, sizeof(group)) == 0;
+	} else if (ok) {
+		ok = bind(m_socket, (const sockaddr*)&local, sizeof(local)) == 0;
+	}
+
+	if (!ok) {
+		closesocket(m_socket);
+		m_socket = (intptr_t)INVALID_SOCKET;
+		StopSockets();
+		return false;
+	}
+
+	m_running = true;
+	m_thread = std::thread(ReceiverThread, this);
+	return true;
+}
+
+void StreamReceiver::Close()
+{
+	if (m_socket == (intptr_t)INVALID_SOCKET)
+		return;
+
+	m_running = false;
+	if (m_thread.joinable())
+		m_thread.join();
+
+	// Wake up readers waiting for the next sample
+	for (int hand = 0; hand < 2; hand++) {
+		std::lock_guard<std::mutex> lk(m_mutex[hand]);
+		m_cv[hand].notify_all();
+	}
+
+	closesocket(m_socket);
+	m_socket = (intptr_t)INVALID_SOCKET;
+	StopSockets();
+}
+
+void StreamReceiver::ReceiverThread(StreamReceiver* receiver)
+{
+	uint8_t datagram[STREAM_MAX_DATAGRAM];
+	while (receiver->m_running) {
+		int length = (int)recv(receiver->m_socket, (char*)datagram, sizeof(datagram), 0);
+		if (length <= 0)
+			continue;
+		receiver->Receive(datagram, (size_t)length, DeviceTimestamp());
+	}
+}
+
+void StreamReceiver::Receive(const uint8_t* datagram, size_t length, uint64_t receive_time)
+{
+	STREAM_HEADER header;
+	if (length < sizeof(header))
+		return;
+	memcpy(&header, datagram, sizeof(header));
+	if (header.magic != STREAM_MAGIC || header.version != STREAM_VERSION)
+		return;
+
+	// A sequence going backwards is a restarted sender, not a loss
+	if (m_sequence_valid && (int32_t)(header.sequence - m_sequence) > 0)
+		m_lost += header.sequence - m_sequence;
+	m_sequence = header.sequence + 1;
+	m_sequence_valid = true;
+	m_datagrams++;
+
+	size_t offset = sizeof(header);
+	for (uint8_t i = 0; i < header.count; i++) {
+		STREAM_RECORD record;
+		if (offset + sizeof(record) > length)
+			return;
+		memcpy(&record, datagram + offset, sizeof(record));
+		offset += sizeof(record);
+
+		size_t size = ((record.kind & STREAM_KIND_DATA) ? sizeof(STREAM_DATA) : 0) +
+			((record.kind & STREAM_KIND_RAW) ? STREAM_RAW_SIZE : 0);
+		if (record.hand > GLOVE_RIGHT || offset + size > length)
+			return;
+
+		// The time the report was read, in the local clock
+		uint64_t read_time = receive_time > record.age_ns ? receive_time - record.age_ns : 0;
+
+		std::lock_guard<std::mutex> lk(m_mutex[record.hand]);
+		HAND& hand = m_hands[record.hand];
+		if (record.kind & STREAM_KIND_DATA) {
+			STREAM_DATA data;
+			memcpy(&data, datagram + offset, sizeof(data));
+			offset += sizeof(data);
+
+			hand.data.Quaternion.w = data.quaternion[0];
+			hand.data.Quaternion.x = data.quaternion[1];
+			hand.data.Quaternion.y = data.quaternion[2];
+			hand.data.Quaternion.z = data.quaternion[3];
+			hand.data.Acceleration.x = data.acceleration[0];
+			hand.data.Acceleration.y = data.acceleration[1];
+			hand.data.Acceleration.z = data.acceleration[2];
+			memcpy(hand.data.Fingers, data.fingers, sizeof(data.fingers));
+			// The euler angles aren't sent, they follow from the quaternion
+			ManusMath::GetEuler(&hand.data.Euler, &hand.data.Quaternion);
+			hand.data.PacketNumber = record.packet_number;
+			hand.has_data = true;
+			hand.sequence++;
+			if (OutputBuffer::IsBound((GLOVE_HAND)record.hand))
+				OutputBuffer::Publish((GLOVE_HAND)record.hand, hand.data, read_time);
+		}
+		if (record.kind & STREAM_KIND_RAW) {
+			GLOVE_RAW_REPORT& raw = hand.history[hand.raw_count++ & (STREAM_HISTORY_SIZE - 1)];
+			raw.timestamp = read_time;
+			raw.packet_number = record.packet_number;
+			memcpy((uint8_t*)&raw + STREAM_RAW_OFFSET, datagram + offset, STREAM_RAW_SIZE);
+			offset += STREAM_RAW_SIZE;
+		}
+		m_last_seen[record.hand] = read_time;
+		m_samples++;
+		m_cv[record.hand].notify_all();
+		Device::NotifySample((GLOVE_HAND)record.hand);
+	}
+}
+
+bool StreamReceiver::IsConnected(GLOVE_HAND hand) const
+{
+	uint64_t last_seen = m_last_seen[hand == GLOVE_LEFT ? 0 : 1];
+	return m_running && last_seen && DeviceTimestamp() - last_seen < DEVICE_TIMEOUT_NS;
+}
+
+int StreamReceiver::GetData(GLOVE_HAND hand, GLOVE_DATA* data, unsigned int timeout)
+{
+	if (!IsConnected(hand))
+		return MANUS_DISCONNECTED;
+
+	int index = hand == GLOVE_LEFT ? 0 : 1;
+	std::unique_lock<std::mutex> lk(m_mutex[index]);
+	HAND& state = m_hands[index];
+
+	// Optionally wait until the next sample arrives
+	if (timeout > 0) {
+		uint64_t sequence = state.sequence;
+		m_cv[index].wait_for(lk, std::chrono::milliseconds(timeout),
+			[&] { return state.sequence != sequence || !m_running; });
+	}
+
+	if (!state.has_data)
+		return MANUS_NO_DATA;
+	*data = state.data;
+	lk.unlock();
+
+	return IsConnected(hand) ? MANUS_SUCCESS : MANUS_DISCONNECTED;
+}
+
+int StreamReceiver::GetDataAfter(GLOVE_HAND hand, uint64_t after_seq, GLOVE_DATA* data, uint64_t* seq, unsigned int timeout)
+{
+	if (!IsConnected(hand))
+		return MANUS_DISCONNECTED;
+
+	int index = hand == GLOVE_LEFT ? 0 : 1;
+	std::unique_lock<std::mutex> lk(m_mutex[index]);
+	HAND& state = m_hands[index];
+
+	if (!m_cv[index].wait_for(lk, std::chrono::milliseconds(timeout),
+		[&] { return state.sequence != after_seq || !m_running; }))
+		return MANUS_NO_DATA;
+	if (!m_running)
+		return MANUS_DISCONNECTED;
+	if (!state.has_data)
+		return MANUS_NO_DATA;
+	*data = state.data;
+	*seq = state.sequence;
+	lk.unlock();
+
+	return IsConnected(hand) ? MANUS_SUCCESS : MANUS_DISCONNECTED;
+}
+
+int StreamReceiver::GetRawReport(GLOVE_HAND hand, GLOVE_RAW_REPORT* report)
+{
+	if (!IsConnected(hand))
+		return MANUS_DISCONNECTED;
+
+	HAND& state = m_hands[hand == GLOVE_LEFT ? 0 : 1];
+	std::lock_guard<std::mutex> lk(m_mutex[hand == GLOVE_LEFT ? 0 : 1]);
+	if (!state.raw_count)
+		return MANUS_NO_DATA;
+	*report = state.history[(state.raw_count - 1) & (STREAM_HISTORY_SIZE - 1)];
+	return MANUS_SUCCESS;
+}
+
+int StreamReceiver::GetRawHistory(GLOVE_HAND hand, GLOVE_RAW_REPORT* reports, unsigned int count, unsigned int* copied)
+{
+	*copied = 0;
+	if (!IsConnected(hand))
+		return MANUS_DISCONNECTED;
+
+	HAND& state = m_hands[hand == GLOVE_LEFT ? 0 : 1];
+	std::lock_guard<std::mutex> lk(m_mutex[hand == GLOVE_LEFT ? 0 : 1]);
+	uint32_t available = state.raw_count < STREAM_HISTORY_SIZE ? state.raw_count : STREAM_HISTORY_SIZE;
+	*copied = count < available ? count : available;
+
+	// Copy the most recent reports, oldest first
+	uint32_t first = state.raw_count - *copied;
+	for (unsigned int i = 0; i < *copied; i++)
+		reports[i] = state.history[(first + i) & (STREAM_HISTORY_SIZE - 1)];
+	return *copied ? MANUS_SUCCESS : MANUS_NO_DATA;
+}
+
+void StreamReceiver::GetStats(uint64_t &datagrams, uint64_t &samples, uint64_t &lost) const
+{
+	datagrams = m_datagrams;
+	samples = m_samples;
+	lost = m_lost;
+}
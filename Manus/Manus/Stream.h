@@ -0,0 +1,198 @@
+/*
+   Copyright 2015 Manus VR
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#pragma once
+
+#include "Manus.h"
+#include "SpscQueue.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+#define STREAM_MAGIC 0x53554E4D // "MNUS"
+#define STREAM_VERSION 1
+// Largest datagram sent, stays below the Ethernet MTU so it's never fragmented
+#define STREAM_MAX_DATAGRAM 1400
+// Samples staged per device for the sender thread
+#define STREAM_QUEUE_SIZE 256
+// Raw reports kept per hand by the receiver, must be a power of two
+#define STREAM_HISTORY_SIZE 64
+
+// Payloads of a record
+#define STREAM_KIND_DATA 0x01
+#define STREAM_KIND_RAW  0x02
+
+// The raw report is sent without the timestamp and packet number, the record header has those
+#define STREAM_RAW_OFFSET offsetof(GLOVE_RAW_REPORT, device_type)
+#define STREAM_RAW_SIZE (sizeof(GLOVE_RAW_REPORT) - STREAM_RAW_OFFSET)
+
+// Wire format, in the byte order of the sender. A datagram holds a
+// header followed by count records, a record holds the payloads of
+// its kind in the order data, raw.
+#pragma pack(push, 1)
+typedef struct {
+	uint32_t magic;
+	uint8_t version;
+	uint8_t count;
+	uint16_t reserved;
+	// Counts the datagrams of the sender, gaps are datagrams lost on the way
+	uint32_t sequence;
+} STREAM_HEADER;
+
+typedef struct {
+	uint8_t kind;
+	uint8_t hand;
+	uint32_t packet_number;
+	// Time from reading the report until the datagram was sent, the
+	// clocks of the machines aren't related so only the age is sent
+	uint32_t age_ns;
+} STREAM_RECORD;
+
+typedef struct {
+	float quaternion[4];
+	float acceleration[3];
+	float fingers[5];
+} STREAM_DATA;
+#pragma pack(pop)
+
+// A sample staged by a device thread
+typedef struct {
+	GLOVE_HAND hand;
+	GLOVE_DATA data;
+	GLOVE_RAW_REPORT raw;
+	uint64_t read_time;
+} STREAM_SAMPLE;
+
+// Sends the gloves over UDP to a unicast or multicast address.
+// Like the Recorder the device threads only copy the samples into a
+// lock-free queue per device, a sender thread batches them into
+// datagrams. A sample waits at most the latency budget for the next
+// ones, so small budgets trade packet rate for latency.
+class StreamSender
+{
+public:
+	class Channel
+	{
+	private:
+		friend class StreamSender;
+		SpscQueue<STREAM_SAMPLE, STREAM_QUEUE_SIZE> m_queue;
+
+	public:
+		Channel();
+		~Channel();
+
+		/*! \brief Stage a sample, called from the device thread. Never blocks. */
+		void Publish(GLOVE_HAND hand, const GLOVE_DATA& data, const GLOVE_RAW_REPORT& raw, uint64_t read_time) {
+			if (!s_streaming.load(std::memory_order_relaxed))
+				return;
+
+			STREAM_SAMPLE sample;
+			sample.hand = hand;
+			sample.data = data;
+			sample.raw = raw;
+			sample.read_time = read_time;
+			if (!m_queue.Push(sample)) {
+				s_dropped.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+
+			// Only an idle sender needs waking, it checks the queues after announcing that
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (s_idle.load(std::memory_order_relaxed))
+				Wake();
+		}
+	};
+
+	static bool Start(const GLOVE_STREAM_CONFIG& config);
+	static void Stop();
+	static bool IsStreaming() { return s_streaming; }
+	static void GetStats(uint64_t &datagrams, uint64_t &samples, uint64_t &dropped);
+
+private:
+	static std::mutex s_mutex;
+	static std::vector<Channel*> s_channels;
+	static std::atomic<bool> s_streaming;
+	static std::thread s_thread;
+	static intptr_t s_socket;
+	static uint32_t s_content;
+	static uint64_t s_latency_ns;
+	static std::atomic<uint64_t> s_datagrams;
+	static std::atomic<uint64_t> s_samples;
+	static std::atomic<uint64_t> s_dropped;
+
+	static std::mutex s_wake_mutex;
+	static std::condition_variable s_wake_cv;
+	static std::atomic<bool> s_idle;
+
+	static void Wake();
+	static void SenderThread();
+	static size_t Drain(std::vector<STREAM_SAMPLE>& batch);
+	static bool IsEmpty();
+};
+
+// Receives the gloves sent by a StreamSender on another machine and
+// serves them with the semantics of a local device.
+class StreamReceiver
+{
+private:
+	typedef struct {
+		GLOVE_DATA data;
+		bool has_data;
+		// Samples received, see ManusGetDataAfter()
+		uint64_t sequence;
+		GLOVE_RAW_REPORT history[STREAM_HISTORY_SIZE];
+		uint32_t raw_count;
+	} HAND;
+
+	intptr_t m_socket;
+	std::atomic<bool> m_running;
+	std::thread m_thread;
+
+	std::mutex m_mutex[2];
+	std::condition_variable m_cv[2];
+	HAND m_hands[2];
+	// Local time the hand was last heard of, read without the lock
+	std::atomic<uint64_t> m_last_seen[2];
+
+	bool m_sequence_valid;
+	uint32_t m_sequence;
+	std::atomic<uint64_t> m_datagrams;
+	std::atomic<uint64_t> m_samples;
+	std::atomic<uint64_t> m_lost;
+
+	static void ReceiverThread(StreamReceiver* receiver);
+	void Receive(const uint8_t* datagram, size_t length, uint64_t receive_time);
+
+public:
+	StreamReceiver();
+	~StreamReceiver();
+
+	bool Open(const char* address, unsigned short port);
+	void Close();
+
+	bool IsConnected(GLOVE_HAND hand) const;
+	int GetData(GLOVE_HAND hand, GLOVE_DATA* data, unsigned int timeout);
+	int GetDataAfter(GLOVE_HAND hand, uint64_t after_seq, GLOVE_DATA* data, uint64_t* seq, unsigned int timeout);
+	int GetRawReport(GLOVE_HAND hand, GLOVE_RAW_REPORT* report);
+	int GetRawHistory(GLOVE_HAND hand, GLOVE_RAW_REPORT* reports, unsigned int count, unsigned int* copied);
+	void GetStats(uint64_t &datagrams, uint64_t &samples, uint64_t &lost) const;
+};
@@ -0,0 +1,141 @@
+/*
+   Copyright 2015 Manus VR
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+
+#include "stdafx.h"
+#include "Trace.h"
+#include "Device.h"
+
+#include <functional>
+#include <thread>
+
+std::mutex Trace::s_mutex;
+TraceRing* Trace::s_rings[TRACE_MAX_THREADS];
+std::atomic<uint32_t> Trace::s_ring_count(0);
+
+// Hands the ring of a thread back when the thread exits
+class TraceThread
+{
+public:
+	TraceRing* m_ring;
+	bool m_acquired;
+
+	TraceThread() : m_ring(NULL), m_acquired(false) {}
+	~TraceThread() {
+		if (m_ring)
+			Trace::Release(m_ring);
+	}
+};
+
+static thread_local TraceThread s_thread;
+
+TraceRing::TraceRing()
+	: m_next(0), m_thread(0), m_in_use(false)
+{
+	for (int i = 0; i < TRACE_RING_SPANS; i++)
+		m_slots[i].sequence.store(0, std::memory_order_relaxed);
+}
+
+void TraceRing::Record(const char* name, uint64_t begin, uint64_t end)
+{
+	// Only the owning thread writes, the counter is atomic for the readers
+	uint32_t index = m_next.load(std::memory_order_relaxed);
+	m_next.store(index + 1, std::memory_order_relaxed);
+	SLOT& slot = m_slots[index & (TRACE_RING_SPANS - 1)];
+
+	uint64_t words[TRACE_SPAN_WORDS] = { 0 };
+	TRACE_SPAN* span = (TRACE_SPAN*)words;
+	span->begin = begin;
+	span->end = end;
+	span->name = name;
+	span->thread = m_thread;
+
+	slot.sequence.store(0, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	for (size_t i = 0; i < TRACE_SPAN_WORDS; i++)
+		slot.words[i].store(words[i], std::memory_order_relaxed);
+	slot.sequence.store(index + 1, std::memory_order_release);
+}
+
+void TraceRing::Collect(std::vector<TRACE_SPAN>& spans) const
+{
+	for (int i = 0; i < TRACE_RING_SPANS; i++) {
+		const SLOT& slot = m_slots[i];
+		uint32_t sequence = slot.sequence.load(std::memory_order_acquire);
+		if (!sequence)
+			continue;
+		uint64_t words[TRACE_SPAN_WORDS];
+		for (size_t w = 0; w < TRACE_SPAN_WORDS; w++)
+			words[w] = slot.words[w].load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (slot.sequence.load(std::memory_order_relaxed) == sequence)
+			spans.push_back(*(const TRACE_SPAN*)words);
+	}
+}
+
+TraceRing* Trace::ThreadRing()
+{
+	// A thread that found no free ring doesn't try again
+	if (!s_thread.m_acquired) {
+		s_thread.m_acquired = true;
+		s_thread.m_ring = Acquire();
+	}
+	return s_thread.m_ring;
+}
+
+TraceRing* Trace::Acquire()
+{
+	std::lock_guard<std::mutex> lk(s_mutex);
+	uint32_t count = s_ring_count.load(std::memory_order_relaxed);
+
+	TraceRing* ring = NULL;
+	for (uint32_t i = 0; i < count && !ring; i++) {
+		if (!s_rings[i]->m_in_use)
+			ring = s_rings[i];
+	}
+	if (!ring) {
+		if (count >= TRACE_MAX_THREADS)
+			return NULL;
+		ring = new TraceRing();
+		s_rings[count] = ring;
+		s_ring_count.store(count + 1, std::memory_order_release);
+	}
+
+	// The same thread id as the latency events, so they share a track
+	ring->m_in_use = true;
+	ring->m_thread = (uint32_t)std::hash<std::thread::id>()(std::this_thread::get_id());
+	return ring;
+}
+
+void Trace::Release(TraceRing* ring)
+{
+	std::lock_guard<std::mutex> lk(s_mutex);
+	ring->m_in_use = false;
+}
+
+void Trace::Collect(std::vector<TRACE_SPAN>& spans)
+{
+	uint32_t count = s_ring_count.load(std::memory_order_acquire);
+	for (uint32_t i = 0; i < count; i++)
+		s_rings[i]->Collect(spans);
+}
+
+void TraceScope::Finish()
+{
+	TraceRing* ring = Trace::ThreadRing();
+	if (ring)
+		ring->Record(m_name, m_begin, DeviceTimestamp());
+}
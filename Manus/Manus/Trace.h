@@ -0,0 +1,110 @@
+/*
+   Copyright 2015 Manus VR
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+
+#pragma once
+
+#include "LatencyTrace.h"
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+// Trace points for profiling the SDK itself. They are compiled in with
+// MANUS_TRACE defined and record while ManusSetTracing() is enabled,
+// without MANUS_TRACE they compile to nothing.
+#ifdef MANUS_TRACE
+#define MANUS_TRACE_CONCAT2(a, b) a##b
+#define MANUS_TRACE_CONCAT(a, b) MANUS_TRACE_CONCAT2(a, b)
+// Records the time until the end of the enclosing scope, name must be a string literal
+#define MANUS_TRACE_SCOPE(name) TraceScope MANUS_TRACE_CONCAT(trace_scope_, __LINE__)(name)
+#define MANUS_TRACE_FUNCTION() MANUS_TRACE_SCOPE(__func__)
+#else
+#define MANUS_TRACE_SCOPE(name)
+#define MANUS_TRACE_FUNCTION()
+#endif
+
+// Number of spans kept per thread, must be a power of two
+#define TRACE_RING_SPANS 1024
+// Threads that can trace at the same time, later threads aren't traced
+#define TRACE_MAX_THREADS 64
+
+// Ring of the most recent spans of one thread. Only the owning thread
+// writes, so recording is a few relaxed stores. The slots are versioned
+// the same way as in LatencyTrace so a reader can skip torn spans.
+class TraceRing
+{
+private:
+	friend class Trace;
+
+	typedef struct {
+		std::atomic<uint32_t> sequence;
+		std::atomic<uint64_t> words[TRACE_SPAN_WORDS];
+	} SLOT;
+
+	SLOT m_slots[TRACE_RING_SPANS];
+	std::atomic<uint32_t> m_next;
+	uint32_t m_thread;
+	bool m_in_use;
+
+public:
+	TraceRing();
+
+	void Record(const char* name, uint64_t begin, uint64_t end);
+	void Collect(std::vector<TRACE_SPAN>& spans) const;
+};
+
+class Trace
+{
+public:
+	/*! \brief Get the ring of the calling thread, NULL when all rings are taken. */
+	static TraceRing* ThreadRing();
+	static void Collect(std::vector<TRACE_SPAN>& spans);
+
+private:
+	// Rings are reused by new threads but never freed, so a reader never
+	// sees one go away
+	static std::mutex s_mutex;
+	static TraceRing* s_rings[TRACE_MAX_THREADS];
+	static std::atomic<uint32_t> s_ring_count;
+
+	friend class TraceThread;
+	static TraceRing* Acquire();
+	static void Release(TraceRing* ring);
+};
+
+class TraceScope
+{
+private:
+	const char* m_name;
+	// 0 when tracing was disabled at the start of the scope
+	uint64_t m_begin;
+
+	void Finish();
+
+public:
+	explicit TraceScope(const char* name) : m_name(name), m_begin(0) {
+		if (LatencyTrace::IsEnabled())
+			m_begin = std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+	~TraceScope() {
+		if (m_begin)
+			Finish();
+	}
+};
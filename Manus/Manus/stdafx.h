@@ -21,6 +21,7 @@
 
 #pragma once
 
+#ifdef _WIN32
 #include "targetver.h"
 
 #define WIN32_LEAN_AND_MEAN             // Exclude rarely-used stuff from Windows headers
@@ -29,5 +30,6 @@
 #include <windows.h>
 #include <bluetoothleapis.h>
 #include <setupapi.h>
+#endif
 
 // TODO: reference additional headers your program requires here
@@ -0,0 +1,639 @@
+/*
+Copyright 2015 Manus VR
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+
+// Benchmarks of the SDK hot paths on simulated gloves.
+// Runs without hardware and writes the results as JSON so they can be
+// compared between releases:
+//
+//   ManusBench [-o results.json] [-d dongles] [-r rate] [-t seconds]
+
+#include "stdafx.h"
+#include "Manus.h"
+#include "FixedMatrix.h"
+// Defines single letter macros, keep it last
+#include "matrix.h"
+
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+typedef std::chrono::steady_clock bench_clock;
+
+typedef struct {
+	unsigned int dongles;
+	float rate;
+	double seconds;
+	const char* output;
+} BENCH_CONFIG;
+
+static double ElapsedUs(bench_clock::time_point start, bench_clock::time_point end)
+{
+	return std::chrono::duration<double, std::micro>(end - start).count();
+}
+
+// Summary of a set of latencies in microseconds as a JSON object
+static std::string LatencyJson(std::vector<double>& samples, double seconds)
+{
+	char json[256];
+	if (samples.empty()) {
+		snprintf(json, sizeof(json), "{ \"calls\": 0 }");
+		return json;
+	}
+
+	std::sort(samples.begin(), samples.end());
+	double total = 0;
+	for (double sample : samples)
+		total += sample;
+	size_t n = samples.size();
+	snprintf(json, sizeof(json),
+		"{ \"calls\": %zu, \"calls_per_s\": %.1f, \"mean_us\": %.3f, \"p50_us\": %.3f, \"p99_us\": %.3f, \"p999_us\": %.3f, \"max_us\": %.3f }",
+		n, n / seconds, total / n, samples[n / 2], samples[n * 99 / 100], samples[n * 999 / 1000], samples[n - 1]);
+	return json;
+}
+
+static GLOVE_SIM_CONFIG SimConfig(unsigned int dongles, float rate)
+{
+	GLOVE_SIM_CONFIG sim;
+	memset(&sim, 0, sizeof(sim));
+	sim.dongles = dongles;
+	sim.gloves = 2;
+	sim.rate = rate;
+	sim.motion = GLOVE_SIM_WAVE;
+	sim.motion_frequency = 0.5f;
+	sim.seed = 1;
+	return sim;
+}
+
+static bool WaitForGloves(unsigned int timeout_ms)
+{
+	GLOVE_DATA data;
+	bench_clock::time_point end = bench_clock::now() + std::chrono::milliseconds(timeout_ms);
+	while (bench_clock::now() < end) {
+		if (ManusGetData(GLOVE_LEFT, &data) == MANUS_SUCCESS && ManusGetData(GLOVE_RIGHT, &data) == MANUS_SUCCESS)
+			return true;
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	return false;
+}
+
+// Time from ManusInit until both gloves deliver data
+static std::string BenchStartup(const BENCH_CONFIG& config)
+{
+	GLOVE_SIM_CONFIG sim = SimConfig(config.dongles, config.rate);
+	ManusSetSimulation(&sim);
+
+	bench_clock::time_point start = bench_clock::now();
+	if (ManusInit() != MANUS_SUCCESS)
+		return "{ \"error\": \"init failed\" }";
+	bench_clock::time_point initialized = bench_clock::now();
+	bool ready = WaitForGloves(5000);
+	bench_clock::time_point first_data = bench_clock::now();
+	ManusExit();
+
+	char json[128];
+	snprintf(json, sizeof(json), "{ \"init_ms\": %.3f, \"first_data_ms\": %s }",
+		ElapsedUs(start, initialized) / 1000.0, ready ? std::to_string(ElapsedUs(start, first_data) / 1000.0).c_str() : "null");
+	return json;
+}
+
+// ManusGetData latency with several threads reading at once
+static std::string BenchGetData(const BENCH_CONFIG& config, unsigned int threads, bool blocking)
+{
+	std::vector<std::vector<double>> samples(threads);
+	std::vector<std::thread> readers;
+	std::atomic<bool> running(true);
+
+	bench_clock::time_point start = bench_clock::now();
+	for (unsigned int i = 0; i < threads; i++) {
+		readers.push_back(std::thread([&, i]() {
+			GLOVE_DATA data;
+			GLOVE_HAND hand = (GLOVE_HAND)(i % 2);
+			while (running) {
+				bench_clock::time_point call = bench_clock::now();
+				int ret = ManusGetData(hand, &data, blocking ? 1000 : 0);
+				if (ret == MANUS_SUCCESS)
+					samples[i].push_back(ElapsedUs(call, bench_clock::now()));
+			}
+		}));
+	}
+	std::this_thread::sleep_for(std::chrono::duration<double>(config.seconds));
+	running = false;
+	for (std::thread& reader : readers)
+		reader.join();
+	double seconds = ElapsedUs(start, bench_clock::now()) / 1e6;
+
+	std::vector<double> all;
+	for (std::vector<double>& thread_samples : samples)
+		all.insert(all.end(), thread_samples.begin(), thread_samples.end());
+
+	char prefix[96];
+	snprintf(prefix, sizeof(prefix), "{ \"threads\": %u, \"blocking\": %s, \"latency\": ", threads, blocking ? "true" : "false");
+	return prefix + LatencyJson(all, seconds) + " }";
+}
+
+// Skeletal model simulation, includes the ManusGetData call
+static std::string BenchSkeletal(const BENCH_CONFIG& config)
+{
+	std::vector<double> samples;
+	GLOVE_SKELETAL model;
+	bench_clock::time_point start = bench_clock::now();
+	bench_clock::time_point end = start + std::chrono::duration_cast<bench_clock::duration>(std::chrono::duration<double>(config.seconds));
+	while (bench_clock::now() < end) {
+		bench_clock::time_point call = bench_clock::now();
+		if (ManusGetSkeletal(GLOVE_RIGHT, &model) == MANUS_SUCCESS)
+			samples.push_back(ElapsedUs(call, bench_clock::now()));
+	}
+	return LatencyJson(samples, ElapsedUs(start, bench_clock::now()) / 1e6);
+}
+
+// Round trip of a request through the device thread and back
+static std::string BenchCommand(const BENCH_CONFIG&)
+{
+	std::vector<double> samples;
+	uint8_t flags;
+	bench_clock::time_point start = bench_clock::now();
+	for (int i = 0; i < 200; i++) {
+		bench_clock::time_point call = bench_clock::now();
+		if (ManusGetFlags(GLOVE_RIGHT, &flags, 1000) == MANUS_SUCCESS)
+			samples.push_back(ElapsedUs(call, bench_clock::now()));
+	}
+	return LatencyJson(samples, ElapsedUs(start, bench_clock::now()) / 1e6);
+}
+
+// Decoding throughput: a capture of the simulator is replayed as fast as
+// the device thread can process it
+static std::string BenchDecode(const BENCH_CONFIG& config)
+{
+	const char* capture = "ManusBench.capture";
+
+	GLOVE_SIM_CONFIG sim = SimConfig(1, 10000.0f);
+	ManusSetSimulation(&sim);
+	if (ManusInit() != MANUS_SUCCESS)
+		return "{ \"error\": \"init failed\" }";
+	WaitForGloves(5000);
+	ManusStartCapture(capture);
+	std::this_thread::sleep_for(std::chrono::duration<double>(config.seconds));
+	ManusStopCapture();
+	ManusExit();
+
+	ManusSetSimulation(NULL);
+	ManusSetReplay(capture, 0.0f);
+	bench_clock::time_point start = bench_clock::now();
+	bench_clock::time_point last = start;
+	unsigned int packets[2] = { 0, 0 };
+	if (ManusInit() != MANUS_SUCCESS) {
+		ManusSetReplay(NULL, 1.0f);
+		remove(capture);
+		return "{ \"error\": \"replay failed\" }";
+	}
+
+	// The replay has ended when the packet numbers stop changing
+	while (ElapsedUs(last, bench_clock::now()) < 250000.0) {
+		for (int hand = 0; hand < 2; hand++) {
+			GLOVE_DATA data;
+			if (ManusGetData((GLOVE_HAND)hand, &data) == MANUS_SUCCESS && data.PacketNumber != packets[hand]) {
+				packets[hand] = data.PacketNumber;
+				last = bench_clock::now();
+			}
+		}
+		std::this_thread::yield();
+	}
+	ManusExit();
+	ManusSetReplay(NULL, 1.0f);
+	remove(capture);
+
+	double seconds = ElapsedUs(start, last) / 1e6;
+	unsigned int reports = packets[0] + packets[1];
+	char json[128];
+	snprintf(json, sizeof(json), "{ \"reports\": %u, \"seconds\": %.6f, \"reports_per_s\": %.1f }",
+		reports, seconds, seconds > 0 ? reports / seconds : 0.0);
+	return json;
+}
+
+// Time the simulated finger holds each level of the filter benchmark
+#define FILTER_STEP_S 1.0
+#define FILTER_RATE_HZ 100.0f
+
+// Square wave on every finger with noise on the index finger. The thumb
+// isn't filtered, it carries the clean level the index finger is compared to.
+static void FilterMotion(unsigned int, double time, GLOVE_DATA* data, void*)
+{
+	float level = fmod(time, 2 * FILTER_STEP_S) < FILTER_STEP_S ? 0.3f : 0.7f;
+	uint32_t hash = (uint32_t)(time * 1e6) * 2654435761u;
+	float noise = ((hash >> 8) / 16777216.0f - 0.5f) * 0.1f;
+
+	data->Quaternion.w = 1.0f;
+	data->Quaternion.x = data->Quaternion.y = data->Quaternion.z = 0.0f;
+	for (int j = 0; j < 5; j++)
+		data->Fingers[j] = level;
+	data->Fingers[GLOVE_FILTER_INDEX] = level + noise;
+}
+
+// Jitter and step delay of the index finger with one filter setting
+static std::string FilterJson(const GLOVE_FILTER_PARAMS* params, double seconds)
+{
+	ManusSetFilter(GLOVE_RIGHT, GLOVE_FILTER_INDEX, params);
+
+	GLOVE_DATA data;
+	uint64_t seq = 0;
+	float level = -1.0f, from = 0.0f;
+	uint64_t step_seq = 0;
+	bool rising = false, pending = false;
+	double delay = 0, variance = 0;
+	unsigned int steps = 0, holds = 0;
+	// Jitter is the spread around the mean in the second half of every hold
+	double sum = 0, square_sum = 0;
+	unsigned int settled = 0;
+	uint64_t settle_samples = (uint64_t)(FILTER_STEP_S * FILTER_RATE_HZ / 2);
+
+	bench_clock::time_point end = bench_clock::now() + std::chrono::duration_cast<bench_clock::duration>(std::chrono::duration<double>(seconds));
+	while (bench_clock::now() < end) {
+		if (ManusGetDataAfter(GLOVE_RIGHT, seq, &data, &seq, 1000) != MANUS_SUCCESS)
+			return "{ \"error\": \"no data\" }";
+
+		float thumb = data.Fingers[GLOVE_FILTER_THUMB];
+		float index = data.Fingers[GLOVE_FILTER_INDEX];
+		if (fabsf(thumb - level) > 0.2f) {
+			if (settled > 1) {
+				double mean = sum / settled;
+				variance += square_sum / settled - mean * mean;
+				holds++;
+			}
+			sum = square_sum = 0;
+			settled = 0;
+
+			// The first level seen only aligns the measurement with the wave
+			pending = level >= 0.0f;
+			from = level;
+			level = thumb;
+			rising = level > from;
+			step_seq = seq;
+		}
+		if (step_seq == 0)
+			continue;
+
+		float half = (from + level) / 2;
+		if (pending && (rising ? index >= half : index <= half)) {
+			delay += (seq - step_seq) / FILTER_RATE_HZ;
+			steps++;
+			pending = false;
+		}
+		if (seq - step_seq >= settle_samples) {
+			sum += index;
+			square_sum += (double)index * index;
+			settled++;
+		}
+	}
+
+	char json[192];
+	if (params)
+		snprintf(json, sizeof(json), "{ \"min_cutoff\": %.2f, \"beta\": %.2f, \"d_cutoff\": %.2f, ",
+			params->min_cutoff, params->beta, params->d_cutoff);
+	else
+		snprintf(json, sizeof(json), "{ \"filter\": null, ");
+	std::string result = json;
+	snprintf(json, sizeof(json), "\"jitter_rms\": %.5f, \"step_delay_ms\": %.1f, \"steps\": %u }",
+		holds ? sqrt(std::max(0.0, variance / holds)) : 0.0, steps ? delay / steps * 1000.0 : 0.0, steps);
+	return result + json;
+}
+
+// Smoothing filter: jitter of a noisy constant against the delay of a step,
+// the filter trades one for the other
+static std::string BenchFilter(const BENCH_CONFIG& config)
+{
+	GLOVE_SIM_CONFIG sim = SimConfig(1, FILTER_RATE_HZ);
+	sim.motion = GLOVE_SIM_SCRIPT;
+	sim.callback = FilterMotion;
+	ManusSetSimulation(&sim);
+	if (ManusInit() != MANUS_SUCCESS || !WaitForGloves(5000)) {
+		ManusExit();
+		return "[ { \"error\": \"init failed\" } ]";
+	}
+
+	const GLOVE_FILTER_PARAMS settings[] = {
+		{ 1.0f, 0.0f, 1.0f },
+		{ 1.0f, 0.5f, 1.0f },
+		{ 1.0f, 5.0f, 1.0f },
+		{ 5.0f, 0.5f, 1.0f },
+	};
+	// Every setting sees at least two full holds
+	double seconds = std::max(config.seconds, 4 * FILTER_STEP_S);
+	std::string filter = "[\n    " + FilterJson(NULL, seconds);
+	for (const GLOVE_FILTER_PARAMS& params : settings)
+		filter += ",\n    " + FilterJson(&params, seconds);
+	filter += "\n  ]";
+
+	ManusSetFilter(GLOVE_RIGHT, GLOVE_FILTER_INDEX, NULL);
+	ManusExit();
+	return filter;
+}
+
+// Random matrices compared between the routines in matrix.cpp and FixedMatrix.h
+#define MATRIX_COUNT 1000
+#define MATRIX_REPEAT 20
+// Largest difference allowed, relative to the largest element of the result
+#define MATRIX_TOLERANCE 1e-4f
+
+static float RandomFloat(uint32_t& state)
+{
+	state = state * 1664525u + 1013904223u;
+	return (state >> 8) / 8388608.0f - 1.0f;
+}
+
+static float RelativeError(const float* a, const float* b, int count)
+{
+	float largest = 1e-30f, error = 0.0f;
+	for (int i = 0; i < count; i++) {
+		largest = std::max(largest, fabsf(a[i]));
+		error = std::max(error, fabsf(a[i] - b[i]));
+	}
+	return error / largest;
+}
+
+static std::string MatrixJson(float error, double c_ns, double fixed_ns)
+{
+	char json[160];
+	snprintf(json, sizeof(json), "{ \"max_error\": %.3g, \"c_ns\": %.1f, \"fixed_ns\": %.1f, \"speedup\": %.2f }",
+		error, c_ns, fixed_ns, fixed_ns > 0 ? c_ns / fixed_ns : 0.0);
+	return json;
+}
+
+// Eigen decomposition of symmetric 10x10 matrices, the size of the magnetometer fit
+static std::string BenchEigen(float& max_error)
+{
+	std::vector<float> input(MATRIX_COUNT * 100);
+	uint32_t state = 1;
+	for (int m = 0; m < MATRIX_COUNT; m++) {
+		float* A = &input[m * 100];
+		for (int i = 0; i < 10; i++)
+			for (int j = i; j < 10; j++)
+				A[i * 10 + j] = A[j * 10 + i] = RandomFloat(state);
+	}
+
+	float A[10][10], eigval[10], eigvec[10][10];
+	float fixed_A[10][10], fixed_eigval[10], fixed_eigvec[10][10];
+	float error = 0.0f;
+	for (int m = 0; m < MATRIX_COUNT; m++) {
+		memcpy(A, &input[m * 100], sizeof(A));
+		memcpy(fixed_A, &input[m * 100], sizeof(fixed_A));
+		eigencompute(A, eigval, eigvec, 10);
+		eigencompute(fixed_A, fixed_eigval, fixed_eigvec);
+		error = std::max(error, RelativeError(eigval, fixed_eigval, 10));
+		error = std::max(error, RelativeError(&eigvec[0][0], &fixed_eigvec[0][0], 100));
+	}
+	max_error = std::max(max_error, error);
+
+	bench_clock::time_point start = bench_clock::now();
+	for (int r = 0; r < MATRIX_REPEAT; r++) {
+		for (int m = 0; m < MATRIX_COUNT; m++) {
+			memcpy(A, &input[m * 100], sizeof(A));
+			eigencompute(A, eigval, eigvec, 10);
+		}
+	}
+	double c_ns = ElapsedUs(start, bench_clock::now()) * 1000.0 / (MATRIX_REPEAT * MATRIX_COUNT);
+
+	start = bench_clock::now();
+	for (int r = 0; r < MATRIX_REPEAT; r++) {
+		for (int m = 0; m < MATRIX_COUNT; m++) {
+			memcpy(fixed_A, &input[m * 100], sizeof(fixed_A));
+			eigencompute(fixed_A, fixed_eigval, fixed_eigvec);
+		}
+	}
+	double fixed_ns = ElapsedUs(start, bench_clock::now()) * 1000.0 / (MATRIX_REPEAT * MATRIX_COUNT);
+
+	return MatrixJson(error, c_ns, fixed_ns);
+}
+
+// Inverse of NxN matrices, the sizes of the hard iron and ellipsoid fits
+template <int N>
+static std::string BenchInverse(float& max_error)
+{
+	std::vector<float> input(MATRIX_COUNT * N * N);
+	uint32_t state = N;
+	for (int m = 0; m < MATRIX_COUNT; m++) {
+		float* A = &input[m * N * N];
+		for (int i = 0; i < N * N; i++)
+			A[i] = RandomFloat(state);
+		// Keep the matrices well conditioned
+		for (int i = 0; i < N; i++)
+			A[i * N + i] += N;
+	}
+
+	float A[N][N], fixed_A[N][N];
+	float* rows[N];
+	for (int i = 0; i < N; i++)
+		rows[i] = A[i];
+	int8 col_ind[N], row_ind[N], pivot[N];
+
+	float error = 0.0f;
+	for (int m = 0; m < MATRIX_COUNT; m++) {
+		memcpy(A, &input[m * N * N], sizeof(A));
+		memcpy(fixed_A, &input[m * N * N], sizeof(fixed_A));
+		fmatrixAeqInvA(rows, col_ind, row_ind, pivot, N);
+		fmatrixAeqInvA(fixed_A);
+		error = std::max(error, RelativeError(&A[0][0], &fixed_A[0][0], N * N));
+	}
+	max_error = std::max(max_error, error);
+
+	bench_clock::time_point start = bench_clock::now();
+	for (int r = 0; r < MATRIX_REPEAT; r++) {
+		for (int m = 0; m < MATRIX_COUNT; m++) {
+			memcpy(A, &input[m * N * N], sizeof(A));
+			fmatrixAeqInvA(rows, col_ind, row_ind, pivot, N);
+		}
+	}
+	double c_ns = ElapsedUs(start, bench_clock::now()) * 1000.0 / (MATRIX_REPEAT * MATRIX_COUNT);
+
+	start = bench_clock::now();
+	for (int r = 0; r < MATRIX_REPEAT; r++) {
+		for (int m = 0; m < MATRIX_COUNT; m++) {
+			memcpy(fixed_A, &input[m * N * N], sizeof(fixed_A));
+			fmatrixAeqInvA(fixed_A);
+		}
+	}
+	double fixed_ns = ElapsedUs(start, bench_clock::now()) * 1000.0 / (MATRIX_REPEAT * MATRIX_COUNT);
+
+	return MatrixJson(error, c_ns, fixed_ns);
+}
+
+// Fixed size matrix routines against the generic ones they replace, the
+// benchmark fails when the results differ
+static std::string BenchMatrix(bool& ok)
+{
+	float max_error = 0.0f;
+	std::string eigen10 = BenchEigen(max_error);
+	std::string inverse4 = BenchInverse<4>(max_error);
+	std::string inverse7 = BenchInverse<7>(max_error);
+	ok = max_error <= MATRIX_TOLERANCE;
+
+	return "{ \"eigen10\": " + eigen10 + ",\n    \"inverse4\": " + inverse4 +
+		",\n    \"inverse7\": " + inverse7 + ",\n    \"match\": " + (ok ? "true" : "false") + " }";
+}
+
+// Encoded size of an archive block, POSE_BLOCK_SIZE in PoseCodec.h
+#define ARCHIVE_BLOCK_SIZE (64 * 1024)
+
+typedef struct {
+	uint64_t reports;
+	// Last packet number of every glove, keyed by source and device type
+	std::map<uint32_t, uint32_t> packet_numbers;
+	bool counted;
+} ARCHIVE_CHECK;
+
+static void CheckReport(unsigned int source, const GLOVE_RAW_REPORT* report, void* user_data)
+{
+	ARCHIVE_CHECK* check = (ARCHIVE_CHECK*)user_data;
+	check->reports++;
+	// The packet numbers count on over the block boundaries
+	uint32_t& last = check->packet_numbers[source << 8 | report->device_type];
+	if (report->packet_number != last + 1)
+		check->counted = false;
+	last = report->packet_number;
+}
+
+static long FileSize(const char* path)
+{
+	FILE* file = fopen(path, "rb");
+	long bytes = 0;
+	if (file) {
+		fseek(file, 0, SEEK_END);
+		bytes = ftell(file);
+		fclose(file);
+	}
+	return bytes;
+}
+
+// Size of a compressed archive of the simulated gloves and the speed of reading it back,
+// the archive spans several blocks to check that the packet numbers carry over
+static std::string BenchArchive(const BENCH_CONFIG& config, bool& ok)
+{
+	const char* archive = "ManusBench.archive";
+	ok = false;
+
+	GLOVE_SIM_CONFIG sim = SimConfig(config.dongles, config.rate);
+	ManusSetSimulation(&sim);
+	if (ManusInit() != MANUS_SUCCESS)
+		return "{ \"error\": \"init failed\" }";
+	WaitForGloves(5000);
+	ManusStartArchive(archive);
+	std::this_thread::sleep_for(std::chrono::duration<double>(config.seconds));
+	bench_clock::time_point deadline = bench_clock::now() + std::chrono::seconds(60);
+	while (FileSize(archive) <= ARCHIVE_BLOCK_SIZE && bench_clock::now() < deadline)
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	// Leave some reports for the next block
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	ManusStopCapture();
+	ManusExit();
+
+	long bytes = FileSize(archive);
+	ARCHIVE_CHECK check;
+	check.reports = 0;
+	check.counted = true;
+	bench_clock::time_point start = bench_clock::now();
+	int ret = ManusReadArchive(archive, CheckReport, &check);
+	double seconds = ElapsedUs(start, bench_clock::now()) / 1e6;
+	remove(archive);
+	if (ret != MANUS_SUCCESS || !check.reports)
+		return "{ \"error\": \"read failed\" }";
+	ok = check.counted && bytes > ARCHIVE_BLOCK_SIZE;
+
+	// A capture stores every report in a fixed size record
+	char json[256];
+	snprintf(json, sizeof(json), "{ \"reports\": %llu, \"bytes_per_report\": %.2f, \"capture_bytes_per_report\": 48, \"read_reports_per_s\": %.1f, \"packet_numbers\": %s }",
+		(unsigned long long)check.reports, (double)bytes / check.reports, check.reports / seconds, check.counted ? "true" : "false");
+	return json;
+}
+
+int main(int argc, char* argv[])
+{
+	BENCH_CONFIG config = { 1, 1000.0f, 2.0, NULL };
+	for (int i = 1; i + 1 < argc; i += 2) {
+		if (!strcmp(argv[i], "-o"))
+			config.output = argv[i + 1];
+		else if (!strcmp(argv[i], "-d"))
+			config.dongles = atoi(argv[i + 1]);
+		else if (!strcmp(argv[i], "-r"))
+			config.rate = (float)atof(argv[i + 1]);
+		else if (!strcmp(argv[i], "-t"))
+			config.seconds = atof(argv[i + 1]);
+	}
+
+	bool matrix_ok;
+	std::string matrix = BenchMatrix(matrix_ok);
+	std::string startup = BenchStartup(config);
+	std::string decode = BenchDecode(config);
+	bool archive_ok;
+	std::string archive = BenchArchive(config, archive_ok);
+	std::string filter = BenchFilter(config);
+
+	// The remaining benchmarks share one session
+	GLOVE_SIM_CONFIG sim = SimConfig(config.dongles, config.rate);
+	ManusSetSimulation(&sim);
+	if (ManusInit() != MANUS_SUCCESS || !WaitForGloves(5000)) {
+		fprintf(stderr, "The simulated gloves didn't start\n");
+		return 1;
+	}
+
+	std::string get_data;
+	const unsigned int thread_counts[] = { 1, 2, 4, 8 };
+	for (bool blocking : { false, true }) {
+		for (unsigned int threads : thread_counts) {
+			if (!get_data.empty())
+				get_data += ",\n    ";
+			get_data += BenchGetData(config, threads, blocking);
+		}
+	}
+	std::string skeletal = BenchSkeletal(config);
+	std::string command = BenchCommand(config);
+	ManusExit();
+
+	FILE* out = config.output ? fopen(config.output, "w") : stdout;
+	if (!out) {
+		fprintf(stderr, "Can't open %s\n", config.output);
+		return 1;
+	}
+	fprintf(out, "{\n");
+	fprintf(out, "  \"config\": { \"dongles\": %u, \"gloves_per_dongle\": 2, \"rate_hz\": %.1f, \"seconds\": %.1f },\n",
+		config.dongles, config.rate, config.seconds);
+	fprintf(out, "  \"startup\": %s,\n", startup.c_str());
+	fprintf(out, "  \"decode\": %s,\n", decode.c_str());
+	fprintf(out, "  \"archive\": %s,\n", archive.c_str());
+	fprintf(out, "  \"filter\": %s,\n", filter.c_str());
+	fprintf(out, "  \"matrix\": %s,\n", matrix.c_str());
+	fprintf(out, "  \"get_data\": [\n    %s\n  ],\n", get_data.c_str());
+	fprintf(out, "  \"skeletal\": %s,\n", skeletal.c_str());
+	fprintf(out, "  \"command_rtt\": %s\n", command.c_str());
+	fprintf(out, "}\n");
+	if (out != stdout)
+		fclose(out);
+
+	if (!matrix_ok) {
+		fprintf(stderr, "The fixed size matrix routines don't match matrix.cpp\n");
+		return 1;
+	}
+	if (!archive_ok) {
+		fprintf(stderr, "The archive packet numbers don't count on over its blocks\n");
+		return 1;
+	}
+	return 0;
+}
@@ -16,6 +16,7 @@
 
 using System;
 using System.Runtime.InteropServices;
+using System.Threading;
 
 namespace ManusMachina {
 #pragma warning disable 0649 // Disable 'field never assigned' warning
@@ -130,6 +131,107 @@ public struct GLOVE_SKELETAL {
             ring, pinky;
     }
 
+    /*! State of a hand for one frame, filled in by ManusGetFrames().
+     *  Unlike GLOVE_DATA it has no arrays, so an array of frames is pinned
+     *  and passed to native code as is instead of being marshaled.
+     */
+    [StructLayout(LayoutKind.Sequential)]
+    public struct GLOVE_FRAME {
+        public GLOVE_HAND hand;
+        public int dataResult;
+        public int skeletalResult;
+
+        public GLOVE_VECTOR Acceleration;
+        public GLOVE_VECTOR Euler;
+        public GLOVE_QUATERNION Quaternion;
+        public float Finger0, Finger1, Finger2, Finger3, Finger4;
+        public uint PacketNumber;
+
+        public GLOVE_SKELETAL skeletal;
+
+        public float GetFinger(int index) {
+            switch (index) {
+                case 0: return this.Finger0;
+                case 1: return this.Finger1;
+                case 2: return this.Finger2;
+                case 3: return this.Finger3;
+                case 4: return this.Finger4;
+                default: throw new InvalidOperationException();
+            }
+        }
+    }
+
+    /*! Mirror of GLOVE_OUTPUT_BUFFER, kept up to date by the SDK, see OutputBuffer. */
+    [StructLayout(LayoutKind.Sequential)]
+    public struct GLOVE_OUTPUT {
+        public int version;
+        public int reserved;
+        public long timestamp;
+
+        public GLOVE_VECTOR Acceleration;
+        public GLOVE_VECTOR Euler;
+        public GLOVE_QUATERNION Quaternion;
+        public float Finger0, Finger1, Finger2, Finger3, Finger4;
+        public uint PacketNumber;
+
+        public GLOVE_SKELETAL skeletal;
+    }
+
+    /*! Mirror of GLOVE_HAPTIC_WAVEFORM, see Glove.ManusPlayHaptic. */
+    [StructLayout(LayoutKind.Sequential)]
+    public struct GLOVE_HAPTIC_WAVEFORM {
+        public GLOVE_HAPTIC_SHAPE shape;
+        public float power;
+
+        public uint attack, decay;
+        public float sustainLevel;
+        public uint sustain, release;
+
+        public uint on, off, count;
+
+        // Pinned float array, only read during the call
+        public IntPtr samples;
+        public uint sampleCount, sampleInterval;
+    }
+
+    /*! Mirror of GLOVE_WRITE_STATS, see Glove.ManusGetWriteStats. */
+    [StructLayout(LayoutKind.Sequential)]
+    public struct GLOVE_WRITE_STATS {
+        public ulong requested;
+        public ulong written;
+        public ulong deduplicated;
+        public ulong superseded;
+        public ulong dropped;
+        public ulong throttled;
+    }
+
+    /*! Mirror of GLOVE_DONGLE_METRICS. */
+    [StructLayout(LayoutKind.Sequential)]
+    public struct GLOVE_DONGLE_METRICS {
+        public ulong packetsLeft, packetsRight;
+        public float packetsPerSecondLeft, packetsPerSecondRight;
+        public ulong jitterLeft, jitterRight;
+        public ulong decode;
+        public uint queueDepth;
+        public uint reconnects;
+        public ulong droppedCommands;
+    }
+
+    /*! Mirror of GLOVE_METRICS, see Glove.ManusGetMetrics. */
+    [StructLayout(LayoutKind.Sequential)]
+    public struct GLOVE_METRICS {
+        public const int MaxDongles = 8;
+
+        public uint dongleCount;
+        [MarshalAs(UnmanagedType.ByValArray, SizeConst = MaxDongles)]
+        public GLOVE_DONGLE_METRICS[] dongles;
+        public int readers;
+        public ulong enumerations;
+        public ulong enumerationTime;
+        public ulong skeletalEvaluations;
+        public ulong skeletalCacheHits;
+    }
+
 #pragma warning restore 0649
 
     public enum GLOVE_HAND {
@@ -137,6 +239,17 @@ public enum GLOVE_HAND {
         GLOVE_RIGHT,
     };
 
+    public enum GLOVE_OUTPUT_LAYOUT {
+        GLOVE_OUTPUT_DATA = 0,
+        GLOVE_OUTPUT_SKELETAL,
+    };
+
+    public enum GLOVE_HAPTIC_SHAPE {
+        GLOVE_HAPTIC_ADSR = 0,
+        GLOVE_HAPTIC_PULSES,
+        GLOVE_HAPTIC_CURVE,
+    };
+
 
     /*!
     *   \brief Glove class
@@ -176,6 +289,17 @@ public class Glove {
         [DllImport("Manus.dll", CallingConvention = CallingConvention.Cdecl)]
         public static extern int ManusGetData(GLOVE_HAND hand, out GLOVE_DATA data, uint timeout = 0);
 
+        /*! \brief Get the first sample of a glove after one the caller already has.
+        *
+        *  \param hand The left or right hand index.
+        *  \param afterSeq Sequence of the last sample the caller has, 0 for none.
+        *  \param data Output variable to receive the data.
+        *  \param seq Output variable to receive the sequence of the data.
+        *  \param timeout Time to wait in milliseconds.
+        */
+        [DllImport("Manus.dll", CallingConvention = CallingConvention.Cdecl)]
+        public static extern int ManusGetDataAfter(GLOVE_HAND hand, ulong afterSeq, out GLOVE_DATA data, out ulong seq, uint timeout);
+
 
         /*! \brief Get a skeletal model for the given glove state.
         *
@@ -192,6 +316,53 @@ public class Glove {
         [DllImport("Manus.dll", CallingConvention = CallingConvention.Cdecl)]
         public static extern int ManusGetSkeletal(GLOVE_HAND hand, out GLOVE_SKELETAL model, uint timeout = 1000);
 
+        /*! \brief Get the data and skeletal model of several hands in one call.
+        *
+        *  The skeletal model of a frame is computed from the data in the
+        *  same frame. The results are reported per frame in dataResult and
+        *  skeletalResult.
+        *
+        *  \param frames The frames to fill in, the hand of every frame must be set.
+        *  \param count Number of frames.
+        *  \param skeletal Also compute the skeletal models.
+        *  \param timeout Milliseconds to wait for the next sample of the first hand.
+        */
+        [DllImport("Manus.dll", CallingConvention = CallingConvention.Cdecl)]
+        public static extern int ManusGetFrames([In, Out] GLOVE_FRAME[] frames, uint count, [MarshalAs(UnmanagedType.U1)] bool skeletal, uint timeout);
+
+        /*! \brief The frames of both hands, in GLOVE_HAND order.
+        *
+        *  Allocated once and updated in place by UpdateFrames(), so reading
+        *  the gloves every frame creates no garbage.
+        */
+        public static readonly GLOVE_FRAME[] Frames = CreateFrames();
+
+        private static GLOVE_FRAME[] CreateFrames() {
+            GLOVE_FRAME[] frames = new GLOVE_FRAME[2];
+            frames[0].hand = GLOVE_HAND.GLOVE_LEFT;
+            frames[1].hand = GLOVE_HAND.GLOVE_RIGHT;
+            return frames;
+        }
+
+        /*! \brief Update the frames of both hands.
+        *
+        *  \param skeletal Also compute the skeletal models.
+        *  \param timeout Milliseconds to wait for the next sample of the left hand.
+        */
+        public static int UpdateFrames(bool skeletal = true, uint timeout = 0) {
+            return ManusGetFrames(Frames, (uint)Frames.Length, skeletal, timeout);
+        }
+
+        /*! \brief Have the SDK write every new sample of a hand into memory of the caller.
+        *
+        *  \param hand The left or right hand index.
+        *  \param memory Buffer of at least the size of the layout, or IntPtr.Zero to unbind.
+        *  \param size Size of the buffer in bytes.
+        *  \param layout What to write.
+        */
+        [DllImport("Manus.dll", CallingConvention = CallingConvention.Cdecl)]
+        public static extern int ManusBindOutputBuffer(GLOVE_HAND hand, IntPtr memory, UIntPtr size, GLOVE_OUTPUT_LAYOUT layout);
+
         /*! \brief Configure the handedness of the glove.
         *
         *  This reconfigures the glove for a different hand.
@@ -231,5 +402,107 @@ public class Glove {
         */
         [DllImport("Manus.dll", CallingConvention = CallingConvention.Cdecl)]
         public static extern int ManusSetVibration(GLOVE_HAND hand, float power);
+
+        /*! \brief Play a haptic waveform on the vibration motor.
+        *
+        *  The waveform replaces the one that is playing on the hand.
+        *
+        *  \param hand The left or right hand index.
+        *  \param waveform The waveform, it is copied.
+        */
+        [DllImport("Manus.dll", CallingConvention = CallingConvention.Cdecl)]
+        public static extern int ManusPlayHaptic(GLOVE_HAND hand, ref GLOVE_HAPTIC_WAVEFORM waveform);
+
+        /*! \brief Stop the haptic waveform and the vibration motor of a hand. */
+        [DllImport("Manus.dll", CallingConvention = CallingConvention.Cdecl)]
+        public static extern int ManusStopHaptic(GLOVE_HAND hand);
+
+        /*! \brief Limit the messages written to each dongle.
+        *
+        *  \param writesPerSecond Most writes per second to a dongle, 0 is unlimited.
+        */
+        [DllImport("Manus.dll", CallingConvention = CallingConvention.Cdecl)]
+        public static extern int ManusSetWriteBudget(uint writesPerSecond);
+
+        /*! \brief Get the message counters of all dongles together. */
+        [DllImport("Manus.dll", CallingConvention = CallingConvention.Cdecl)]
+        public static extern int ManusGetWriteStats(out GLOVE_WRITE_STATS stats);
+
+        /*! \brief Get the health of the SDK and the dongles. */
+        [DllImport("Manus.dll", CallingConvention = CallingConvention.Cdecl)]
+        public static extern int ManusGetMetrics(out GLOVE_METRICS metrics);
+
+        public const uint GLOVE_MASK_LEFT = 1 << (int)GLOVE_HAND.GLOVE_LEFT;
+        public const uint GLOVE_MASK_RIGHT = 1 << (int)GLOVE_HAND.GLOVE_RIGHT;
+
+        /*! \brief Wait until any of several hands has a new sample.
+        *
+        *  \param handMask The hands to wait for, GLOVE_MASK_LEFT and/or GLOVE_MASK_RIGHT.
+        *  \param lastSeen Two sample sequences, start with zeros. The sequence of the returned hand is updated.
+        *  \param timeout Time to wait in milliseconds.
+        *  \param which The hand with a new sample.
+        */
+        [DllImport("Manus.dll", CallingConvention = CallingConvention.Cdecl)]
+        public static extern int ManusWaitAny(uint handMask, [In, Out] uint[] lastSeen, uint timeout, out GLOVE_HAND which);
+
+        /*! \brief Write the metrics in the Prometheus text format.
+        *
+        *  \param target The file to write, or "unix:" followed by the path of a Unix socket.
+        */
+        [DllImport("Manus.dll", CallingConvention = CallingConvention.Cdecl)]
+        public static extern int ManusWriteMetrics([MarshalAs(UnmanagedType.LPStr)] string target);
+    }
+
+    /*!
+    *   \brief Glove state written by the SDK into pinned managed memory
+    *
+    *   Reading it is a plain memory copy, without a call into the SDK.
+    */
+    public class OutputBuffer : IDisposable {
+        private GLOVE_HAND hand;
+        private GLOVE_OUTPUT[] buffer = new GLOVE_OUTPUT[1];
+        private GCHandle handle;
+
+        /*! \brief Result of binding the buffer, see ManusBindOutputBuffer(). */
+        public readonly int Result;
+
+        public OutputBuffer(GLOVE_HAND hand, bool skeletal) {
+            this.hand = hand;
+            this.handle = GCHandle.Alloc(this.buffer, GCHandleType.Pinned);
+            this.Result = Glove.ManusBindOutputBuffer(hand, this.handle.AddrOfPinnedObject(),
+                (UIntPtr)Marshal.SizeOf(typeof(GLOVE_OUTPUT)),
+                skeletal ? GLOVE_OUTPUT_LAYOUT.GLOVE_OUTPUT_SKELETAL : GLOVE_OUTPUT_LAYOUT.GLOVE_OUTPUT_DATA);
+        }
+
+        /*! \brief Copy the latest sample.
+        *
+        *  \param output Output variable to receive the sample.
+        *  \return Number of samples written so far, 0 when there is no sample yet,
+        *  or Glove.ERROR when the buffer stayed in the middle of a write.
+        */
+        public int Read(out GLOVE_OUTPUT output) {
+            // Same limit as ManusReadOutputBuffer(), a stopped writer leaves the version odd
+            for (int tries = 0; tries < 100000; tries++) {
+                int version = Thread.VolatileRead(ref this.buffer[0].version);
+                if ((version & 1) != 0) {
+                    Thread.Sleep(0);
+                    continue;
+                }
+                output = this.buffer[0];
+                Thread.MemoryBarrier();
+                if (Thread.VolatileRead(ref this.buffer[0].version) == version)
+                    return (int)((uint)version / 2);
+            }
+            output = new GLOVE_OUTPUT();
+            return Glove.ERROR;
+        }
+
+        public void Dispose() {
+            if (!this.handle.IsAllocated)
+                return;
+            // The SDK no longer writes the memory once this returns
+            Glove.ManusBindOutputBuffer(this.hand, IntPtr.Zero, UIntPtr.Zero, GLOVE_OUTPUT_LAYOUT.GLOVE_OUTPUT_DATA);
+            this.handle.Free();
+        }
     }
 }
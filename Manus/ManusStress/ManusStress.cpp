@@ -0,0 +1,425 @@
+/*
+Copyright 2015 Manus VR
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+
+// Contention stress test of the public API on simulated gloves.
+// Worker threads call every entry point at once while the simulated
+// dongles are pulled out and plugged back in underneath them. Reports
+// the throughput and latency of every call and the time spent waiting
+// for the device locks as JSON, and fails when a call misbehaves:
+//
+//   ManusStress [-o results.json] [-d dongles] [-r rate] [-t seconds] [-c threads] [-p plug_ms]
+//
+// Build the Linux library with -DMANUS_SANITIZE=thread to run it under
+// ThreadSanitizer.
+
+#include "stdafx.h"
+#include "Manus.h"
+
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+typedef std::chrono::steady_clock stress_clock;
+
+// Log-linear latency buckets: 16 per power of two up to about 9 minutes (2^39 ns)
+#define STRESS_SUB_BITS 4
+#define STRESS_BUCKETS (36 << STRESS_SUB_BITS)
+#define STRESS_TRACE_FILE "ManusStress.trace.json"
+
+typedef struct {
+	unsigned int dongles;
+	float rate;
+	double seconds;
+	unsigned int threads;
+	unsigned int plug_ms;
+	const char* output;
+} STRESS_CONFIG;
+
+typedef struct {
+	uint64_t calls;
+	uint64_t succeeded;
+	// Calls that returned a code the entry point must not return
+	uint64_t failed;
+	uint64_t total_ns;
+	uint64_t max_ns;
+	uint32_t buckets[STRESS_BUCKETS];
+} OP_STATS;
+
+typedef int (*OP_FUNCTION)(GLOVE_HAND hand, uint32_t iteration);
+
+typedef struct {
+	const char* name;
+	OP_FUNCTION function;
+	// Codes besides MANUS_SUCCESS the call is allowed to return
+	int allowed[3];
+} OP;
+
+static int Bucket(uint64_t ns)
+{
+	if (ns < (1u << STRESS_SUB_BITS))
+		return (int)ns;
+	int msb = 0;
+	while (ns >> (msb + 1))
+		msb++;
+	int bucket = ((msb - STRESS_SUB_BITS + 1) << STRESS_SUB_BITS) + (int)((ns >> (msb - STRESS_SUB_BITS)) & ((1 << STRESS_SUB_BITS) - 1));
+	return bucket < STRESS_BUCKETS ? bucket : STRESS_BUCKETS - 1;
+}
+
+// Lower bound of a bucket in nanoseconds
+static uint64_t BucketValue(int bucket)
+{
+	if (bucket < (1 << STRESS_SUB_BITS))
+		return bucket;
+	int msb = (bucket >> STRESS_SUB_BITS) + STRESS_SUB_BITS - 1;
+	uint64_t sub = bucket & ((1 << STRESS_SUB_BITS) - 1);
+	return (1ull << msb) | (sub << (msb - STRESS_SUB_BITS));
+}
+
+static uint64_t Percentile(const OP_STATS& stats, double fraction)
+{
+	uint64_t target = (uint64_t)(stats.calls * fraction);
+	uint64_t seen = 0;
+	for (int i = 0; i < STRESS_BUCKETS; i++) {
+		seen += stats.buckets[i];
+		if (seen > target)
+			return BucketValue(i);
+	}
+	return stats.max_ns;
+}
+
+static int OpGetData(GLOVE_HAND hand, uint32_t)
+{
+	GLOVE_DATA data;
+	return ManusGetData(hand, &data, 0);
+}
+
+static int OpGetDataBlocking(GLOVE_HAND hand, uint32_t)
+{
+	GLOVE_DATA data;
+	return ManusGetData(hand, &data, 5);
+}
+
+static int OpGetPredictedData(GLOVE_HAND hand, uint32_t)
+{
+	GLOVE_DATA data;
+	return ManusGetPredictedData(hand, ManusGetTimestamp() + 10000000, &data);
+}
+
+static int OpGetSkeletal(GLOVE_HAND hand, uint32_t)
+{
+	GLOVE_SKELETAL model;
+	return ManusGetSkeletal(hand, &model, 0);
+}
+
+static int OpGetRawHistory(GLOVE_HAND hand, uint32_t)
+{
+	GLOVE_RAW_REPORT reports[16];
+	unsigned int copied;
+	return ManusGetRawHistory(hand, reports, 16, &copied);
+}
+
+static int OpGetGesture(GLOVE_HAND hand, uint32_t)
+{
+	int gesture;
+	return ManusGetGesture(hand, &gesture);
+}
+
+static int OpCompass(GLOVE_HAND hand, uint32_t iteration)
+{
+	// A sphere of samples so the background fit has something to do
+	int16_t compass[3] = { (int16_t)(iteration % 200 - 100), (int16_t)(iteration / 7 % 200 - 100), (int16_t)(iteration / 49 % 200 - 100) };
+	int ret = ManusAddCompassSample(hand, compass);
+	if (ret != MANUS_SUCCESS)
+		return ret;
+	float heading;
+	ret = ManusGetHeading(hand, &heading);
+	return ret == MANUS_NO_DATA ? MANUS_SUCCESS : ret;
+}
+
+static int OpSetVibration(GLOVE_HAND hand, uint32_t iteration)
+{
+	return ManusSetVibration(hand, (iteration % 10) / 10.0f);
+}
+
+static int OpGetFlags(GLOVE_HAND hand, uint32_t)
+{
+	uint8_t flags;
+	return ManusGetFlags(hand, &flags, 10);
+}
+
+static int OpSetHandedness(GLOVE_HAND hand, uint32_t)
+{
+	return ManusSetHandedness(hand, hand == GLOVE_RIGHT);
+}
+
+static int OpGetRssi(GLOVE_HAND hand, uint32_t)
+{
+	int32_t rssi;
+	return ManusGetRssi(hand, &rssi, 10);
+}
+
+static int OpGetBattery(GLOVE_HAND hand, uint32_t)
+{
+	uint8_t battery;
+	return ManusGetBatteryPercentage(hand, &battery, 10);
+}
+
+static int OpSetFilter(GLOVE_HAND hand, uint32_t iteration)
+{
+	GLOVE_FILTER_PARAMS params = { 1.0f, 0.01f, 1.0f };
+	return ManusSetFilter(hand, GLOVE_FILTER_ORIENTATION, (iteration & 1) ? &params : NULL);
+}
+
+static int OpFingerCalibration(GLOVE_HAND hand, uint32_t iteration)
+{
+	if (iteration & 1)
+		return ManusStartFingerCalibration(hand);
+	// Too short to record a range, which is reported as an error
+	int ret = ManusStopFingerCalibration(hand, false);
+	return ret == MANUS_ERROR ? MANUS_SUCCESS : ret;
+}
+
+static int OpIsConnected(GLOVE_HAND hand, uint32_t)
+{
+	ManusIsConnected(hand);
+	return MANUS_SUCCESS;
+}
+
+static int OpGetLatency(GLOVE_HAND hand, uint32_t iteration)
+{
+	GLOVE_LATENCY_HISTOGRAM histogram;
+	return ManusGetLatencyHistogram((GLOVE_LATENCY_STAGE)(iteration % GLOVE_LATENCY_STAGES), hand, &histogram);
+}
+
+// Every call may find the glove gone while its dongle is pulled out
+static const OP s_ops[] = {
+	{ "get_data", OpGetData, { MANUS_DISCONNECTED } },
+	{ "get_data_blocking", OpGetDataBlocking, { MANUS_DISCONNECTED } },
+	{ "get_predicted_data", OpGetPredictedData, { MANUS_DISCONNECTED } },
+	// The library can be built without the skeletal model
+	{ "get_skeletal", OpGetSkeletal, { MANUS_DISCONNECTED, MANUS_ERROR } },
+	{ "get_raw_history", OpGetRawHistory, { MANUS_DISCONNECTED } },
+	{ "get_gesture", OpGetGesture, { MANUS_DISCONNECTED } },
+	{ "compass", OpCompass, { MANUS_DISCONNECTED } },
+	{ "set_vibration", OpSetVibration, { MANUS_DISCONNECTED } },
+	{ "get_flags", OpGetFlags, { MANUS_DISCONNECTED } },
+	{ "set_handedness", OpSetHandedness, { MANUS_DISCONNECTED } },
+	{ "get_rssi", OpGetRssi, { MANUS_DISCONNECTED } },
+	{ "get_battery", OpGetBattery, { MANUS_DISCONNECTED } },
+	{ "set_filter", OpSetFilter, { 0 } },
+	{ "finger_calibration", OpFingerCalibration, { MANUS_DISCONNECTED } },
+	{ "is_connected", OpIsConnected, { 0 } },
+	{ "get_latency", OpGetLatency, { MANUS_NO_DATA } },
+};
+#define STRESS_OPS (sizeof(s_ops) / sizeof(s_ops[0]))
+
+static bool Allowed(const OP& op, int ret)
+{
+	if (ret == MANUS_SUCCESS)
+		return true;
+	for (int code : op.allowed)
+		if (code && code == ret)
+			return true;
+	return false;
+}
+
+static void Worker(unsigned int index, std::atomic<bool>& running, std::vector<OP_STATS>& stats)
+{
+	uint32_t iteration = 0;
+	while (running) {
+		// Every thread walks the operations in a different order
+		size_t op_index = (iteration * 7 + index * 3) % STRESS_OPS;
+		const OP& op = s_ops[op_index];
+		GLOVE_HAND hand = (GLOVE_HAND)((iteration / STRESS_OPS + index) & 1);
+
+		stress_clock::time_point start = stress_clock::now();
+		int ret = op.function(hand, iteration);
+		uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(stress_clock::now() - start).count();
+
+		OP_STATS& op_stats = stats[op_index];
+		op_stats.calls++;
+		if (ret == MANUS_SUCCESS)
+			op_stats.succeeded++;
+		else if (!Allowed(op, ret))
+			op_stats.failed++;
+		op_stats.total_ns += ns;
+		if (ns > op_stats.max_ns)
+			op_stats.max_ns = ns;
+		op_stats.buckets[Bucket(ns)]++;
+		iteration++;
+	}
+}
+
+// Gesture events have a single consumer by contract
+static void GesturePoller(std::atomic<bool>& running, std::atomic<uint64_t>& events)
+{
+	GLOVE_GESTURE_EVENT event;
+	while (running) {
+		if (ManusPollGesture(&event) == MANUS_SUCCESS)
+			events++;
+		else
+			std::this_thread::sleep_for(std::chrono::microseconds(100));
+	}
+}
+
+// Pulls the dongles out and plugs them back in, one at a time, and
+// collects the trace that is being written meanwhile
+static void HotPlug(const STRESS_CONFIG& config, std::atomic<bool>& running, std::atomic<uint64_t>& cycles)
+{
+	unsigned int dongle = 0;
+	while (running) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(config.plug_ms));
+		ManusSetSimulatedDongle(dongle, false);
+		std::this_thread::sleep_for(std::chrono::milliseconds(config.plug_ms));
+		ManusSetSimulatedDongle(dongle, true);
+		ManusWriteTrace(STRESS_TRACE_FILE);
+		dongle = (dongle + 1) % config.dongles;
+		cycles++;
+	}
+	remove(STRESS_TRACE_FILE);
+}
+
+static std::string LatencyJson(const GLOVE_LATENCY_HISTOGRAM& histogram)
+{
+	char json[256];
+	snprintf(json, sizeof(json),
+		"{ \"count\": %llu, \"mean_us\": %.3f, \"p50_us\": %.3f, \"p99_us\": %.3f, \"p999_us\": %.3f, \"max_us\": %.3f }",
+		(unsigned long long)histogram.count, histogram.mean_ns / 1000.0, histogram.p50_ns / 1000.0,
+		histogram.p99_ns / 1000.0, histogram.p999_ns / 1000.0, histogram.max_ns / 1000.0);
+	return json;
+}
+
+int main(int argc, char* argv[])
+{
+	STRESS_CONFIG config = { 2, 1000.0f, 5.0, 8, 50, NULL };
+	for (int i = 1; i + 1 < argc; i += 2) {
+		if (!strcmp(argv[i], "-o"))
+			config.output = argv[i + 1];
+		else if (!strcmp(argv[i], "-d"))
+			config.dongles = atoi(argv[i + 1]);
+		else if (!strcmp(argv[i], "-r"))
+			config.rate = (float)atof(argv[i + 1]);
+		else if (!strcmp(argv[i], "-t"))
+			config.seconds = atof(argv[i + 1]);
+		else if (!strcmp(argv[i], "-c"))
+			config.threads = atoi(argv[i + 1]);
+		else if (!strcmp(argv[i], "-p"))
+			config.plug_ms = atoi(argv[i + 1]);
+	}
+	if (config.dongles < 1 || config.threads < 1 || config.plug_ms < 1) {
+		fprintf(stderr, "Invalid arguments\n");
+		return 1;
+	}
+
+	GLOVE_SIM_CONFIG sim;
+	memset(&sim, 0, sizeof(sim));
+	sim.dongles = config.dongles;
+	sim.gloves = 2;
+	sim.rate = config.rate;
+	sim.loss = 0.01f;
+	sim.jitter_us = 100.0f;
+	sim.motion = GLOVE_SIM_RANDOM;
+	sim.motion_frequency = 1.0f;
+	sim.seed = 1;
+	if (ManusSetSimulation(&sim) != MANUS_SUCCESS || ManusInit() != MANUS_SUCCESS) {
+		fprintf(stderr, "The SDK didn't start\n");
+		return 1;
+	}
+	ManusSetTracing(true);
+
+	std::atomic<bool> running(true);
+	std::atomic<uint64_t> gesture_events(0);
+	std::atomic<uint64_t> plug_cycles(0);
+	std::vector<std::vector<OP_STATS>> stats(config.threads, std::vector<OP_STATS>(STRESS_OPS));
+	for (std::vector<OP_STATS>& thread_stats : stats)
+		memset(thread_stats.data(), 0, thread_stats.size() * sizeof(OP_STATS));
+
+	stress_clock::time_point start = stress_clock::now();
+	std::vector<std::thread> threads;
+	for (unsigned int i = 0; i < config.threads; i++)
+		threads.push_back(std::thread(Worker, i, std::ref(running), std::ref(stats[i])));
+	threads.push_back(std::thread(GesturePoller, std::ref(running), std::ref(gesture_events)));
+	threads.push_back(std::thread(HotPlug, std::cref(config), std::ref(running), std::ref(plug_cycles)));
+
+	std::this_thread::sleep_for(std::chrono::duration<double>(config.seconds));
+	running = false;
+	for (std::thread& thread : threads)
+		thread.join();
+	double seconds = std::chrono::duration<double>(stress_clock::now() - start).count();
+
+	GLOVE_LATENCY_HISTOGRAM lock_wait[2];
+	for (int hand = 0; hand < 2; hand++)
+		if (ManusGetLatencyHistogram(GLOVE_LATENCY_LOCK_WAIT, (GLOVE_HAND)hand, &lock_wait[hand]) != MANUS_SUCCESS)
+			memset(&lock_wait[hand], 0, sizeof(lock_wait[hand]));
+	ManusSetTracing(false);
+	ManusExit();
+
+	FILE* out = config.output ? fopen(config.output, "w") : stdout;
+	if (!out) {
+		fprintf(stderr, "Can't open %s\n", config.output);
+		return 1;
+	}
+
+	uint64_t total_calls = 0, total_failed = 0;
+	fprintf(out, "{\n");
+	fprintf(out, "  \"config\": { \"dongles\": %u, \"rate_hz\": %.1f, \"seconds\": %.1f, \"threads\": %u, \"plug_ms\": %u },\n",
+		config.dongles, config.rate, config.seconds, config.threads, config.plug_ms);
+	fprintf(out, "  \"calls\": {\n");
+	for (size_t op = 0; op < STRESS_OPS; op++) {
+		OP_STATS total;
+		memset(&total, 0, sizeof(total));
+		for (std::vector<OP_STATS>& thread_stats : stats) {
+			const OP_STATS& s = thread_stats[op];
+			total.calls += s.calls;
+			total.succeeded += s.succeeded;
+			total.failed += s.failed;
+			total.total_ns += s.total_ns;
+			if (s.max_ns > total.max_ns)
+				total.max_ns = s.max_ns;
+			for (int i = 0; i < STRESS_BUCKETS; i++)
+				total.buckets[i] += s.buckets[i];
+		}
+		total_calls += total.calls;
+		total_failed += total.failed;
+		fprintf(out, "    \"%s\": { \"calls\": %llu, \"calls_per_s\": %.1f, \"succeeded\": %llu, \"failed\": %llu, "
+			"\"mean_us\": %.3f, \"p50_us\": %.3f, \"p99_us\": %.3f, \"p999_us\": %.3f, \"max_us\": %.3f }%s\n",
+			s_ops[op].name, (unsigned long long)total.calls, total.calls / seconds,
+			(unsigned long long)total.succeeded, (unsigned long long)total.failed,
+			total.calls ? total.total_ns / 1000.0 / total.calls : 0.0,
+			Percentile(total, 0.5) / 1000.0, Percentile(total, 0.99) / 1000.0, Percentile(total, 0.999) / 1000.0,
+			total.max_ns / 1000.0, op + 1 < STRESS_OPS ? "," : "");
+	}
+	fprintf(out, "  },\n");
+	fprintf(out, "  \"total\": { \"calls\": %llu, \"calls_per_s\": %.1f, \"failed\": %llu },\n",
+		(unsigned long long)total_calls, total_calls / seconds, (unsigned long long)total_failed);
+	fprintf(out, "  \"lock_wait\": { \"left\": %s, \"right\": %s },\n",
+		LatencyJson(lock_wait[GLOVE_LEFT]).c_str(), LatencyJson(lock_wait[GLOVE_RIGHT]).c_str());
+	fprintf(out, "  \"gesture_events\": %llu,\n", (unsigned long long)gesture_events.load());
+	fprintf(out, "  \"plug_cycles\": %llu\n", (unsigned long long)plug_cycles.load());
+	fprintf(out, "}\n");
+	if (out != stdout)
+		fclose(out);
+
+	if (total_failed) {
+		fprintf(stderr, "%llu calls returned an unexpected code\n", (unsigned long long)total_failed);
+		return 1;
+	}
+	return 0;
+}
@@ -78,6 +78,8 @@ int _tmain(int argc, _TCHAR* argv[])
 		ClearScreenPart(0);
 		ClearScreenPart(1);
 		bool running = true;
+		uint32_t last_seen[2] = { 0 };
+		LARGE_INTEGER previous[2] = { 0 };
 		while (running)
 		{
 			if (_kbhit()) 
@@ -113,11 +115,18 @@ int _tmain(int argc, _TCHAR* argv[])
 
 			}
 
+			// Only the hand with a new sample is shown, a missing glove doesn't hold up the other one
+			GLOVE_HAND which = GLOVE_LEFT;
+			int wait = ManusWaitAny(GLOVE_MASK_LEFT | GLOVE_MASK_RIGHT, last_seen, 250, &which);
+
 			for (int i = 0; i < 2; i++)
 			{
 				GLOVE_HAND hand = (GLOVE_HAND)i;
+				if (wait == MANUS_SUCCESS && hand != which && ManusIsConnected(hand))
+					continue;
 				LARGE_INTEGER start, end, elapsed;
-				QueryPerformanceCounter(&start);
+				// The interval is the time since the previous sample of the hand
+				start = previous[i];
 
 				GLOVE_DATA data = { 0 };
 				GLOVE_SKELETAL skeletal = { 0 };
@@ -125,7 +134,7 @@ int _tmain(int argc, _TCHAR* argv[])
 				COORD coord = { (SHORT)0, (SHORT)(9 * i) };
 				SetConsoleCursorPosition(GetStdHandle(STD_OUTPUT_HANDLE), coord);
 
-				if (ManusIsConnected(hand) && (ManusGetData(hand, &data, 250) == MANUS_SUCCESS))
+				if (wait == MANUS_SUCCESS && hand == which && (ManusGetData(hand, &data, 0) == MANUS_SUCCESS))
 				{
 					printf("glove: %d - %06d %s\n", i, data.PacketNumber, i > 0 ? "Right" : "Left");
 					//ManusGetSkeletal(hand, &skeletal);
@@ -138,6 +147,9 @@ int _tmain(int argc, _TCHAR* argv[])
 				}
 
 				QueryPerformanceCounter(&end);
+				previous[i] = end;
+				if (!start.QuadPart)
+					continue;
 				elapsed.QuadPart = end.QuadPart - start.QuadPart;
 				
 				float interval = (elapsed.QuadPart * 1000) / (double)freq.QuadPart;